@@ -0,0 +1,533 @@
+#include "Camera.h"
+#include "UART.h"
+#include "TimeBase.h"
+#include "inc/Profile.h"
+
+// command ids from the uCAM-III datasheet 
+#define CMD_INITIAL      0x01 
+#define CMD_GET_PICTURE  0x04 
+#define CMD_SNAPSHOT     0x05 
+#define CMD_PACKAGE_SIZE 0x06 
+#define CMD_DATA         0x0A 
+#define CMD_SYNC         0x0D 
+#define CMD_ACK          0x0E 
+#define CMD_NAK          0x0F 
+
+// the steps, in order 
+#define CAMERA_STEP_IDLE         0 
+#define CAMERA_STEP_INITIAL      1 // waiting on ACK for INITIAL 
+#define CAMERA_STEP_PACKAGE_SIZE 2 // waiting on ACK for SET PACKAGE SIZE 
+#define CAMERA_STEP_SNAPSHOT     3 // waiting on ACK for SNAPSHOT 
+#define CAMERA_STEP_GET_PICTURE  4 // waiting on ACK for GET PICTURE 
+#define CAMERA_STEP_DATA         5 // waiting on DATA, which has the picture size 
+#define CAMERA_STEP_TRANSFER     6 // packages streaming in over uDMA 
+#define CAMERA_STEP_RETRY        7 // bad JPEG package, waiting for the line to go quiet before asking again 
+#define CAMERA_STEP_DONE         8 
+#define CAMERA_STEP_ERROR        9 
+// armed mode only 
+#define CAMERA_STEP_ARMED        10 // set up, waiting for the shutter 
+#define CAMERA_STEP_KEEPALIVE    11 // waiting on ACK for the keep-alive (SET PACKAGE SIZE again, it changes nothing) 
+#define CAMERA_STEP_SYNC         12 // link lost: sending SYNC until the camera answers, then set up again 
+
+#define UART4_PRIORITY 2 
+
+// JPEG package: 2 byte id, 2 byte data size, data, 2 byte verify code 
+#define PACKAGE_SIZE     512 
+#define PACKAGE_OVERHEAD 6 
+#define PACKAGE_DATA     (PACKAGE_SIZE - PACKAGE_OVERHEAD) 
+// no bytes for this long means whatever was already asked for has finished arriving 
+#define RETRY_QUIET_MS   5 
+
+uint32_t Camera_CaptureMs = 0; 
+uint32_t Camera_ErrorStep = CAMERA_STEP_IDLE; 
+uint32_t Camera_Retransmissions = 0; 
+uint32_t Camera_Frames = 0; 
+uint32_t Camera_Fps10 = 0; 
+uint32_t Camera_ShutterUs = 0; 
+uint32_t Camera_LinkLosses = 0; 
+uint32_t Camera_SyncAttempts = 0; 
+uint32_t Camera_FrameSeq = 0; 
+uint32_t Camera_FrameMs = 0; 
+
+static uint32_t ChosenFormat = CAMERA_RAW; // what Camera_SetFormat asked for 
+static uint32_t ChosenResolution = CAMERA_RAW_160x120; 
+static uint32_t Format;     // what the capture that is running now uses 
+static uint32_t Resolution; 
+
+static uint32_t Step = CAMERA_STEP_IDLE; 
+static uint32_t StepStart;  // TimeBase_Ms when the current command went out 
+static uint32_t CaptureStart; 
+static void (*Store)(uint8_t *package, uint32_t length); 
+
+static uint32_t WireBytes;   // whole picture as it comes over the link, JPEG framing included 
+static uint32_t Package;     // next JPEG package we want to store 
+static uint32_t PackageBase; // camera package number of the DMA engine's package 0 
+static uint32_t Retries;     // for the current package 
+static uint32_t Preview;     // 1 while the viewfinder is running 
+static uint32_t FpsStart;    // TimeBase_Ms at the start of the current fps window 
+
+static uint32_t Armed;        // 1 while in armed mode 
+static uint32_t ShootPending; // Camera_Shoot came in while the camera was busy 
+static uint32_t ShutterStart; // TimeBase_Us when Camera_Shoot was called 
+static uint32_t SyncTries;    // SYNCs sent since the last reset 
+static uint32_t SyncAcked;    // camera ACKed one of them, its own SYNC comes next 
+
+#define RECOVER_NONE 0xFF 
+static uint32_t CommandRetries;  // times the current command has been sent again 
+static uint32_t Resynced;        // this picture has already been through a re-sync 
+static uint32_t ResetDone;       // and a hardware reset 
+static uint32_t RecoverLevel = RECOVER_NONE; // UART_RECOVER_* level in progress 
+static uint32_t RecoverStart; 
+
+static uint32_t BurstLeft;    // frames of the burst not stored yet, the one coming in now included 
+static uint32_t NextSent;     // SNAPSHOT for the next burst frame is already out 
+static uint32_t SnapshotMs;   // when SNAPSHOT went out for the frame coming in now 
+static uint32_t NextSnapshotMs; 
+static uint32_t NextSeq = 0; 
+
+void Camera_SetFormat(uint32_t format, uint32_t resolution) { 
+	ChosenFormat = format; 
+	ChosenResolution = resolution; 
+}
+
+static void Camera_Fail(void) { 
+	if (RecoverLevel != RECOVER_NONE) { 
+		UART_RecoveryMs[RecoverLevel] += TimeBase_Ms() - RecoverStart; 
+		RecoverLevel = RECOVER_NONE; 
+	}
+	Camera_ErrorStep = Step; 
+	Step = CAMERA_STEP_ERROR; 
+	UART_RxInterruptDisable(); 
+	DMA_UART_RxStop(); 
+}
+
+// a new picture gets the whole recovery policy again 
+static void Camera_RecoverReset(void) { 
+	CommandRetries = 0; 
+	Resynced = 0; 
+	ResetDone = 0; 
+}
+
+// start counting time against a recovery level (the last one didn't do it) 
+static void Camera_RecoverLevel(uint32_t level) { 
+	uint32_t now = TimeBase_Ms(); 
+	if (RecoverLevel != RECOVER_NONE) UART_RecoveryMs[RecoverLevel] += now - RecoverStart; 
+	RecoverLevel = level; 
+	RecoverStart = now; 
+	++UART_Recoveries[level]; 
+}
+
+// the camera answered properly again, whatever recovery was going on worked 
+static void Camera_Recovered(void) { 
+	CommandRetries = 0; 
+	if (RecoverLevel == RECOVER_NONE) return; 
+	UART_RecoveryMs[RecoverLevel] += TimeBase_Ms() - RecoverStart; 
+	RecoverLevel = RECOVER_NONE; 
+}
+
+static void Camera_Request(uint32_t package) { 
+	UART_OutCUSTOMACK(PackageBase + package); 
+}
+
+// hand the DMA engine everything from camera package "first" to the end of the picture 
+static void Camera_Receive(uint32_t first) { 
+	PackageBase = first; 
+	DMA_UART_RxStart(WireBytes - first*PACKAGE_SIZE, Camera_Request, UART4_PRIORITY); 
+}
+
+// send the command that belongs to a step and start its timeout 
+static void Camera_Enter(uint32_t step) { 
+	Step = step; 
+	StepStart = TimeBase_Ms(); 
+	switch (step) { 
+		case CAMERA_STEP_INITIAL: 
+			if (Format == CAMERA_JPEG) UART_OutCommand(CMD_INITIAL, 0x00, 0x07, 0x07, Resolution); 
+			else UART_OutCommand(CMD_INITIAL, 0x00, 0x08, Resolution, 0x05); // RAW 16 bit 
+			break; 
+		case CAMERA_STEP_PACKAGE_SIZE: 
+			UART_OutCommand(CMD_PACKAGE_SIZE, 0x08, PACKAGE_SIZE&0xFF, PACKAGE_SIZE>>8, 0x00); 
+			break; 
+		case CAMERA_STEP_SNAPSHOT: 
+			SnapshotMs = StepStart; 
+			UART_OutCommand(CMD_SNAPSHOT, (Format == CAMERA_JPEG) ? 0x00 : 0x01, 0x00, 0x00, 0x00); // compressed or RAW 
+			break; 
+		case CAMERA_STEP_GET_PICTURE: 
+			UART_OutCommand(CMD_GET_PICTURE, Preview ? 0x02 : 0x01, 0x00, 0x00, 0x00); // RAW preview, or what SNAPSHOT took 
+			break; 
+		case CAMERA_STEP_KEEPALIVE: 
+			UART_OutCommand(CMD_PACKAGE_SIZE, 0x08, PACKAGE_SIZE&0xFF, PACKAGE_SIZE>>8, 0x00); 
+			break; 
+		case CAMERA_STEP_SYNC: 
+			SyncAcked = 0; 
+			UART_OutCommand(CMD_SYNC, 0x00, 0x00, 0x00, 0x00); 
+			++SyncTries; 
+			++Camera_SyncAttempts; 
+			break; 
+		default: 
+			break; 
+	}
+}
+
+void Camera_StartCapture(void (*store)(uint8_t *package, uint32_t length)) { 
+	Preview = 0; 
+	Armed = 0; 
+	BurstLeft = 0; 
+	Format = ChosenFormat; 
+	Resolution = ChosenResolution; 
+	Store = store; 
+	CaptureStart = TimeBase_Ms(); 
+	Camera_RecoverReset(); 
+	DMA_UART_RxStop(); 
+	UART_RxInterruptEnable(UART4_PRIORITY); 
+	Camera_Enter(CAMERA_STEP_INITIAL); 
+}
+
+void Camera_StartPreview(void (*store)(uint8_t *package, uint32_t length)) { 
+	Format = CAMERA_RAW; 
+	Resolution = CAMERA_RAW_80x60; 
+	Preview = 1; 
+	Armed = 0; 
+	BurstLeft = 0; 
+	Store = store; 
+	Camera_Frames = 0; 
+	Camera_Fps10 = 0; 
+	CaptureStart = FpsStart = TimeBase_Ms(); 
+	Camera_RecoverReset(); 
+	DMA_UART_RxStop(); 
+	UART_RxInterruptEnable(UART4_PRIORITY); 
+	Camera_Enter(CAMERA_STEP_INITIAL); 
+}
+
+void Camera_StopPreview() { 
+	Preview = 0; 
+}
+
+void Camera_Arm() { 
+	Preview = 0; 
+	Armed = 1; 
+	BurstLeft = 0; 
+	ShootPending = 0; 
+	Format = ChosenFormat; 
+	Resolution = ChosenResolution; 
+	Camera_RecoverReset(); 
+	DMA_UART_RxStop(); 
+	UART_RxInterruptEnable(UART4_PRIORITY); 
+	Camera_Enter(CAMERA_STEP_INITIAL); 
+}
+
+static void Camera_Snapshot(void) { 
+	CaptureStart = TimeBase_Ms(); 
+	Camera_Enter(CAMERA_STEP_SNAPSHOT); 
+}
+
+void Camera_Shoot(void (*store)(uint8_t *package, uint32_t length)) { 
+	ShutterStart = TimeBase_Us(); 
+	PROFILE2 = PROFILE2_BIT; 
+	Store = store; 
+	Camera_RecoverReset(); 
+	if (Step == CAMERA_STEP_ARMED) Camera_Snapshot(); 
+	else ShootPending = 1; // keep-alive or re-arm in progress, go as soon as it is done 
+}
+
+// armed and idle again: take the shot that was waiting, if there is one 
+static void Camera_Ready(void) { 
+	Step = CAMERA_STEP_ARMED; 
+	StepStart = TimeBase_Ms(); 
+	if (ShootPending) { 
+		ShootPending = 0; 
+		Camera_Snapshot(); 
+	}
+}
+
+// armed mode lost the camera: sync again from scratch, then redo the set up 
+static void Camera_Rearm(void) { 
+	++Camera_LinkLosses; 
+	Camera_RecoverReset(); 
+	Resynced = 1; 
+	Camera_RecoverLevel(UART_RECOVER_RESYNC); 
+	DMA_UART_RxStop(); 
+	UART_RxInterruptEnable(UART4_PRIORITY); 
+	SyncTries = 0; 
+	Camera_Enter(CAMERA_STEP_SYNC); 
+}
+
+// something went wrong with a command: work up the recovery levels 
+static void Camera_Recover(void) { 
+	if (Step >= CAMERA_STEP_INITIAL && Step <= CAMERA_STEP_DATA && CommandRetries < UART_COMMAND_RETRIES) { 
+		// 1. glitched byte: say it again (DATA only ever comes after a GET PICTURE) 
+		++CommandRetries; 
+		Camera_RecoverLevel(UART_RECOVER_RETRY); 
+		UART_RxFlush(); 
+		Camera_Enter((Step == CAMERA_STEP_DATA) ? CAMERA_STEP_GET_PICTURE : Step); 
+		return; 
+	}
+	if (Resynced && ResetDone) { 
+		Camera_Fail(); 
+		return; 
+	}
+	// 2. sync up again and redo the set up. the SYNC step moves on to 3 (hardware reset) by itself 
+	if (Armed && Step >= CAMERA_STEP_SNAPSHOT && Step <= CAMERA_STEP_DATA) ShootPending = 1; // take it again 
+	Resynced = 1; 
+	Camera_RecoverLevel(UART_RECOVER_RESYNC); 
+	DMA_UART_RxStop(); 
+	UART_RxInterruptEnable(UART4_PRIORITY); 
+	SyncTries = 0; 
+	Camera_Enter(CAMERA_STEP_SYNC); 
+}
+
+// one reply while syncing: ACK for our SYNC, then the camera's own SYNC, which gets ACKed 
+static void Camera_SyncReply(UART_Reply *reply) { 
+	if (reply->id == CMD_ACK && reply->parameter[0] == CMD_SYNC) SyncAcked = 1; 
+	else if (reply->id == CMD_SYNC && SyncAcked) { 
+		UART_OutACK(); 
+		Camera_Enter(CAMERA_STEP_INITIAL); 
+	}
+}
+
+// a preview frame is all stored: ask for the next one before anybody looks at this one 
+static void Camera_NextFrame(void) { 
+	uint32_t now = TimeBase_Ms(); 
+	++Camera_Frames; 
+	if ((Camera_Frames % CAMERA_FPS_FRAMES) == 0) { 
+		if (now != FpsStart) Camera_Fps10 = (CAMERA_FPS_FRAMES*10000)/(now - FpsStart); 
+		FpsStart = now; 
+	}
+	UART_RxInterruptEnable(UART4_PRIORITY); 
+	Camera_Enter(CAMERA_STEP_GET_PICTURE); 
+}
+
+void Camera_StartBurst(uint32_t frames, void (*store)(uint8_t *package, uint32_t length)) { 
+	Camera_StartCapture(store); 
+	BurstLeft = frames; 
+	NextSent = 0; 
+	Camera_Frames = 0; 
+}
+
+// burst: SNAPSHOT for the next frame. the camera is done with this one once its last package is 
+// out, so tell it (JPEG wants the end of picture ACK) and start listening for replies again 
+static void Camera_NextSnapshot(void) { 
+	if (Format == CAMERA_JPEG) UART_OutCommand(CMD_ACK, 0x00, 0x00, 0xF0, 0xF0); 
+	UART_RxInterruptEnable(UART4_PRIORITY); 
+	NextSnapshotMs = TimeBase_Ms(); 
+	UART_OutCommand(CMD_SNAPSHOT, (Format == CAMERA_JPEG) ? 0x00 : 0x01, 0x00, 0x00, 0x00); 
+	NextSent = 1; 
+}
+
+// handle one reply while a command step is waiting 
+static void Camera_Reply(UART_Reply *reply) { 
+	if (Step == CAMERA_STEP_DATA) { 
+		if (reply->id != CMD_DATA) { 
+			Camera_Recover(); 
+			return; 
+		}
+		Camera_Recovered(); 
+		uint32_t num_bytes = ((uint32_t)reply->parameter[3] << 16) + ((uint32_t)reply->parameter[2] << 8) + reply->parameter[1]; 
+		WireBytes = num_bytes; 
+		if (Format == CAMERA_JPEG) { 
+			WireBytes += PACKAGE_OVERHEAD*((num_bytes + PACKAGE_DATA - 1)/PACKAGE_DATA); 
+		}
+		// from here on uDMA owns the receive side 
+		UART_RxInterruptDisable(); 
+		Step = CAMERA_STEP_TRANSFER; 
+		StepStart = TimeBase_Ms(); 
+		Package = 0; 
+		Retries = 0; 
+		Camera_Receive(0); 
+		return; 
+	}
+	// everything else wants the ACK for the command we sent 
+	static const uint8_t command[] = {0, CMD_INITIAL, CMD_PACKAGE_SIZE, CMD_SNAPSHOT, CMD_GET_PICTURE}; 
+	if (reply->id != CMD_ACK || reply->parameter[0] != command[Step]) { 
+		Camera_Recover(); 
+		return; 
+	}
+	Camera_Recovered(); 
+	if (Step == CAMERA_STEP_SNAPSHOT && Armed) { 
+		Camera_ShutterUs = TimeBase_Us() - ShutterStart; 
+		PROFILE2 = 0; 
+	}
+	if (Step == CAMERA_STEP_GET_PICTURE) { 
+		Step = CAMERA_STEP_DATA; // DATA follows the ACK by itself 
+		StepStart = TimeBase_Ms(); 
+	}
+	else if (Preview && Step == CAMERA_STEP_PACKAGE_SIZE) Camera_Enter(CAMERA_STEP_GET_PICTURE); // live frames, no snapshot 
+	else if (Armed && Step == CAMERA_STEP_PACKAGE_SIZE) Camera_Ready(); // set up, SNAPSHOT waits for the shutter 
+	else Camera_Enter(Step + 1); 
+}
+
+// check a JPEG package's framing and verify code (low byte of the sum of everything in front of it) 
+// returns the number of picture bytes in it, or -1 if it is no good 
+// expected: the package id it should have 
+static int32_t Camera_CheckPackage(uint8_t *package, uint32_t length, uint32_t expected) { 
+	uint32_t id = package[0] + ((uint32_t)package[1] << 8); 
+	uint32_t size = package[2] + ((uint32_t)package[3] << 8); 
+	if (length < PACKAGE_OVERHEAD || id != expected || size > length - PACKAGE_OVERHEAD) return -1; 
+	uint8_t sum = 0; 
+	for (uint32_t i = 0; i < size + 4; ++i) sum += package[i]; 
+	if (package[size + 4] != sum || package[size + 5] != 0) return -1; 
+	return size; 
+}
+
+// one package out of the DMA engine. returns 0 if the rest of the stream has to be thrown away 
+static uint32_t Camera_Package(uint8_t *package, uint32_t length) { 
+	if (Format != CAMERA_JPEG) { 
+		(*Store)(package, length); 
+		return 1; 
+	}
+	int32_t size = Camera_CheckPackage(package, length, Package); 
+	if (size < 0) { 
+		// everything already asked for after this one is going to come in anyway, so stop 
+		// listening, let the line go quiet, and then ask again starting from the bad one 
+		if (++Retries > CAMERA_MAX_RETRIES) { 
+			Camera_Fail(); 
+			return 0; 
+		}
+		++Camera_Retransmissions; 
+		DMA_UART_RxStop(); 
+		Step = CAMERA_STEP_RETRY; 
+		StepStart = TimeBase_Ms(); 
+		return 0; 
+	}
+	(*Store)(package + 4, size); 
+	++Package; 
+	Retries = 0; 
+	return 1; 
+}
+
+// burst: once the whole frame is in, and nothing that is left could need asking for again, 
+// the snapshot buffer is free for the next frame 
+static void Camera_Overlap(void) { 
+	uint8_t *package; 
+	uint32_t length; 
+	if (BurstLeft <= 1 || NextSent || !DMA_UART_RxReceived()) return; 
+	if (Format == CAMERA_JPEG) { 
+		for (uint32_t i = 0; (package = DMA_UART_RxPeek(i, &length)) != 0; ++i) { 
+			if (Camera_CheckPackage(package, length, Package + i) < 0) return; // retransmit first 
+		}
+	}
+	Camera_NextSnapshot(); 
+}
+
+// burst: a whole frame is stored, move on to the next one (its SNAPSHOT may already be ACKed) 
+static uint32_t Camera_BurstFrame(void) { 
+	uint32_t now = TimeBase_Ms(); 
+	Camera_FrameSeq = NextSeq++; 
+	Camera_FrameMs = SnapshotMs; 
+	++Camera_Frames; 
+	if (--BurstLeft == 0) { 
+		Camera_CaptureMs = now - CaptureStart; 
+		if (now != CaptureStart) Camera_Fps10 = (Camera_Frames*10000)/(now - CaptureStart); 
+		if (Format == CAMERA_JPEG) UART_OutCommand(CMD_ACK, 0x00, 0x00, 0xF0, 0xF0); // end of picture 
+		Step = CAMERA_STEP_DONE; 
+		return CAMERA_DONE; 
+	}
+	if (!NextSent) Camera_NextSnapshot(); 
+	NextSent = 0; 
+	Step = CAMERA_STEP_SNAPSHOT; 
+	StepStart = SnapshotMs = NextSnapshotMs; 
+	return CAMERA_FRAME; 
+}
+
+uint32_t Camera_Poll() { 
+	UART_Reply reply; 
+	uint8_t *package; 
+	uint32_t length; 
+	switch (Step) { 
+		case CAMERA_STEP_IDLE: 
+			return CAMERA_IDLE; 
+		case CAMERA_STEP_DONE: 
+			return CAMERA_DONE; 
+		case CAMERA_STEP_ERROR: 
+			if (Armed) Camera_Rearm(); // report it once, then get the camera back in the background 
+			return CAMERA_ERROR; 
+		case CAMERA_STEP_ARMED: 
+			UART_RxFlush(); // nothing is expected, don't let noise pile up in front of the next reply 
+			if ((TimeBase_Ms() - StepStart) >= CAMERA_KEEPALIVE_MS) Camera_Enter(CAMERA_STEP_KEEPALIVE); 
+			return CAMERA_ARMED; 
+		case CAMERA_STEP_KEEPALIVE: 
+			if (UART_InReply(&reply)) { 
+				if (reply.id == CMD_ACK && reply.parameter[0] == CMD_PACKAGE_SIZE) Camera_Ready(); 
+				else Camera_Rearm(); 
+			}
+			else if ((TimeBase_Ms() - StepStart) > CAMERA_REPLY_TIMEOUT_MS) Camera_Rearm(); 
+			break; 
+		case CAMERA_STEP_SYNC: 
+			while (Step == CAMERA_STEP_SYNC && UART_InReply(&reply)) { 
+				Camera_SyncReply(&reply); 
+			}
+			// same schedule as UART_Sync, but a SYNC that has been ACKed gets the full reply timeout 
+			if (Step == CAMERA_STEP_SYNC && (TimeBase_Ms() - StepStart) >= (SyncAcked ? CAMERA_REPLY_TIMEOUT_MS : UART_SYNC_DELAY_MS(SyncTries - 1))) { 
+				if (SyncTries >= UART_SYNC_TRIES) { 
+					if (ResetDone && !Armed) { // armed mode keeps trying in the background 
+						Camera_Fail(); 
+						return CAMERA_ERROR; 
+					}
+					// 3. nothing at this rate, reset and start over at the camera's power up rate 
+					ResetDone = 1; 
+					Camera_RecoverLevel(UART_RECOVER_RESET); 
+					Camera_HardwareReset(); 
+					UART_SetBaudRate(115200); 
+					UART_RxInterruptEnable(UART4_PRIORITY); 
+					SyncTries = 0; 
+				}
+				Camera_Enter(CAMERA_STEP_SYNC); 
+			}
+			break; 
+		case CAMERA_STEP_RETRY: 
+			if (UART_RxFlush() != 0) StepStart = TimeBase_Ms(); // still talking 
+			else if ((TimeBase_Ms() - StepStart) >= RETRY_QUIET_MS) { 
+				Step = CAMERA_STEP_TRANSFER; 
+				StepStart = TimeBase_Ms(); 
+				Camera_Receive(Package); 
+			}
+			return CAMERA_BUSY; 
+		case CAMERA_STEP_TRANSFER: 
+			Camera_Overlap(); 
+			while (Step == CAMERA_STEP_TRANSFER && (package = DMA_UART_RxGet(&length)) != 0) { 
+				if (!Camera_Package(package, length)) break; 
+				DMA_UART_RxRelease(); 
+				StepStart = TimeBase_Ms(); // timeout is per package, not per picture 
+				Camera_Overlap(); 
+			}
+			if (Step == CAMERA_STEP_TRANSFER && DMA_UART_RxDone()) { 
+				if (BurstLeft) return Camera_BurstFrame(); 
+				if (Format == CAMERA_JPEG) UART_OutCommand(CMD_ACK, 0x00, 0x00, 0xF0, 0xF0); // end of picture 
+				if (Preview) { 
+					Camera_NextFrame(); 
+					return CAMERA_FRAME; 
+				}
+				Camera_CaptureMs = TimeBase_Ms() - CaptureStart; 
+				if (Armed) { 
+					// receive side goes back to queueing replies for the keep-alive 
+					UART_RxInterruptEnable(UART4_PRIORITY); 
+					Camera_Ready(); 
+					return CAMERA_DONE; 
+				}
+				Step = CAMERA_STEP_DONE; 
+				return CAMERA_DONE; 
+			}
+			break; 
+		default: 
+			while (Step < CAMERA_STEP_TRANSFER && UART_InReply(&reply)) { 
+				Camera_Reply(&reply); 
+			}
+			break; 
+	}
+	if (Step == CAMERA_STEP_ERROR) return CAMERA_ERROR; 
+	if (Step == CAMERA_STEP_ARMED) return CAMERA_ARMED; 
+	if (Step >= CAMERA_STEP_ARMED) return CAMERA_BUSY; // background steps time themselves 
+	if (Step != CAMERA_STEP_RETRY && (TimeBase_Ms() - StepStart) > CAMERA_REPLY_TIMEOUT_MS) { 
+		if (Step != CAMERA_STEP_TRANSFER) Camera_Recover(); 
+		else if (Format == CAMERA_JPEG && Retries < CAMERA_MAX_RETRIES) { 
+			// packages went missing: same as a bad checksum, ask again from the first one we don't have 
+			++Retries; 
+			++Camera_Retransmissions; 
+			DMA_UART_RxStop(); 
+			Step = CAMERA_STEP_RETRY; 
+			StepStart = TimeBase_Ms(); 
+		}
+		else Camera_Fail(); // RAW bytes are already stored, there is no asking for them again 
+		if (Step == CAMERA_STEP_ERROR) return CAMERA_ERROR; 
+	}
+	return CAMERA_BUSY; 
+}
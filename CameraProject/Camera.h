@@ -0,0 +1,122 @@
+#include <stdint.h>
+
+// non-blocking picture capture for the uCAM-III 
+// the camera must already be synced (Initialize_Camera_Routine), then: 
+//   Camera_StartCapture(store); 
+//   while (Camera_Poll() == CAMERA_BUSY) { do other work } 
+// replies come in on UART4 interrupts and timeouts run off TimeBase_Ms, so every step 
+// moves on as soon as the camera answers instead of after a fixed delay 
+
+// return values of Camera_Poll 
+#define CAMERA_IDLE  0  // nothing started 
+#define CAMERA_BUSY  1  // still going, call Camera_Poll again 
+#define CAMERA_DONE  2  // picture stored 
+#define CAMERA_ERROR 3  // NAK, unexpected reply or timeout. Camera_ErrorStep says where 
+#define CAMERA_FRAME 4  // preview and burst: a whole frame has been stored and the next one is already on its way 
+#define CAMERA_ARMED 5  // armed mode: set up and waiting for Camera_Shoot 
+
+// picture formats for Camera_SetFormat 
+#define CAMERA_RAW  0 // 16 bit RGB565, one continuous block of pixels 
+#define CAMERA_JPEG 1 // compressed, comes in packages that each carry their own checksum 
+
+// resolutions for CAMERA_RAW 
+#define CAMERA_RAW_80x60    0x01 
+#define CAMERA_RAW_160x120  0x03 
+#define CAMERA_RAW_128x128  0x09 
+#define CAMERA_RAW_128x96   0x0B 
+
+// resolutions for CAMERA_JPEG 
+#define CAMERA_JPEG_160x128 0x03 
+#define CAMERA_JPEG_320x240 0x05 
+#define CAMERA_JPEG_640x480 0x07 
+
+// a JPEG package that fails its checksum gets asked for again this many times before we give up 
+#define CAMERA_MAX_RETRIES 3 
+
+// how long the camera gets to answer a command before we give up 
+#define CAMERA_REPLY_TIMEOUT_MS 500 
+
+// milliseconds from Camera_StartCapture to the last package stored, for the last good capture 
+extern uint32_t Camera_CaptureMs; 
+
+// JPEG packages that had to be asked for again, since power up 
+extern uint32_t Camera_Retransmissions; 
+
+// preview or burst frames stored since Camera_StartPreview / Camera_StartBurst 
+extern uint32_t Camera_Frames; 
+
+// preview frames per second times 10, measured over the last CAMERA_FPS_FRAMES frames 
+// (for a burst: over the whole burst, once it is done) 
+#define CAMERA_FPS_FRAMES 16 
+extern uint32_t Camera_Fps10; 
+
+// burst: sequence number (counts up since power up) and snapshot time (TimeBase_Ms) of the 
+// frame that was just stored, valid when Camera_Poll returns CAMERA_FRAME or CAMERA_DONE 
+extern uint32_t Camera_FrameSeq; 
+extern uint32_t Camera_FrameMs; 
+
+// armed mode: send a keep-alive this often while waiting for the shutter, so a dead link is found before the button is 
+#define CAMERA_KEEPALIVE_MS 2000 
+
+// armed mode: microseconds from Camera_Shoot to the camera ACKing SNAPSHOT, for the last shot 
+// PE3 (Profile 2) is also high for that time, so it can be checked with a scope 
+extern uint32_t Camera_ShutterUs; 
+
+// armed mode: times the link was found dead and the camera had to be synced and set up again 
+extern uint32_t Camera_LinkLosses; 
+
+// SYNCs sent getting the camera back after link losses and failed commands, since power up 
+// (the first sync is UART_Sync's, see UART_SyncAttempts and friends) 
+extern uint32_t Camera_SyncAttempts; 
+
+// a command that gets no reply, a NAK or a wrong reply is not the end of a capture: it is sent 
+// again, then the camera is synced again and set up from INITIAL, then it is hardware reset and 
+// synced from scratch, each level at most once per picture (UART_COMMAND_RETRIES sends for the first). 
+// only when all of that fails does Camera_Poll return CAMERA_ERROR. every level is counted in 
+// UART_Recoveries / UART_RecoveryMs. an armed shot that needed a re-sync is taken again afterwards 
+
+// the step we were on when the last capture failed (one of the CAMERA_STEP_* values in Camera.c) 
+extern uint32_t Camera_ErrorStep; 
+
+// choose what the next Camera_StartCapture takes. default is CAMERA_RAW at CAMERA_RAW_160x120 
+// format: CAMERA_RAW or CAMERA_JPEG, resolution: one of the matching values above 
+void Camera_SetFormat(uint32_t format, uint32_t resolution); 
+
+// begin taking a picture 
+// store: called with every package, in order, as soon as it has arrived. 
+//        for JPEG this is only the picture data of a package that passed its checksum 
+//        the package buffer can be reused as soon as store returns 
+void Camera_StartCapture(void (*store)(uint8_t *package, uint32_t length)); 
+
+// move the capture along as far as it can go without waiting 
+// returns one of the CAMERA_* values above 
+uint32_t Camera_Poll(void); 
+
+// viewfinder: keep pulling RAW preview frames at 80x60 (the smallest) until Camera_StopPreview 
+// every time Camera_Poll returns CAMERA_FRAME, store has seen a whole frame. GET PICTURE for 
+// the next frame has already gone out by then, so the camera works on it while the caller 
+// puts this one on the screen. store must be ready for the next frame before the next Camera_Poll 
+void Camera_StartPreview(void (*store)(uint8_t *package, uint32_t length)); 
+
+// stop after the frame that is coming in now. Camera_Poll returns CAMERA_DONE once it is stored 
+void Camera_StopPreview(void); 
+
+// armed mode: do INITIAL and SET PACKAGE SIZE once, for the format from Camera_SetFormat, 
+// and leave only SNAPSHOT and GET PICTURE for the shutter. the camera must already be synced 
+// keep calling Camera_Poll while waiting: it returns CAMERA_ARMED when ready, and CAMERA_BUSY while 
+// it is setting up, checking the link, or syncing again after the link was lost 
+// Camera_StartCapture and Camera_StartPreview reconfigure the camera, so they disarm it 
+void Camera_Arm(void); 
+
+// armed mode: take a picture now, or as soon as the camera is armed again if it is busy 
+// store: same as for Camera_StartCapture 
+// Camera_Poll returns CAMERA_DONE (or CAMERA_ERROR) once for the shot, then goes back to CAMERA_ARMED 
+void Camera_Shoot(void (*store)(uint8_t *package, uint32_t length)); 
+
+// burst: take frames pictures back to back, in the format from Camera_SetFormat 
+// as soon as the camera has sent the last package of frame k (and for JPEG, every package still 
+// waiting to be stored has passed its checksum), SNAPSHOT for frame k+1 goes out, so the camera 
+// fills its snapshot buffer again while the end of frame k is still being written to storage 
+// Camera_Poll returns CAMERA_FRAME after every frame but the last, and CAMERA_DONE after the last. 
+// like the preview, store must be ready for the next frame before the next Camera_Poll 
+void Camera_StartBurst(uint32_t frames, void (*store)(uint8_t *package, uint32_t length)); 
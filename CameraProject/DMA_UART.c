@@ -7,6 +7,26 @@ uint32_t ucControlTable[256] __attribute__ ((aligned(1024)));
 // UART4RX uses uDMA channel 18, encoding 2
 #define CH18    (18*4)
 #define BIT18 0x00040000  
+// the alternate control structures start 512 bytes (128 words) into the table 
+#define ALTCH18 (128+18*4)
+
+#define UDMA_CHCTL_XFERMODE_M        0x00000007  // transfer mode bits, 0 once a structure is done 
+#define UDMA_CHCTL_XFERMODE_BASIC    0x00000001
+#define UDMA_CHCTL_XFERMODE_PINGPONG 0x00000003
+
+volatile uint32_t DMA_UART_RxStalls = 0; 
+
+static uint8_t RxBuffers[DMA_UART_NUM_BUFFERS][DMA_UART_BUFFER_SIZE]; 
+static uint32_t RxLength[DMA_UART_NUM_BUFFERS]; 
+static void (*RxRequest)(uint32_t package); 
+static uint32_t RxTotal;              // bytes in the whole stream 
+static uint32_t RxNumPackages;        // packages in the whole stream 
+// package counters, each one only ever counts up: 
+// Released <= Taken <= Filled <= Armed <= NumPackages 
+static volatile uint32_t RxArmed;     // handed to the controller 
+static volatile uint32_t RxFilled;    // finished by the controller 
+static volatile uint32_t RxTaken;     // given to the consumer 
+static volatile uint32_t RxReleased;  // given back by the consumer 
 
 void DMA_UART_Init() { 
 	int i; 
@@ -21,7 +41,7 @@ void DMA_UART_Init() {
 	UDMA_CFG_R |= 0x01; 
 	// program location of channel control table w DMACTLBASE register
 	UDMA_CTLBASE_R = (uint32_t)ucControlTable;
-	UDMA_CHMAP2_R &= 0x00000200; // setting enc. 2 for channel 18 
+	UDMA_CHMAP2_R = (UDMA_CHMAP2_R&0xFFFFF0FF)|0x00000200; // setting enc. 2 for channel 18 (bits 11:8) 
 	// configure channel attributes for this specific DMA 
 	UDMA_PRIOCLR_R = BIT18;     // default, not high priority
   UDMA_ALTCLR_R = BIT18;      // use primary control
@@ -75,3 +95,107 @@ void DMA_UART_Enable() {
 void DMA_UART_Disable() { 
 	UART4_DMACTL_R &= 0xFFFFFFFFE; // disable last bit 
 }
+
+
+// package k always goes into buffer k%DMA_UART_NUM_BUFFERS, and even packages use the primary 
+// control structure while odd ones use the alternate, since ping-pong flips between the two 
+static void DMA_UART_Arm(uint32_t package) { 
+	uint32_t index = (package&1) ? ALTCH18 : CH18; 
+	uint32_t buffer = package%DMA_UART_NUM_BUFFERS; 
+	uint32_t count = RxTotal - package*DMA_UART_BUFFER_SIZE; 
+	if (count > DMA_UART_BUFFER_SIZE) count = DMA_UART_BUFFER_SIZE; 
+	RxLength[buffer] = count; 
+	ucControlTable[index]   = (uint32_t)&UART4_DR_R; 
+	ucControlTable[index+1] = (uint32_t)RxBuffers[buffer]+count-1; 
+	// same control word as DMA_UART_Transfer, but the last package is basic so the channel stops by itself 
+	ucControlTable[index+2] = 0x0C000000+((count-1)<<4)+ 
+		((package+1 < RxNumPackages) ? UDMA_CHCTL_XFERMODE_PINGPONG : UDMA_CHCTL_XFERMODE_BASIC); 
+	++RxArmed; 
+	if (RxRequest) (*RxRequest)(package); 
+}
+
+// keep both control structures loaded as long as the consumer has handed buffers back 
+// called from the handler, and with interrupts off from the consumer side 
+static void DMA_UART_Refill(void) { 
+	while (RxArmed < RxNumPackages && RxArmed - RxFilled < 2) { 
+		if (RxArmed - RxReleased >= DMA_UART_NUM_BUFFERS) { 
+			++DMA_UART_RxStalls; // consumer is behind, DMA_UART_RxRelease will pick this back up 
+			break; 
+		}
+		DMA_UART_Arm(RxArmed); 
+	}
+	// ping-pong ran into an empty structure (or we just started): point the channel at the oldest 
+	// armed package and turn it back on. bytes wait in the uart fifo in the meantime 
+	uint32_t oldest = (RxFilled&1) ? ALTCH18 : CH18; 
+	if (RxFilled < RxArmed && DMA_UART_Status() == 0 && 
+		(ucControlTable[oldest+2]&UDMA_CHCTL_XFERMODE_M) != 0) { // finished ones are left for the handler 
+		if (RxFilled&1) UDMA_ALTSET_R = BIT18; 
+		else UDMA_ALTCLR_R = BIT18; 
+		UDMA_ENASET_R = BIT18; 
+	}
+}
+
+void DMA_UART_RxStart(uint32_t num_bytes, void (*request)(uint32_t package), uint32_t priority) { 
+	DMA_UART_RxStop(); 
+	RxRequest = request; 
+	RxTotal = num_bytes; 
+	RxNumPackages = (num_bytes + DMA_UART_BUFFER_SIZE - 1)/DMA_UART_BUFFER_SIZE; 
+	RxArmed = RxFilled = RxTaken = RxReleased = 0; 
+	UDMA_CHIS_R = BIT18; // clear anything left over 
+	// UART4 is interrupt number 60: priority lives in bits 7:5 of PRI15, enable is bit 28 of EN1 
+	NVIC_PRI15_R = (NVIC_PRI15_R&0xFFFFFF00)|(priority<<5); 
+	NVIC_EN1_R = 1<<28; 
+	UART4_DMACTL_R |= 0x01; 
+	long sr = StartCritical(); 
+	DMA_UART_Refill(); 
+	EndCritical(sr); 
+}
+
+uint8_t * DMA_UART_RxGet(uint32_t *length) { 
+	if (RxTaken == RxFilled) return 0; // next one still coming in 
+	uint32_t buffer = RxTaken%DMA_UART_NUM_BUFFERS; 
+	++RxTaken; 
+	*length = RxLength[buffer]; 
+	return RxBuffers[buffer]; 
+}
+
+uint8_t * DMA_UART_RxPeek(uint32_t n, uint32_t *length) { 
+	if (RxTaken + n >= RxFilled) return 0; 
+	uint32_t buffer = (RxTaken + n)%DMA_UART_NUM_BUFFERS; 
+	*length = RxLength[buffer]; 
+	return RxBuffers[buffer]; 
+}
+
+void DMA_UART_RxRelease(void) { 
+	if (RxReleased == RxTaken) return; 
+	long sr = StartCritical(); 
+	++RxReleased; 
+	DMA_UART_Refill(); 
+	EndCritical(sr); 
+}
+
+uint32_t DMA_UART_RxDone(void) { 
+	return (RxReleased == RxNumPackages); 
+}
+
+uint32_t DMA_UART_RxReceived(void) { 
+	return (RxFilled == RxNumPackages); 
+}
+
+void DMA_UART_RxStop(void) { 
+	UDMA_ENACLR_R = BIT18; 
+	NVIC_DIS1_R = 1<<28; 
+	RxNumPackages = RxArmed; // nothing more gets armed 
+	RxReleased = RxTaken = RxFilled = RxArmed; 
+}
+
+// a structure that has finished has its mode bits cleared by the controller. 
+// packages always finish in order, so just walk forward from the oldest armed one 
+void DMA_UART_Handler(void) { 
+	UDMA_CHIS_R = BIT18; // acknowledge 
+	while (RxFilled < RxArmed && 
+		(ucControlTable[((RxFilled&1) ? ALTCH18 : CH18)+2]&UDMA_CHCTL_XFERMODE_M) == 0) { 
+		++RxFilled; 
+	}
+	DMA_UART_Refill(); 
+}
@@ -1,9 +1,21 @@
 #include <stdint.h>
+#ifdef HOST_SIM
+#include "tools/sim/tm4c_sim.h" // register stand-ins so the engine can be benchmarked on a pc
+#else
 #include "inc/tm4c123gh6pm.h" 
 #include "inc/CortexM.h"
+#endif
 
 extern uint8_t flag; 
 
+// receive engine: camera packages stream into a ring of package buffers using ping-pong mode 
+// need at least 2 buffers for ping-pong, the third one gives the consumer a whole package of slack 
+#define DMA_UART_NUM_BUFFERS 3 
+#define DMA_UART_BUFFER_SIZE 512 
+
+// counts how many times the controller had to stop because every buffer was still held by the consumer 
+extern volatile uint32_t DMA_UART_RxStalls; 
+
 // initialize all the dma uart4 stuff 
 void DMA_UART_Init(void); 
 
@@ -19,3 +31,35 @@ void DMA_UART_Transfer(volatile uint32_t *source, uint8_t *destination, uint32_t
 void DMA_UART_Enable(void); 
 
 void DMA_UART_Disable(void); 
+
+// start streaming num_bytes of camera data into the package buffers 
+// request: called every time a package buffer is handed to the controller (package number as input), 
+//          so the caller can ask the camera for that package. pass 0 for a free-running stream (RAW) 
+// priority: 0 (highest) to 7 (lowest) for the UART4 interrupt that signals a finished package 
+// does not wait for any data. DMA_UART_Enable must have been called first 
+void DMA_UART_RxStart(uint32_t num_bytes, void (*request)(uint32_t package), uint32_t priority); 
+
+// returns the oldest package that has finished receiving, or 0 if the next one is still coming in 
+// length: populated with the number of valid bytes in the package 
+// packages come out in order, and stay valid until they are released 
+uint8_t * DMA_UART_RxGet(uint32_t *length); 
+
+// look at a finished package without taking it: n = 0 is the one DMA_UART_RxGet would return next 
+// returns 0 if that package is still coming in 
+uint8_t * DMA_UART_RxPeek(uint32_t n, uint32_t *length); 
+
+// hand the oldest package back so its buffer can receive again 
+void DMA_UART_RxRelease(void); 
+
+// returns 1 once every package of the stream has been received and released 
+uint32_t DMA_UART_RxDone(void); 
+
+// returns 1 once every package of the stream has been received, even if some are still held 
+// the sender is finished with the stream from then on 
+uint32_t DMA_UART_RxReceived(void); 
+
+// abandon the current stream (camera went quiet, etc.) 
+void DMA_UART_RxStop(void); 
+
+// uDMA completion for channel 18 comes in on the UART4 vector, UART4_Handler (UART.c) calls this 
+void DMA_UART_Handler(void); 
@@ -0,0 +1,32 @@
+#include "Eeprom.h"
+#ifdef HOST_SIM
+#include "tools/sim/tm4c_sim.h" // EEPROM model, for the storage benchmark 
+#else
+#include "inc/tm4c123gh6pm.h"
+#endif
+
+static uint32_t Started = 0; 
+static uint32_t Usable = 0; 
+
+// EEPROM is busy after reset and after every write 
+void Eeprom_Wait() { 
+	while ((EEPROM_EEDONE_R & EEPROM_EEDONE_WORKING) != 0); 
+} 
+
+uint32_t Eeprom_Init() { 
+	if (Started) return Usable; 
+	Started = 1; 
+	// 1. clock, then wait out the power up (datasheet 8.2.4.1) 
+	SYSCTL_RCGCEEPROM_R |= SYSCTL_RCGCEEPROM_R0; 
+	while ((SYSCTL_PREEPROM_R & SYSCTL_PREEPROM_R0) == 0); 
+	Eeprom_Wait(); 
+	// 2. an interrupted write gets retried by a reset of the module 
+	if (EEPROM_EESUPP_R & (EEPROM_EESUPP_PRETRY|EEPROM_EESUPP_ERETRY)) { 
+		SYSCTL_SREEPROM_R |= SYSCTL_SREEPROM_R0; 
+		SYSCTL_SREEPROM_R &= ~SYSCTL_SREEPROM_R0; 
+		while ((SYSCTL_PREEPROM_R & SYSCTL_PREEPROM_R0) == 0); 
+		Eeprom_Wait(); 
+		if (EEPROM_EESUPP_R & (EEPROM_EESUPP_PRETRY|EEPROM_EESUPP_ERETRY)) return Usable = 0; 
+	} 
+	return Usable = 1; 
+} 
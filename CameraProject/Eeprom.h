@@ -0,0 +1,11 @@
+#include <stdint.h>
+
+// the on-chip EEPROM, shared by FileCounter (picture counter, block 0) and SDCard (each card's 
+// clock, block 1). only the bring up lives here, each user reads and writes its own block 
+
+// turn on the EEPROM, the first call only (later ones give back the same answer) 
+// returns 1 if it is usable, 0 if it came up with an error it couldn't get past 
+uint32_t Eeprom_Init(void); 
+
+// wait out the write (or power up) in progress 
+void Eeprom_Wait(void); 
@@ -0,0 +1,423 @@
+#include <string.h>
+#include "Fat32.h"
+#include "SectorCache.h"
+
+#define SECTOR_SIZE 512 
+#define FAT_ENTRIES 128          // FAT entries in a sector 
+#define DIR_ENTRY 32             // bytes per directory entry 
+#define FAT_MASK 0x0FFFFFFF      // top 4 bits of a FAT entry are reserved, and kept as they are 
+#define FAT_FREE 0 
+#define FAT_BAD  0x0FFFFFF7 
+#define FAT_EOC  0x0FFFFFFF      // end of a cluster chain 
+#define FAT_LAST 0x0FFFFFF8      // this and above: end of chain 
+#define FAT_DATE 0x0021          // 1980-01-01, there is no clock to stamp files with 
+#define GROW_CLUSTERS 8          // set aside at a time once a file runs past its expected size 
+#define NONE 0xFFFFFFFF 
+
+uint32_t Fat32_Length = 0; 
+uint32_t Fat32_Reserved = 0; 
+uint32_t Fat32_FreeClusters = NONE; 
+
+// the volume 
+static uint32_t Mounted; 
+static uint32_t FatStart;        // first sector of the first FAT 
+static uint32_t FatSectors;      // sectors per FAT 
+static uint32_t Fats;            // FAT copies 
+static uint32_t DataStart;       // first sector of cluster 2 
+static uint32_t ClusterSectors; 
+static uint32_t RootCluster; 
+static uint32_t FsInfo;          // FSInfo sector, 0 if there isn't one 
+static uint32_t Clusters;        // cluster numbers go from 2 to Clusters - 1 
+static uint32_t NextFree;        // where the search for free clusters starts 
+static void (*WriteData)(uint32_t sector, uint8_t *data); 
+
+static uint8_t Sector[SECTOR_SIZE]; // boot, FAT, directory or FSInfo sector 
+static uint32_t Loaded = NONE;      // which one. everything changed in it is written back right away, 
+                                    // so it stays the same as the card's (the cache's) copy 
+
+// the file being written 
+static uint32_t Open; 
+static uint8_t Name[11]; 
+static uint32_t RunStart[FAT32_RUNS], RunLength[FAT32_RUNS]; // clusters set aside, in file order 
+static uint32_t Runs; 
+static uint32_t Run;             // run the next data sector goes in 
+static uint32_t RunSector;       // sectors of that run already written 
+static uint8_t Partial[SECTOR_SIZE]; 
+static uint32_t Fill;            // bytes in Partial 
+static uint32_t Failed;          // data that couldn't be placed (card full) 
+static uint32_t DirSector;       // free directory entry found by Fat32_Create, 0 if the directory has to grow 
+static uint32_t DirOffset; 
+static uint32_t Taken;           // clusters linked in by Fat32_Close 
+
+static uint32_t Fat32_Get16(const uint8_t *source) { 
+	return source[0] | (source[1] << 8); 
+} 
+
+static uint32_t Fat32_Get32(const uint8_t *source) { 
+	return source[0] | (source[1] << 8) | (source[2] << 16) | ((uint32_t)source[3] << 24); 
+} 
+
+static void Fat32_Put16(uint8_t *destination, uint32_t value) { 
+	destination[0] = value & 0xFF; 
+	destination[1] = (value >> 8) & 0xFF; 
+} 
+
+static void Fat32_Put32(uint8_t *destination, uint32_t value) { 
+	Fat32_Put16(destination, value & 0xFFFF); 
+	Fat32_Put16(destination + 2, value >> 16); 
+} 
+
+// get a sector into Sector, returns 0 if it couldn't be read 
+static uint32_t Fat32_Load(uint32_t sector) { 
+	if (sector == Loaded) return 1; 
+	Loaded = NONE; 
+	if (!SectorCache_ReadSectorAt(sector, Sector)) return 0; 
+	Loaded = sector; 
+	return 1; 
+} 
+
+static void Fat32_Store(void) { 
+	SectorCache_WriteSectorAt(Loaded, Sector); 
+} 
+
+static uint32_t Fat32_ClusterSector(uint32_t cluster) { 
+	return DataStart + (cluster - 2)*ClusterSectors; 
+} 
+
+// FAT entry of a cluster, FAT_BAD if the FAT couldn't be read 
+static uint32_t Fat32_Get(uint32_t cluster) { 
+	if (!Fat32_Load(FatStart + cluster/FAT_ENTRIES)) return FAT_BAD; 
+	return Fat32_Get32(&Sector[(cluster % FAT_ENTRIES)*4]) & FAT_MASK; 
+} 
+
+// set a FAT entry in every copy of the FAT 
+static uint32_t Fat32_Set(uint32_t cluster, uint32_t value) { 
+	for (uint32_t i = 0; i < Fats; ++i) { 
+		if (!Fat32_Load(FatStart + i*FatSectors + cluster/FAT_ENTRIES)) return 0; 
+		uint8_t *entry = &Sector[(cluster % FAT_ENTRIES)*4]; 
+		Fat32_Put32(entry, (Fat32_Get32(entry) & ~FAT_MASK) | (value & FAT_MASK)); 
+		Fat32_Store(); 
+	} 
+	return 1; 
+} 
+
+// 1 if the cluster is set aside for the file being written 
+static uint32_t Fat32_Ours(uint32_t cluster) { 
+	for (uint32_t i = 0; i < Runs; ++i) { 
+		if (cluster >= RunStart[i] && cluster - RunStart[i] < RunLength[i]) return 1; 
+	} 
+	return 0; 
+} 
+
+static uint32_t Fat32_Free(uint32_t cluster) { 
+	return !Fat32_Ours(cluster) && Fat32_Get(cluster) == FAT_FREE; 
+} 
+
+// look for count free clusters in a row, from NextFree round to just before it 
+// returns the first one, or 0 if there is no run that long. longest/longest_start: the longest run seen 
+static uint32_t Fat32_FindRun(uint32_t count, uint32_t *longest_start, uint32_t *longest) { 
+	uint32_t start = 0, length = 0; 
+	uint32_t cluster = NextFree; 
+	*longest = 0; 
+	for (uint32_t n = 2; n < Clusters; ++n) { 
+		if (cluster >= Clusters) { 
+			cluster = 2; // a run doesn't wrap round 
+			length = 0; 
+		} 
+		if (Fat32_Free(cluster)) { 
+			if (length++ == 0) start = cluster; 
+			if (length > *longest) { 
+				*longest = length; 
+				*longest_start = start; 
+			} 
+			if (length == count) return start; 
+		} 
+		else length = 0; 
+		++cluster; 
+	} 
+	return 0; 
+} 
+
+// set aside count clusters for the file: one run if there is one that long, else the longest runs there are 
+static uint32_t Fat32_SetAside(uint32_t count) { 
+	while (count > 0) { 
+		uint32_t start, length; 
+		if (Runs == FAT32_RUNS) return 0; 
+		uint32_t first = Fat32_FindRun(count, &start, &length); 
+		if (first) { 
+			start = first; 
+			length = count; 
+		} 
+		else if (length == 0) return 0; // not a free cluster left 
+		RunStart[Runs] = start; 
+		RunLength[Runs] = length; 
+		++Runs; 
+		NextFree = (start + length < Clusters) ? start + length : 2; 
+		count -= length; 
+	} 
+	return 1; 
+} 
+
+// "img_1.raw" -> "IMG_1   RAW" 
+static void Fat32_Name(const char *name, uint8_t *fat_name) { 
+	memset(fat_name, ' ', 11); 
+	for (int i = 0; *name != '\0' && *name != '.'; ++name) { 
+		if (i < 8) fat_name[i++] = (*name >= 'a' && *name <= 'z') ? *name - 'a' + 'A' : *name; 
+	} 
+	if (*name == '.') ++name; 
+	for (int i = 8; *name != '\0' && i < 11; ++name) { 
+		fat_name[i++] = (*name >= 'a' && *name <= 'z') ? *name - 'a' + 'A' : *name; 
+	} 
+} 
+
+// look through the root directory for fat_name, and note the first free entry on the way 
+// (DirSector 0 if there isn't one and the directory has to grow) 
+// returns FAT32_EXISTS, FAT32_OK (not there) or FAT32_IO 
+static uint32_t Fat32_Find(const uint8_t *fat_name) { 
+	DirSector = 0; 
+	uint32_t cluster = RootCluster; 
+	for (uint32_t hops = 2; hops < Clusters && cluster >= 2 && cluster < Clusters; ++hops) { 
+		for (uint32_t s = 0; s < ClusterSectors; ++s) { 
+			uint32_t sector = Fat32_ClusterSector(cluster) + s; 
+			if (!Fat32_Load(sector)) return FAT32_IO; 
+			for (uint32_t offset = 0; offset < SECTOR_SIZE; offset += DIR_ENTRY) { 
+				uint8_t *entry = &Sector[offset]; 
+				if (entry[0] == 0x00 || entry[0] == 0xE5) { // free (0x00: and so is everything after it) 
+					if (DirSector == 0) { 
+						DirSector = sector; 
+						DirOffset = offset; 
+					} 
+					if (entry[0] == 0x00) return FAT32_OK; 
+					continue; 
+				} 
+				if ((entry[11] & 0x0F) == 0x0F || (entry[11] & 0x08)) continue; // long name piece, volume label 
+				if (memcmp(entry, fat_name, 11) == 0) return FAT32_EXISTS; 
+			} 
+		} 
+		uint32_t next = Fat32_Get(cluster); 
+		if (next == FAT_BAD) return FAT32_IO; 
+		if (next >= FAT_LAST) return FAT32_OK; 
+		cluster = next; 
+	} 
+	return FAT32_OK; 
+} 
+
+// a zeroed cluster on the end of the root directory, its first entry is the file's 
+static uint32_t Fat32_GrowDirectory(void) { 
+	uint32_t last = RootCluster, next; 
+	for (uint32_t hops = 2; hops < Clusters; ++hops) { 
+		next = Fat32_Get(last); 
+		if (next < 2 || next >= Clusters) break; 
+		last = next; 
+	} 
+	uint32_t start, length; 
+	uint32_t cluster = Fat32_FindRun(1, &start, &length); 
+	if (cluster == 0) return 0; 
+	memset(Sector, 0, SECTOR_SIZE); 
+	Loaded = NONE; 
+	for (uint32_t s = 0; s < ClusterSectors; ++s) SectorCache_WriteSectorAt(Fat32_ClusterSector(cluster) + s, Sector); 
+	SectorCache_Sync(); // zeroed before the directory runs into it 
+	if (!Fat32_Set(cluster, FAT_EOC) || !Fat32_Set(last, cluster)) return 0; 
+	++Taken; 
+	NextFree = (cluster + 1 < Clusters) ? cluster + 1 : 2; 
+	DirSector = Fat32_ClusterSector(cluster); 
+	DirOffset = 0; 
+	return 1; 
+} 
+
+// boot sector of a FAT32 volume with 512 byte sectors 
+static uint32_t Fat32_IsBoot(const uint8_t *boot) { 
+	return Fat32_Get16(&boot[11]) == SECTOR_SIZE && boot[13] != 0 && boot[16] != 0 
+		&& Fat32_Get16(&boot[22]) == 0 && Fat32_Get32(&boot[36]) != 0; 
+} 
+
+uint32_t Fat32_Mount(void (*write)(uint32_t sector, uint8_t *data)) { 
+	WriteData = write; 
+	Mounted = 0; 
+	Open = 0; 
+	Loaded = NONE; 
+	uint32_t base = 0; 
+	if (!Fat32_Load(0) || Fat32_Get16(&Sector[510]) != 0xAA55) return FAT32_NO_VOLUME; 
+	if (!Fat32_IsBoot(Sector)) { 
+		// partition table: the first partition, if it is FAT32 
+		uint8_t type = Sector[446 + 4]; 
+		if (type != 0x0B && type != 0x0C) return FAT32_NO_VOLUME; 
+		base = Fat32_Get32(&Sector[446 + 8]); 
+		if (!Fat32_Load(base) || Fat32_Get16(&Sector[510]) != 0xAA55 || !Fat32_IsBoot(Sector)) return FAT32_NO_VOLUME; 
+	} 
+	ClusterSectors = Sector[13]; 
+	Fats = Sector[16]; 
+	FatSectors = Fat32_Get32(&Sector[36]); 
+	FatStart = base + Fat32_Get16(&Sector[14]); 
+	DataStart = FatStart + Fats*FatSectors; 
+	RootCluster = Fat32_Get32(&Sector[44]); 
+	uint32_t total = Fat32_Get16(&Sector[19]); 
+	if (total == 0) total = Fat32_Get32(&Sector[32]); 
+	if (total <= DataStart - base) return FAT32_NO_VOLUME; 
+	Clusters = (total - (DataStart - base))/ClusterSectors + 2; 
+	if (Clusters > FatSectors*FAT_ENTRIES) Clusters = FatSectors*FAT_ENTRIES; 
+	FsInfo = Fat32_Get16(&Sector[48]); 
+	FsInfo = (FsInfo == 0 || FsInfo == 0xFFFF) ? 0 : base + FsInfo; 
+
+	NextFree = 2; 
+	Fat32_FreeClusters = NONE; 
+	if (FsInfo && Fat32_Load(FsInfo) && Fat32_Get32(&Sector[0]) == 0x41615252 && Fat32_Get32(&Sector[484]) == 0x61417272) { 
+		Fat32_FreeClusters = Fat32_Get32(&Sector[488]); 
+		uint32_t hint = Fat32_Get32(&Sector[492]); 
+		if (hint >= 2 && hint < Clusters) NextFree = hint; 
+		SectorCache_Keep(FsInfo); 
+	} 
+	else FsInfo = 0; 
+	Mounted = 1; 
+	return FAT32_OK; 
+} 
+
+uint32_t Fat32_Exists(const char *name) { 
+	uint8_t fat_name[11]; 
+	if (!Mounted) return 0; 
+	Fat32_Name(name, fat_name); 
+	uint32_t dir_sector = DirSector, dir_offset = DirOffset; // the open file's entry 
+	uint32_t found = Fat32_Find(fat_name); 
+	DirSector = dir_sector; 
+	DirOffset = dir_offset; 
+	return found == FAT32_EXISTS; 
+} 
+
+uint32_t Fat32_Create(const char *name, uint32_t size) { 
+	if (!Mounted) return FAT32_NO_VOLUME; 
+	Open = 0; // a file that was never closed is dropped, nothing points at its clusters 
+	Fat32_Name(name, Name); 
+	uint32_t found = Fat32_Find(Name); 
+	if (found != FAT32_OK) return found; 
+	if (DirSector) SectorCache_Keep(DirSector); // it gets written at close 
+
+	Runs = Run = RunSector = 0; 
+	Fill = 0; 
+	Failed = 0; 
+	Taken = 0; 
+	Fat32_Length = 0; 
+	uint32_t cluster_bytes = ClusterSectors*SECTOR_SIZE; 
+	uint32_t clusters = (size + cluster_bytes - 1)/cluster_bytes; 
+	if (clusters == 0) clusters = 1; 
+	if (!Fat32_SetAside(clusters)) { 
+		Runs = 0; 
+		return FAT32_FULL; 
+	} 
+	// pre-erase what the picture is expected to fill of the first run 
+	Fat32_Reserved = RunLength[0]*ClusterSectors; 
+	if (size > 0 && (size + SECTOR_SIZE - 1)/SECTOR_SIZE < Fat32_Reserved) Fat32_Reserved = (size + SECTOR_SIZE - 1)/SECTOR_SIZE; 
+	Open = 1; 
+	return FAT32_OK; 
+} 
+
+// where the next data sector goes. a file that has run past what was set aside takes the 
+// cluster right after its last one if that is free, else another run 
+// returns 0 if the card is full 
+static uint32_t Fat32_NextSector(void) { 
+	if (RunSector == RunLength[Run]*ClusterSectors) { // this run is full 
+		uint32_t next = RunStart[Run] + RunLength[Run]; 
+		if (Run + 1 == Runs && next < Clusters && Fat32_Free(next)) ++RunLength[Run]; 
+		else { 
+			if (Run + 1 == Runs && !Fat32_SetAside(GROW_CLUSTERS)) return 0; 
+			++Run; 
+			RunSector = 0; 
+		} 
+	} 
+	return Fat32_ClusterSector(RunStart[Run]) + RunSector++; 
+} 
+
+static void Fat32_Data(uint8_t *data) { 
+	uint32_t sector = Fat32_NextSector(); 
+	if (sector == 0) { 
+		Failed = 1; 
+		return; 
+	} 
+	(*WriteData)(sector, data); 
+} 
+
+void Fat32_Write(uint8_t *data, uint32_t length) { 
+	if (!Open) return; 
+	Fat32_Length += length; 
+	// top up a partial sector first 
+	if (Fill > 0) { 
+		uint32_t n = SECTOR_SIZE - Fill; 
+		if (n > length) n = length; 
+		memcpy(&Partial[Fill], data, n); 
+		Fill += n; 
+		data += n; 
+		length -= n; 
+		if (Fill < SECTOR_SIZE) return; 
+		Fat32_Data(Partial); 
+		Fill = 0; 
+	} 
+	// whole sectors go out straight from the caller's buffer 
+	while (length >= SECTOR_SIZE) { 
+		Fat32_Data(data); 
+		data += SECTOR_SIZE; 
+		length -= SECTOR_SIZE; 
+	} 
+	if (length > 0) { 
+		memcpy(Partial, data, length); 
+		Fill = length; 
+	} 
+} 
+
+uint32_t Fat32_Close() { 
+	if (!Open) return FAT32_NOT_OPEN; 
+	Open = 0; 
+	if (Fill > 0) { 
+		memset(&Partial[Fill], 0, SECTOR_SIZE - Fill); 
+		Fat32_Data(Partial); 
+		Fill = 0; 
+	} 
+	if (Failed) return FAT32_FULL; 
+	SectorCache_Sync(); // the data is on the card before anything points at it 
+
+	// chain the clusters that got data, run by run 
+	uint32_t cluster_bytes = ClusterSectors*SECTOR_SIZE; 
+	uint32_t used = (Fat32_Length + cluster_bytes - 1)/cluster_bytes; 
+	uint32_t first = (used > 0) ? RunStart[0] : 0; 
+	uint32_t previous = 0; 
+	for (uint32_t i = 0; i < Runs && used > 0; ++i) { 
+		for (uint32_t j = 0; j < RunLength[i] && used > 0; ++j, --used) { 
+			uint32_t cluster = RunStart[i] + j; 
+			if (previous && !Fat32_Set(previous, cluster)) return FAT32_IO; 
+			previous = cluster; 
+			++Taken; 
+		} 
+	} 
+	if (previous && !Fat32_Set(previous, FAT_EOC)) return FAT32_IO; 
+	// clusters set aside but not used go back (they were never marked) 
+	if (Runs > 0) { 
+		uint32_t after = (previous != 0) ? previous + 1 : RunStart[0]; 
+		NextFree = (after < Clusters) ? after : 2; 
+	} 
+	Runs = 0; 
+
+	// directory entry 
+	if (DirSector == 0 && !Fat32_GrowDirectory()) return FAT32_FULL; 
+	if (!Fat32_Load(DirSector)) return FAT32_IO; 
+	uint8_t *entry = &Sector[DirOffset]; 
+	memset(entry, 0, DIR_ENTRY); 
+	memcpy(entry, Name, 11); 
+	entry[11] = 0x20; // archive 
+	Fat32_Put16(&entry[16], FAT_DATE); // created 
+	Fat32_Put16(&entry[18], FAT_DATE); // accessed 
+	Fat32_Put16(&entry[20], first >> 16); 
+	Fat32_Put16(&entry[24], FAT_DATE); // written 
+	Fat32_Put16(&entry[26], first & 0xFFFF); 
+	Fat32_Put32(&entry[28], Fat32_Length); 
+	Fat32_Store(); 
+
+	// FSInfo is only a hint, but keep it right 
+	if (FsInfo && Fat32_Load(FsInfo)) { 
+		if (Fat32_FreeClusters != NONE) { 
+			Fat32_FreeClusters = (Fat32_FreeClusters > Taken) ? Fat32_FreeClusters - Taken : 0; 
+			Fat32_Put32(&Sector[488], Fat32_FreeClusters); 
+		} 
+		Fat32_Put32(&Sector[492], NextFree); 
+		Fat32_Store(); 
+	} 
+	SectorCache_Sync(); 
+	return FAT32_OK; 
+} 
@@ -0,0 +1,57 @@
+#include <stdint.h>
+
+// FAT32 on the SPI SD card, cut down to what the camera does: one file at a time, written start to 
+// finish into the root directory under an 8.3 name (IMG_0001.RAW). the card has to be FAT32 already 
+// (formatted on a pc, mkfs.vfat -F 32), whole card or first partition, 512 byte sectors. 
+// tuned for pictures: 
+//   - Fat32_Create takes the expected size and sets aside a run of free clusters for all of it, so the 
+//     picture's sectors are one after another and reach the card as one pre-erased multi-block write. 
+//     a picture that comes out bigger grows the run if the next clusters are free, else gets another 
+//   - nothing but picture data is written until Fat32_Close, which then writes the cluster chain 
+//     (both FATs), the directory entry and FSInfo in that order, after the data is on the card. 
+//     losing power before then leaves the file system as it was, the data just sits in free clusters 
+// FAT and directory sectors go through SectorCache, so SectorCache_Init has to be pointed at the 
+// same card first. picture data goes straight to the write passed to Fat32_Mount 
+
+// how a call went 
+#define FAT32_OK          0 
+#define FAT32_NO_VOLUME   1 // no FAT32 file system found, or the card couldn't be read 
+#define FAT32_EXISTS      2 // there is already a file by that name 
+#define FAT32_FULL        3 // not enough free clusters (or directory entries) 
+#define FAT32_NOT_OPEN    4 // no file being written 
+#define FAT32_IO          5 // a sector couldn't be read 
+
+// most pieces a file can end up in (a picture that runs past what was set aside, on a fragmented card) 
+#define FAT32_RUNS 8 
+
+// bytes handed to Fat32_Write since the file was created 
+extern uint32_t Fat32_Length; 
+
+// sectors set aside by the last Fat32_Create, one after the other from the file's first sector, 
+// the count to pre-erase (SDCard_Reserve) before the first write 
+extern uint32_t Fat32_Reserved; 
+
+// free clusters, as far as FSInfo knows (0xFFFFFFFF if it doesn't) 
+extern uint32_t Fat32_FreeClusters; 
+
+// find the file system (boot sector at sector 0, or the first partition of a partition table) 
+// write: where picture data goes (SDCard_WriteSectorAt), one whole sector 
+// returns FAT32_OK or FAT32_NO_VOLUME 
+uint32_t Fat32_Mount(void (*write)(uint32_t sector, uint8_t *data)); 
+
+// start a file in the root directory 
+// name: 8.3, "IMG_0001.RAW". size: bytes expected, 0 if not known (clusters are then set aside as it grows) 
+// a file still open from before (a failed picture) is dropped, as if it had never been started 
+// returns FAT32_OK, FAT32_EXISTS, FAT32_FULL, FAT32_NO_VOLUME or FAT32_IO 
+uint32_t Fat32_Create(const char *name, uint32_t size); 
+
+// add bytes to the file. same shape as the Camera_StartCapture store callback, 
+// and data can be reused as soon as it returns 
+void Fat32_Write(uint8_t *data, uint32_t length); 
+
+// finish the file: last partial sector, then the FAT, directory entry and FSInfo, all synced 
+// returns FAT32_OK, or what went wrong (the file is then left out of the directory) 
+uint32_t Fat32_Close(void); 
+
+// 1 if the root directory has a file by that name, 0 if not 
+uint32_t Fat32_Exists(const char *name); 
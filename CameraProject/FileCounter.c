@@ -0,0 +1,38 @@
+#include "FileCounter.h"
+#include "Eeprom.h"
+#include "inc/tm4c123gh6pm.h"
+
+#define COUNTER_BLOCK 0     // EEPROM block the counter lives in 
+#define COUNTER_WORDS 16    // words per block 
+#define ERASED 0xFFFFFFFF   // what a word that has never been written reads as 
+
+static uint32_t Counter = 0; 
+static uint32_t Usable = 0; 
+
+uint32_t FileCounter_Init() { 
+	Usable = Eeprom_Init(); 
+	if (!Usable) return 0; 
+	// the counter is the biggest word in the block 
+	Counter = 0; 
+	EEPROM_EEBLOCK_R = COUNTER_BLOCK; 
+	EEPROM_EEOFFSET_R = 0; 
+	for (int i = 0; i < COUNTER_WORDS; ++i) { 
+		uint32_t word = EEPROM_EERDWRINC_R; // offset moves up by itself 
+		if (word != ERASED && word > Counter) Counter = word; 
+	}
+	return 1; 
+}
+
+uint32_t FileCounter_Peek() { 
+	return Counter; 
+}
+
+void FileCounter_Set(uint32_t value) { 
+	if (value <= Counter || value == ERASED) return; 
+	Counter = value; 
+	if (!Usable) return; 
+	EEPROM_EEBLOCK_R = COUNTER_BLOCK; 
+	EEPROM_EEOFFSET_R = value % COUNTER_WORDS; 
+	EEPROM_EERDWR_R = value; 
+	Eeprom_Wait(); 
+}
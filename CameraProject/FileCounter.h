@@ -0,0 +1,21 @@
+#include <stdint.h>
+
+// monotonic picture counter kept in the on-chip EEPROM, so the next file name is known at boot 
+// without asking the card. the counter only ever goes up, and it moves on before a name is used, 
+// so a number is never handed out twice, even across a power loss halfway through a picture. 
+// writes rotate through the 16 words of one EEPROM block, so each word sees 1/16 of them. 
+// names come from the counter modulo FILE_NUMBERS, so they come round again after 10000 pictures 
+// (IMG_9999 is followed by IMG_0000). whoever names a file checks the card for a free one from there 
+
+#define FILE_NUMBERS 10000 // IMG_0000 to IMG_9999 
+
+// turn on the EEPROM and read the counter. once at startup 
+// returns 1 if the EEPROM is usable, 0 if it came up with an error (the counter then starts at 0 
+// every boot, and the names get found the slow way) 
+uint32_t FileCounter_Init(void); 
+
+// the next number to use (0 on a chip that has never taken a picture) 
+uint32_t FileCounter_Peek(void); 
+
+// make value the next number to use. ignored unless it is above the current one 
+void FileCounter_Set(uint32_t value); 
@@ -0,0 +1,161 @@
+#include <string.h>
+#include "ImageLog.h"
+#include "SectorBuffer.h"
+#include "TimeBase.h"
+
+uint32_t ImageLog_Next = 0; 
+uint32_t ImageLog_Reads = 0; 
+uint32_t ImageLog_Torn = 0; 
+
+static uint8_t Sector[SECTOR_SIZE]; // log sector or a header being looked at 
+static uint32_t FirstSector; 
+static uint32_t Id; 
+static uint32_t Slots; 
+static uint32_t DataSector;         // where the picture being written starts 
+static uint32_t Overflow;           // picture being written ran past its slot (or there is no log to write to) 
+static uint32_t Unreadable;         // the log sector couldn't be read 
+static void (*WriteSector)(uint32_t sector, uint8_t *data); 
+static uint32_t (*ReadSector)(uint32_t sector, uint8_t *data); 
+static void (*Flush)(void); 
+
+static void ImageLog_Put32(uint8_t *destination, uint32_t value) { 
+	destination[0] = value & 0xFF; 
+	destination[1] = (value >> 8) & 0xFF; 
+	destination[2] = (value >> 16) & 0xFF; 
+	destination[3] = (value >> 24) & 0xFF; 
+} 
+
+uint32_t ImageLog_Sector(uint32_t n) { 
+	if (Slots == 0) return FirstSector + 1; 
+	return FirstSector + 1 + (n % Slots)*IMAGELOG_SLOT_SECTORS; 
+} 
+
+// 1 if picture n went in, whether it is still there or a later one in its slot has taken over. 
+// the slot holds the newest m with m % Slots == n % Slots that was written, so this is 1 for 
+// every n below ImageLog_Next and 0 from there on, which is what the search needs 
+static uint32_t ImageLog_Written(uint32_t n) { 
+	++ImageLog_Reads; 
+	if (!(*ReadSector)(ImageLog_Sector(n), Sector)) return 0; 
+	if (!SectorBuffer_IsHeader(Sector)) return 0; 
+	if (SectorBuffer_Get32(&Sector[SECTOR_HEADER_LOG_OFFSET]) != Id) return 0; 
+	uint32_t m = SectorBuffer_Get32(&Sector[SECTOR_HEADER_SEQUENCE_OFFSET]); 
+	return (m >= n) && ((m - n) % Slots == 0); 
+} 
+
+// 1 unless picture n's header (known to be good) and data disagree. a sector that can't be read 
+// isn't proof of anything, so the picture stays 
+static uint32_t ImageLog_Whole(uint32_t n) { 
+	uint32_t sector = ImageLog_Sector(n); 
+	++ImageLog_Reads; 
+	if (!(*ReadSector)(sector, Sector)) return 1; 
+	uint32_t length = SectorBuffer_Get32(&Sector[SECTOR_HEADER_LENGTH_OFFSET]); 
+	uint32_t sectors = SectorBuffer_Get32(&Sector[SECTOR_HEADER_SECTORS_OFFSET]); 
+	uint32_t crc = SectorBuffer_Get32(&Sector[SECTOR_HEADER_CRC_OFFSET]); 
+	if (sectors >= IMAGELOG_SLOT_SECTORS || length > sectors*SECTOR_SIZE) return 0; 
+	uint32_t check = 0; 
+	for (uint32_t i = 0; i < sectors && length > 0; ++i) { 
+		uint32_t bytes = (length < SECTOR_SIZE) ? length : SECTOR_SIZE; 
+		++ImageLog_Reads; 
+		if (!(*ReadSector)(sector + 1 + i, Sector)) return 1; 
+		check = SectorBuffer_Crc32(check, Sector, bytes); 
+		length -= bytes; 
+	} 
+	return check == crc; 
+} 
+
+uint32_t ImageLog_Find(uint32_t first_sector, uint32_t (*read)(uint32_t sector, uint8_t *data)) { 
+	FirstSector = first_sector; 
+	ReadSector = read; 
+	ImageLog_Next = 0; 
+	ImageLog_Reads = 1; 
+	ImageLog_Torn = 0; 
+	Slots = 0; 
+	Unreadable = !(*read)(first_sector, Sector); 
+	if (Unreadable) return 0; 
+	if (SectorBuffer_Get32(&Sector[IMAGELOG_MAGIC_OFFSET]) != IMAGELOG_MAGIC) return 0; 
+	if (SectorBuffer_Get32(&Sector[IMAGELOG_CHECK_OFFSET]) != SectorBuffer_Crc32(0, Sector, IMAGELOG_CHECK_OFFSET)) return 0; 
+	if (SectorBuffer_Get32(&Sector[IMAGELOG_SECTORS_OFFSET]) != IMAGELOG_SLOT_SECTORS) return 0; 
+	Id = SectorBuffer_Get32(&Sector[IMAGELOG_ID_OFFSET]); 
+	Slots = SectorBuffer_Get32(&Sector[IMAGELOG_SLOTS_OFFSET]); 
+	if (Slots == 0) return 0; 
+	 
+	// written for everything below the end, so double until past it, then halve the gap 
+	if (!ImageLog_Written(0)) return 1; 
+	uint32_t low = 0;      // written 
+	uint32_t high = 1;     // not written, once the doubling stops 
+	while (ImageLog_Written(high)) { 
+		low = high; 
+		if (high >= 0x80000000) { high = 0xFFFFFFFF; break; } 
+		high <<= 1; 
+	} 
+	while (high - low > 1) { 
+		uint32_t middle = low + (high - low)/2; 
+		if (ImageLog_Written(middle)) low = middle; 
+		else high = middle; 
+	} 
+	ImageLog_Next = low + 1; 
+	// the flush in front of every header also put the header before it on the card, so only the 
+	// newest picture can be torn 
+	if (!ImageLog_Whole(low)) { 
+		ImageLog_Next = low; 
+		ImageLog_Torn = 1; 
+	} 
+	return 1; 
+} 
+
+uint32_t ImageLog_Open(uint32_t first_sector, uint32_t slots, void (*write)(uint32_t sector, uint8_t *data), 
+	uint32_t (*read)(uint32_t sector, uint8_t *data), void (*flush)(void)) { 
+	WriteSector = write; 
+	Flush = flush; 
+	if (ImageLog_Find(first_sector, read) && Slots == slots) return IMAGELOG_FOUND; 
+	if (Unreadable) { 
+		Slots = 0; // a read that didn't work is no reason to throw the log away, just take no pictures 
+		return IMAGELOG_UNREADABLE; 
+	} 
+
+	// new log. an id no older log here had: one past the id that was there, mixed with the time 
+	// so a card that never had a log doesn't start every log on the same one 
+	uint32_t old = SectorBuffer_Get32(&Sector[IMAGELOG_ID_OFFSET]); 
+	Id = (old + 1) ^ (TimeBase_Us() << 8); 
+	if (Id == 0) Id = 1; // 0 is "not in a log" 
+	Slots = slots; 
+	ImageLog_Next = 0; 
+	memset(Sector, 0, SECTOR_SIZE); 
+	ImageLog_Put32(&Sector[IMAGELOG_MAGIC_OFFSET], IMAGELOG_MAGIC); 
+	ImageLog_Put32(&Sector[IMAGELOG_ID_OFFSET], Id); 
+	ImageLog_Put32(&Sector[IMAGELOG_SECTORS_OFFSET], IMAGELOG_SLOT_SECTORS); 
+	ImageLog_Put32(&Sector[IMAGELOG_SLOTS_OFFSET], Slots); 
+	ImageLog_Put32(&Sector[IMAGELOG_CHECK_OFFSET], SectorBuffer_Crc32(0, Sector, IMAGELOG_CHECK_OFFSET)); 
+	(*WriteSector)(first_sector, Sector); 
+	return IMAGELOG_NEW; 
+} 
+
+// SectorBuffer's backend while a picture goes in: anything past the end of the slot is dropped, 
+// or it would land on the next slot's header 
+static void ImageLog_WriteSector(uint32_t sector, uint8_t *data) { 
+	if (Overflow || sector - (DataSector - 1) >= IMAGELOG_SLOT_SECTORS) { 
+		Overflow = 1; 
+		return; 
+	} 
+	if (sector == DataSector - 1 && Flush) (*Flush)(); // the header commits the picture, so its data goes first 
+	(*WriteSector)(sector, data); 
+} 
+
+uint32_t ImageLog_Begin(uint32_t format, uint32_t width, uint32_t height) { 
+	uint32_t sector = ImageLog_Sector(ImageLog_Next); 
+	DataSector = sector + 1; 
+	Overflow = (Slots == 0); 
+	SectorBuffer_Open(sector, ImageLog_WriteSector); 
+	SectorBuffer_Describe(Id, format, width, height); 
+	return DataSector; 
+} 
+
+uint32_t ImageLog_Close(uint32_t timestamp) { 
+	// a picture that didn't fit has lost sectors, so it gets no header and its slot is used again 
+	SectorBuffer_Tag(ImageLog_Next, timestamp); 
+	if (SectorBuffer_Length > (IMAGELOG_SLOT_SECTORS - 1)*SECTOR_SIZE) Overflow = 1; 
+	if (Overflow) return 0; 
+	SectorBuffer_Close(); 
+	++ImageLog_Next; 
+	return 1; 
+} 
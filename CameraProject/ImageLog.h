@@ -0,0 +1,71 @@
+#include <stdint.h>
+
+// append-only log of pictures in a raw area of a card, so a shot never overwrites the one before it 
+// and a pc can get every picture back off a dump of the card (tools/imagelog_extract.c). 
+// layout, starting at first_sector: 
+//   first_sector                                   log sector: magic, log id, slot size, number of slots, CRC32 
+//   first_sector + 1 + slot*IMAGELOG_SLOT_SECTORS  SectorBuffer header (magic, sequence number, format, 
+//                                                  resolution, length, timestamp, CRC32s), then the picture 
+// the picture with sequence number n goes in slot n % slots, so pictures are written one after the other 
+// (the fastest pattern for an sd card) and once the log is full the oldest one goes first. 
+// the header is written after the picture, so a picture cut short (power, camera error) just isn't in the log. 
+// every header carries the log id, so headers left on the card by an older log don't count 
+// commit order, so losing power at any point leaves the log as it was or with the new picture whole: 
+//   1. the picture's data sectors, however the backend likes (queued, cached, one multi-block write) 
+//   2. the backend's flush, once per picture, so all of the data is on the card 
+//   3. the header with its CRC32s, the one sector that puts the picture in the log 
+// at power up only the newest picture is checked against its data CRC32 (ImageLog_Find). a picture whose 
+// header got there and data didn't (a card that wrote out of order) is dropped and its slot used again 
+
+#define IMAGELOG_MAGIC 0x31474F4C // "LOG1" when read as bytes 
+#define IMAGELOG_SLOT_SECTORS 256 // header + up to 255 sectors (127.5 KB): a 160x120 RAW picture, or a 640x480 JPEG 
+
+// log sector fields, byte offsets (all little endian) 
+#define IMAGELOG_MAGIC_OFFSET   0 
+#define IMAGELOG_ID_OFFSET      4 
+#define IMAGELOG_SECTORS_OFFSET 8  // IMAGELOG_SLOT_SECTORS when it was made 
+#define IMAGELOG_SLOTS_OFFSET   12 
+#define IMAGELOG_CHECK_OFFSET   16 // CRC32 of bytes 0 to 15 
+
+// sequence number the next picture gets, which is also how many pictures have ever gone into the log 
+extern uint32_t ImageLog_Next; 
+
+// sectors read to find the end of the log by the last ImageLog_Find, the newest picture's check included 
+extern uint32_t ImageLog_Reads; 
+
+// 1 if the last ImageLog_Find dropped the newest picture because its data didn't match its header 
+extern uint32_t ImageLog_Torn; 
+
+// look for a log at first_sector and find its end (ImageLog_Next) with an exponential then binary 
+// search over sequence numbers, about 2*log2(pictures) header reads instead of a scan, then read the 
+// newest picture back and check it against its CRC32. one that doesn't match is left out (ImageLog_Torn). 
+// nothing is written 
+// read: storage backend, reads one whole sector (LCD_ReadSectorAt, etc.), returns 1 if it got it 
+// returns 1 if there is a log, 0 if not 
+uint32_t ImageLog_Find(uint32_t first_sector, uint32_t (*read)(uint32_t sector, uint8_t *data)); 
+
+// pick up the log at first_sector, or start a new one of slots pictures there if there isn't one 
+// (or it has a different shape). a new log gets a new id, so nothing of an old one shows through 
+// write/read: storage backend (LCD_WriteSectorAt/LCD_ReadSectorAt, SDCard_WriteSectorAt/SDCard_ReadSectorAt) 
+// flush: gets everything written so far onto the card (LCD_FlushMedia, SectorCache_Sync), called between 
+// a picture's data and its header. 0 for a backend that writes in order and straight away 
+// returns IMAGELOG_FOUND, IMAGELOG_NEW, or IMAGELOG_UNREADABLE if the log sector couldn't be read 
+// (nothing is written then, and no picture goes in until an ImageLog_Open that works) 
+#define IMAGELOG_NEW        0 
+#define IMAGELOG_FOUND      1 
+#define IMAGELOG_UNREADABLE 2 
+uint32_t ImageLog_Open(uint32_t first_sector, uint32_t slots, void (*write)(uint32_t sector, uint8_t *data), 
+	uint32_t (*read)(uint32_t sector, uint8_t *data), void (*flush)(void)); 
+
+// start the next picture: opens SectorBuffer on its slot, so the camera's store callback is 
+// SectorBuffer_Write. format: CAMERA_RAW or CAMERA_JPEG, width/height in pixels 
+// returns the sector the picture's data starts at (for LCD_QueueImage etc.) 
+uint32_t ImageLog_Begin(uint32_t format, uint32_t width, uint32_t height); 
+
+// flush the picture's data, then write the header, which puts the picture in the log 
+// timestamp: ms the picture was taken (TimeBase_Ms, Camera_FrameMs) 
+// returns 1 if it went in, 0 if it didn't fit its slot or there is no log open (it is left out) 
+uint32_t ImageLog_Close(uint32_t timestamp); 
+
+// slot of sequence number n, first sector (its header) 
+uint32_t ImageLog_Sector(uint32_t n); 
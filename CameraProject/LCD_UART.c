@@ -1,11 +1,82 @@
 #include <stdio.h>
 #include "LCD_UART.h"
+#include "UART.h" // UART_BusClock 
+#include "TimeBase.h"
+#include <string.h>
+#include "FileCounter.h"
 
 #define UART_FR_TXFF            0x00000020  // UART Transmit FIFO Full
 #define UART_FR_RXFE            0x00000010  // UART Receive FIFO Empty
 #define UART_LCRH_WLEN_8        0x00000060  // 8 bit word length
 #define UART_LCRH_FEN           0x00000010  // UART Enable FIFOs
 #define UART_CTL_UARTEN         0x00000001  // UART Enable
+#define UART_FR_BUSY            0x00000008  // UART Busy
+#define UART_IM_RXIM            0x00000010  // UART Receive Interrupt Mask
+#define UART_IM_TXIM            0x00000020  // UART Transmit Interrupt Mask
+#define UART_IM_RTIM            0x00000040  // UART Receive Time-Out Interrupt Mask
+
+#define UART3_PRIORITY 3 // below the camera (2), the display can always wait a little 
+
+// transmit queue: commands get copied in here and UART3_Handler feeds them to the fifo, 
+// so a sector write costs a copy instead of 514 byte times. size is a power of 2 
+#define TX_QUEUE_SIZE 2048 
+static uint8_t TxQueue[TX_QUEUE_SIZE]; 
+static volatile uint32_t TxPut = 0; 
+static volatile uint32_t TxGet = 0; 
+
+// everything the display sends back, collected by UART3_Handler 
+#define RX_QUEUE_SIZE 64 
+static volatile uint8_t RxQueue[RX_QUEUE_SIZE]; 
+static volatile uint32_t RxPut = 0; 
+static volatile uint32_t RxGet = 0; 
+
+// commands in flight, oldest first. the display answers in order, so the next reply byte always 
+// belongs to the oldest one, and its length says where the next reply starts 
+typedef struct { 
+	uint16_t length;  // reply bytes owed 
+	uint16_t got;     // reply bytes in so far 
+	uint8_t check;    // REPLY_ACK or REPLY_STATUS 
+	uint8_t status;   // LCD_OK etc. once it is done 
+	uint8_t started;  // 1 once its last byte has gone out and its clock is running 
+	uint8_t reply[3]; // ACK and the status word (or whatever the first 3 bytes are) 
+	uint8_t *data;    // where reply bytes past the first 3 go (sector reads), 0 to drop them 
+	uint32_t sent;    // TxPut after its last byte 
+	uint32_t timeout; // ms without a reply byte before giving up on it 
+	uint32_t last;    // ms of the last byte in (or of the last byte out) 
+} LCD_Command; 
+#define REPLY_ACK    0 // first byte has to be an ACK 
+#define REPLY_STATUS 1 // ACK, then a status word that is 0 on failure 
+#define IN_FLIGHT 32 
+static LCD_Command Pending[IN_FLIGHT]; 
+static uint32_t PendingPut = 0; 
+static uint32_t PendingGet = 0; 
+
+uint32_t LCD_ReplyErrors = 0; 
+uint32_t LCD_Timeouts = 0; 
+
+#define LCD_ACK 0x06 
+#define REPLY_TIMEOUT_MS 100 // display commands answer within a few ms 
+#define WRITE_TIMEOUT_MS 500 // sd card writes (and long strings) can take a couple of hundred 
+
+// rates for the display's set baud command, slowest first. the display's clock doesn't divide down 
+// to the nominal rate exactly above 115200, so the uart gets programmed for what it really sends 
+// (actual rates from the picaso datasheet's baud rate table) 
+typedef struct { 
+	uint16_t index;  // set baud parameter 
+	uint32_t actual; // what we program UART3 for 
+} LCD_Rate; 
+static const LCD_Rate Rates[] = { 
+	{6, 9600}, {13, 115200}, {15, 281250}, {17, 401785}, {18, 562500}, {19, 703125} 
+}; 
+#define NUM_RATES (sizeof(Rates)/sizeof(Rates[0])) 
+#define BAUD_ACK_TIMEOUT_MS   500 // set baud ACKs at the new rate about 100 ms after the command 
+#define BAUD_REPLY_TIMEOUT_MS 50 
+#define BAUD_CHECKS 3             // round trips a new rate has to survive 
+
+uint32_t LCD_Baud = 9600; 
+
+// sector the display's sector address points at right now (it moves up by one after every read or write) 
+static uint32_t CurrentSector = 0xFFFFFFFF; 
 
 void LCD_UART_Init() { 
 	// 1. uart configurations 
@@ -14,6 +85,7 @@ void LCD_UART_Init() {
 	UART3_CTL_R &= ~UART_CTL_UARTEN; //disable UART 
 	UART3_IBRD_R = 520; 
 	UART3_FBRD_R = 53; // baud rate calculation stuff -> we want a baud rate of 9600! 
+	LCD_Baud = 9600; 
 	UART3_LCRH_R = (UART_LCRH_WLEN_8|UART_LCRH_FEN); // specifications of uart 
 	UART3_CTL_R |= UART_CTL_UARTEN; // re-enable uart 
 	// 2. gpio stuff with port c (using pc6 and pc7) 
@@ -21,149 +93,462 @@ void LCD_UART_Init() {
 	GPIO_PORTC_DEN_R |= 0xC0; // enable digital i/o on pc6-7
 	GPIO_PORTC_PCTL_R = (GPIO_PORTC_PCTL_R&0x00FFFFFF)+0x11000000; 
 	GPIO_PORTC_AMSEL_R &= ~0x03; // disable analog functionality 
+	// 3. interrupts: receive at 1/8 full plus time-out, transmit refill at 1/2 empty 
+	TxPut = TxGet = RxPut = RxGet = 0; 
+	PendingPut = PendingGet = 0; 
+	UART3_IFLS_R = (UART3_IFLS_R&~0x3F)|0x02; 
+	UART3_ICR_R = UART_IM_RXIM|UART_IM_RTIM|UART_IM_TXIM; 
+	UART3_IM_R = UART_IM_RXIM|UART_IM_RTIM; // transmit interrupt only while there is something queued 
+	// UART3 is interrupt number 59: priority lives in bits 31:29 of PRI14, enable is bit 27 of EN1 
+	NVIC_PRI14_R = (NVIC_PRI14_R&0x00FFFFFF)|(UART3_PRIORITY<<29); 
+	NVIC_EN1_R = 1<<27; 
+}
+
+// move queued bytes into the transmit fifo while there is room 
+// returns 1 if bytes are still queued 
+static uint32_t LCD_TxFill(void) { 
+	while (TxGet != TxPut && (UART3_FR_R & UART_FR_TXFF) == 0) { 
+		UART3_DR_R = TxQueue[(TxGet++)%TX_QUEUE_SIZE]; 
+	}
+	return (TxGet != TxPut); 
+}
+
+void UART3_Handler() { 
+	if (UART3_MIS_R & UART_IM_TXIM) { 
+		UART3_ICR_R = UART_IM_TXIM; 
+		if (!LCD_TxFill()) UART3_IM_R &= ~UART_IM_TXIM; // queue ran dry 
+	}
+	if (UART3_MIS_R & (UART_IM_RXIM|UART_IM_RTIM)) { 
+		UART3_ICR_R = UART_IM_RXIM|UART_IM_RTIM; 
+		while ((UART3_FR_R & UART_FR_RXFE) == 0) { 
+			if (RxPut - RxGet < RX_QUEUE_SIZE) RxQueue[(RxPut++)%RX_QUEUE_SIZE] = (UART3_DR_R&0xFF); 
+			else (void)UART3_DR_R; // nobody is reading, drop it 
+		}
+	}
+}
+
+// match replies that have come in to the commands in flight, and time out the oldest one 
+// if it has gone quiet for too long 
+static void LCD_Service(void) { 
+#ifdef HOST_SIM
+	Sim_Idle(); // every wait loop comes through here, and none of them touch a register 
+#endif
+	while (PendingGet != PendingPut) { 
+		LCD_Command *command = &Pending[PendingGet%IN_FLIGHT]; 
+		if (RxGet == RxPut) { 
+			// nothing in. its clock only runs once it has all gone out 
+			if ((int32_t)(TxGet - command->sent) < 0) return; 
+			uint32_t now = TimeBase_Ms(); 
+			if (!command->started) { 
+				command->started = 1; 
+				command->last = now; 
+				return; 
+			}
+			if ((now - command->last) <= command->timeout) return; 
+			command->status = LCD_TIMEOUT; 
+			++LCD_Timeouts; 
+			RxGet = RxPut; // half a reply is no use to the next one 
+			++PendingGet; 
+			continue; 
+		}
+		uint8_t data = RxQueue[(RxGet++)%RX_QUEUE_SIZE]; 
+		if (command->got < 3) command->reply[command->got] = data; 
+		else if (command->data) command->data[command->got - 3] = data; 
+		command->started = 1; 
+		command->last = TimeBase_Ms(); 
+		if (++command->got < command->length) continue; 
+		if (command->reply[0] != LCD_ACK) command->status = LCD_NAK; 
+		else if (command->check == REPLY_STATUS && command->reply[1] == 0 && command->reply[2] == 0) command->status = LCD_FAILED; 
+		if (command->status != LCD_OK) ++LCD_ReplyErrors; 
+		++PendingGet; 
+	}
+}
+
+// queue one byte for the display, waiting for room if the queue is full 
+static void LCD_Out(uint8_t data) { 
+	while (TxPut - TxGet >= TX_QUEUE_SIZE) LCD_Service(); 
+	TxQueue[TxPut%TX_QUEUE_SIZE] = data; 
+	++TxPut; 
+	if ((UART3_IM_R & UART_IM_TXIM) == 0) { 
+		long sr = StartCritical(); 
+		if (LCD_TxFill()) UART3_IM_R |= UART_IM_TXIM; // handler takes it from here 
+		EndCritical(sr); 
+	}
+}
+
+// queue a block of bytes (sector data) 
+static void LCD_OutBlock(const uint8_t *data, uint32_t length) { 
+	while (length > 0) { 
+		uint32_t room; 
+		while ((room = TX_QUEUE_SIZE - (TxPut - TxGet)) == 0) LCD_Service(); 
+		uint32_t n = (length < room) ? length : room; 
+		uint32_t put = TxPut%TX_QUEUE_SIZE; 
+		if (n > TX_QUEUE_SIZE - put) n = TX_QUEUE_SIZE - put; // up to the wrap 
+		memcpy(&TxQueue[put], data, n); 
+		TxPut += n; 
+		data += n; 
+		length -= n; 
+		long sr = StartCritical(); 
+		if (LCD_TxFill()) UART3_IM_R |= UART_IM_TXIM; 
+		EndCritical(sr); 
+	}
+}
+
+// the command just queued is owed a reply: length bytes, checked by LCD_Service as they come in 
+// data: where bytes past the first 3 go (0 to drop them), timeout: ms it may go quiet for 
+// returns a ticket for LCD_Wait. nothing has to wait, so commands can go out back to back 
+static uint32_t LCD_Expect(uint16_t length, uint8_t check, uint8_t *data, uint32_t timeout) { 
+	while (PendingPut - PendingGet >= IN_FLIGHT) LCD_Service(); 
+	LCD_Command *command = &Pending[PendingPut%IN_FLIGHT]; 
+	command->length = length; 
+	command->got = 0; 
+	command->check = check; 
+	command->status = LCD_OK; 
+	command->started = 0; 
+	command->data = data; 
+	command->sent = TxPut; 
+	command->timeout = timeout; 
+	return PendingPut++; 
+}
+
+// wait for a command's reply 
+// returns LCD_OK, LCD_TIMEOUT, LCD_NAK or LCD_FAILED 
+// (only good until IN_FLIGHT more commands have gone out, so wait right away) 
+static uint32_t LCD_Wait(uint32_t ticket) { 
+	while ((int32_t)(PendingGet - ticket) <= 0) LCD_Service(); 
+	return Pending[ticket%IN_FLIGHT].status; 
+}
+
+// the first 3 bytes of a command's reply, once LCD_Wait has returned 
+static uint8_t * LCD_Reply(uint32_t ticket) { 
+	return Pending[ticket%IN_FLIGHT].reply; 
+}
+
+// wait until the transmit queue and fifo are empty (replies may still be on the way) 
+static void LCD_TxDrain(void) { 
+	while (TxGet != TxPut) LCD_Service(); 
+	while ((UART3_FR_R & UART_FR_BUSY) != 0); 
+}
+
+void LCD_WaitIdle() { 
+	while (PendingGet != PendingPut) LCD_Service(); 
+	LCD_TxDrain(); 
+}
+
+// reprogram UART3 for a new rate, once the last byte has gone out at the old one 
+static void LCD_UART_SetBaudRate(uint32_t baud) { 
+	uint32_t divisor64 = (UART_BusClock()*4 + baud/2)/baud; // 64*bus/(16*baud), IBRD and FBRD in one 
+	LCD_TxDrain(); 
+	UART3_CTL_R &= ~UART_CTL_UARTEN; 
+	UART3_IBRD_R = divisor64 >> 6; 
+	UART3_FBRD_R = divisor64 & 0x3F; 
+	UART3_LCRH_R = (UART_LCRH_WLEN_8|UART_LCRH_FEN); // divisors only latch on an LCRH write 
+	UART3_CTL_R |= UART_CTL_UARTEN; 
+	LCD_Baud = baud; 
+}
+
+// drop anything left over from a rate change 
+static void LCD_RxFlush(void) { 
+	LCD_WaitIdle(); 
+	RxGet = RxPut; 
+}
+
+// one round trip: get version (00 1B) comes back as ACK and a 2 byte version 
+static uint32_t LCD_CheckLink(void) { 
+	LCD_RxFlush(); 
+	LCD_Out(0x00); 
+	LCD_Out(0x1B); 
+	return (LCD_Wait(LCD_Expect(3, REPLY_ACK, 0, BAUD_REPLY_TIMEOUT_MS)) == LCD_OK); 
+}
+
+// set baud (00 26, then the rate index) at the current rate. the display answers at the new one 
+static uint32_t LCD_OutBaudRate(const LCD_Rate *rate) { 
+	LCD_RxFlush(); 
+	LCD_Out(0x00); 
+	LCD_Out(0x26); 
+	LCD_Out((rate->index & 0xFF00) >> 8); 
+	LCD_Out((rate->index & 0x00FF)); 
+	LCD_UART_SetBaudRate(rate->actual); 
+	RxGet = RxPut; // whatever came in while the rates didn't match 
+	return (LCD_Wait(LCD_Expect(1, REPLY_ACK, 0, BAUD_ACK_TIMEOUT_MS)) == LCD_OK); 
+}
+
+uint32_t LCD_NegotiateBaud() { 
+	uint32_t good; 
+	// find the display: 9600 after power up, but a reset of just the tm4c leaves it where it was 
+	for (good = 0; good < NUM_RATES; ++good) { 
+		LCD_UART_SetBaudRate(Rates[good].actual); 
+		if (LCD_CheckLink()) break; 
+	}
+	if (good == NUM_RATES) { 
+		LCD_UART_SetBaudRate(Rates[0].actual); 
+		return 0; 
+	}
+	for (uint32_t next = good + 1; next < NUM_RATES; ++next) { 
+		uint32_t passed = LCD_OutBaudRate(&Rates[next]); 
+		for (int i = 0; i < BAUD_CHECKS && passed; ++i) passed = LCD_CheckLink(); 
+		if (passed) { 
+			good = next; 
+			continue; 
+		}
+		// too fast for the wiring: ask for the last good rate at the bad one and hope it gets through 
+		if (LCD_OutBaudRate(&Rates[good]) && LCD_CheckLink()) break; 
+		// otherwise it is most likely still at the new rate: send it back to where it starts out from there 
+		LCD_UART_SetBaudRate(Rates[next].actual); 
+		LCD_OutBaudRate(&Rates[0]); 
+		if (LCD_CheckLink()) break; 
+		LCD_UART_SetBaudRate(Rates[0].actual); 
+		return 0; 
+	}
+	return LCD_Baud; 
 }
 
 void LCD_Clear() { 
-	while ((UART3_FR_R & UART_FR_TXFF) != 0); // busy wait 
-	UART3_DR_R = 0xFF;
-	while ((UART3_FR_R & UART_FR_TXFF) != 0); // busy wait 
-	UART3_DR_R = 0xCD; 	
+	LCD_Out(0xFF);
+	LCD_Out(0xCD); 	
 	
-	LCD_InData(); 
+	LCD_Wait(LCD_Expect(1, REPLY_ACK, 0, REPLY_TIMEOUT_MS)); 
 }
 
 void LCD_DrawRectangle() { 
-	while ((UART3_FR_R & UART_FR_TXFF) != 0); // busy wait 
-	UART3_DR_R = 0x0; 
+	LCD_Out(0x0); 
 }
 
 char LCD_InData() { 
-	while ((UART3_FR_R & UART_FR_RXFE) != 0); 
-	return (UART3_DR_R&0xFF);
+	// replies owed to earlier commands come first 
+	while (PendingGet != PendingPut) LCD_Service(); 
+	uint32_t start = TimeBase_Ms(); 
+	while (RxGet == RxPut) { 
+		if ((TimeBase_Ms() - start) > REPLY_TIMEOUT_MS) { 
+			++LCD_Timeouts; 
+			return 0; 
+		}
+	}
+	return RxQueue[(RxGet++)%RX_QUEUE_SIZE]; 
+}
+
+/********* BLIT **********/ 
+
+static uint32_t BlitRemaining = 0; // pixel bytes the open blit still wants 
+static uint32_t Blitting = 0;      // 1 between LCD_BlitOpen and LCD_BlitClose 
+
+void LCD_BlitOpen(uint16_t x_pos, uint16_t y_pos, uint16_t width, uint16_t height) { 
+	// blit com to display (00 23, x, y, width, height, then the pixels). the window goes out once, 
+	// the pixels follow as they come in 
+	LCD_Out(0x00); 
+	LCD_Out(0x23); 
+	LCD_Out((x_pos & 0xFF00) >> 8); 
+	LCD_Out((x_pos & 0x00FF)); 
+	LCD_Out((y_pos & 0xFF00) >> 8); 
+	LCD_Out((y_pos & 0x00FF)); 
+	LCD_Out((width & 0xFF00) >> 8); 
+	LCD_Out((width & 0x00FF)); 
+	LCD_Out((height & 0xFF00) >> 8); 
+	LCD_Out((height & 0x00FF)); 
+	BlitRemaining = (uint32_t)width*height*2; 
+	Blitting = 1; 
+}
+
+void LCD_BlitWrite(uint8_t *data, uint32_t length) { 
+	if (length > BlitRemaining) length = BlitRemaining; // anything past the window would be read as a command 
+	LCD_OutBlock(data, length); 
+	BlitRemaining -= length; 
+}
+
+uint32_t LCD_BlitClose() { 
+	if (!Blitting) return 0; 
+	Blitting = 0; 
+	uint32_t short_frame = (BlitRemaining != 0); 
+	// the display is still counting pixels, so a short frame gets finished off in black 
+	while (BlitRemaining > 0) { 
+		LCD_Out(0x00); 
+		--BlitRemaining; 
+	}
+	LCD_Expect(1, REPLY_ACK, 0, WRITE_TIMEOUT_MS); 
+	return !short_frame; 
 }
 
 void LCD_WriteString(char * string) { 
-	while ((UART3_FR_R & UART_FR_TXFF) != 0); // busy wait 
-	UART3_DR_R = 0x00;
-	while ((UART3_FR_R & UART_FR_TXFF) != 0); // busy wait 
-	UART3_DR_R = 0x18;
+	LCD_Out(0x00);
+	LCD_Out(0x18);
 	for (int i = 0; string[i] != '\0' && i < 511; i++) { 
-		while ((UART3_FR_R & UART_FR_TXFF) != 0); // busy wait 
-		UART3_DR_R = string[i];
+		LCD_Out(string[i]);
 	}
-	while ((UART3_FR_R & UART_FR_TXFF) != 0); // busy wait 
-	UART3_DR_R = '\0'; // string needs to be null terminated 
-	LCD_InData(); 
-	LCD_InData(); 
-	LCD_InData(); 
+	LCD_Out('\0'); // string needs to be null terminated 
+	LCD_Expect(3, REPLY_ACK, 0, WRITE_TIMEOUT_MS); // ACK and the string length 
 }
 
 /********* SD CARD FUNCTIONS **************/ 
 
 void LCD_MediaInit() { 
-	while ((UART3_FR_R & UART_FR_TXFF) != 0); // busy wait 
-	UART3_DR_R = 0xFF;
-	while ((UART3_FR_R & UART_FR_TXFF) != 0); // busy wait 
-	UART3_DR_R = 0x89;
+	LCD_Out(0xFF);
+	LCD_Out(0x89);
 	
-	if (LCD_InData() != 0x06) LCD_WriteString("Media Init Command Unsuccessful \n"); 
-	if (LCD_InData() == 1) LCD_WriteString("Actually you just misread \n"); 
-	if (LCD_InData() == 0) LCD_WriteString("SD Card not present! \n"); 
+	uint32_t status = LCD_Wait(LCD_Expect(3, REPLY_STATUS, 0, WRITE_TIMEOUT_MS)); 
+	if (status == LCD_FAILED) LCD_WriteString("SD Card not present! \n"); 
+	else if (status != LCD_OK) LCD_WriteString("Media Init Command Unsuccessful \n"); 
+	CurrentSector = 0xFFFFFFFF; 
 }
 
 void LCD_SetSectorAddress(uint32_t sector_location) { 
 	// command 
-	while ((UART3_FR_R & UART_FR_TXFF) != 0); // busy wait 
-	UART3_DR_R = 0xFF;
-	while ((UART3_FR_R & UART_FR_TXFF) != 0); // busy wait 
-	UART3_DR_R = 0x92;
+	LCD_Out(0xFF);
+	LCD_Out(0x92);
 	// hiword
-	while ((UART3_FR_R & UART_FR_TXFF) != 0); // busy wait 
-	UART3_DR_R = (sector_location & 0xFF000000) >> 24;
-	while ((UART3_FR_R & UART_FR_TXFF) != 0); // busy wait 
-	UART3_DR_R = (sector_location & 0x00FF0000) >> 16;
+	LCD_Out((sector_location & 0xFF000000) >> 24);
+	LCD_Out((sector_location & 0x00FF0000) >> 16);
 	// loword
-	while ((UART3_FR_R & UART_FR_TXFF) != 0); // busy wait 
-	UART3_DR_R = (sector_location & 0x0000FF00) >> 8;
-	while ((UART3_FR_R & UART_FR_TXFF) != 0); // busy wait 
-	UART3_DR_R = (sector_location & 0x000000FF);
+	LCD_Out((sector_location & 0x0000FF00) >> 8);
+	LCD_Out((sector_location & 0x000000FF));
 	
-	LCD_InData(); 
+	LCD_Expect(1, REPLY_ACK, 0, REPLY_TIMEOUT_MS); 
+	CurrentSector = sector_location; 
 }
 
 void LCD_WriteSector(uint8_t source[]) { 
-	int i;
-	while ((UART3_FR_R & UART_FR_TXFF) != 0); // busy wait 
-	UART3_DR_R = 0x00;
-	while ((UART3_FR_R & UART_FR_TXFF) != 0); // busy wait 
-	UART3_DR_R = 0x17;
-	for (i = 0; i < 512; ++i) { 
-		while ((UART3_FR_R & UART_FR_TXFF) != 0); // busy wait 
-		UART3_DR_R = source[i]; // iterating through the source array
-	}
+	LCD_Out(0x00);
+	LCD_Out(0x17);
+	LCD_OutBlock(source, 512); 
 	
-	LCD_InData(); 
-	LCD_InData(); 
-	if (LCD_InData() == 0) LCD_WriteString("Write Media Attempt Failed \n");  
+	LCD_Expect(3, REPLY_STATUS, 0, WRITE_TIMEOUT_MS); // ACK, then a status word that is 0 if the write failed 
+	++CurrentSector; 
+}
+
+void LCD_WriteSectorAt(uint32_t sector, uint8_t *source) { 
+	if (sector != CurrentSector) LCD_SetSectorAddress(sector); 
+	LCD_WriteSector(source); 
 }
 
 void LCD_ReadSector(uint8_t (*to_populate)[512]) { 
-	int i; 
-	while ((UART3_FR_R & UART_FR_TXFF) != 0); // busy wait 
-	UART3_DR_R = 0x00;
-	while ((UART3_FR_R & UART_FR_TXFF) != 0); // busy wait 
-	UART3_DR_R = 0x16;
+	LCD_Out(0x00);
+	LCD_Out(0x16);
 	
-	LCD_InData(); 
-	LCD_InData(); 
+	// ACK and a status word, then the sector straight into to_populate 
+	LCD_Wait(LCD_Expect(3 + 512, REPLY_STATUS, *to_populate, WRITE_TIMEOUT_MS)); 
+	++CurrentSector; 
+}
+
+uint32_t LCD_ReadSectorAt(uint32_t sector, uint8_t *destination) { 
+	if (sector != CurrentSector) LCD_SetSectorAddress(sector); 
+	LCD_Out(0x00);
+	LCD_Out(0x16);
 	
-	for (i = 0; i < 512; ++i) { 
-		while ((UART3_FR_R & UART_FR_RXFE) != 0); 
-		(*to_populate)[i] = (UART3_DR_R&0xFF);
-	}
+	uint32_t status = LCD_Wait(LCD_Expect(3 + 512, REPLY_STATUS, destination, WRITE_TIMEOUT_MS)); 
+	++CurrentSector; 
+	return (status == LCD_OK); 
 }
 
 void LCD_FlushMedia() { 
-	while ((UART3_FR_R & UART_FR_TXFF) != 0); // busy wait 
-	UART3_DR_R = 0xFF;
-	while ((UART3_FR_R & UART_FR_TXFF) != 0); // busy wait 
-	UART3_DR_R = 0x8A;
+	LCD_Out(0xFF);
+	LCD_Out(0x8A);
 	
-	LCD_InData(); 
-	LCD_InData(); 
-	if (LCD_InData() == 0) LCD_WriteString("Flush Media Attempt Failed \n");  
+	if (LCD_Wait(LCD_Expect(3, REPLY_STATUS, 0, WRITE_TIMEOUT_MS)) != LCD_OK) LCD_WriteString("Flush Media Attempt Failed \n");  
 }
 
 void LCD_DisplayImage(uint16_t x_pos, uint16_t y_pos) { 
-	while ((UART3_FR_R & UART_FR_TXFF) != 0); // busy wait 
-	UART3_DR_R = 0xFF;
-	while ((UART3_FR_R & UART_FR_TXFF) != 0); // busy wait 
-	UART3_DR_R = 0x8B;
+	LCD_Out(0xFF);
+	LCD_Out(0x8B);
 	
 	// x
-	while ((UART3_FR_R & UART_FR_TXFF) != 0); // busy wait 
-	UART3_DR_R = (x_pos & 0xFF00) >> 8;
-	while ((UART3_FR_R & UART_FR_TXFF) != 0); // busy wait 
-	UART3_DR_R = (x_pos & 0x00FF);
+	LCD_Out((x_pos & 0xFF00) >> 8);
+	LCD_Out((x_pos & 0x00FF));
 	
 	// y
-	while ((UART3_FR_R & UART_FR_TXFF) != 0); // busy wait 
-	UART3_DR_R = (y_pos & 0xFF00) >> 8;
-	while ((UART3_FR_R & UART_FR_TXFF) != 0); // busy wait 
-	UART3_DR_R = (y_pos & 0x00FF);
+	LCD_Out((y_pos & 0xFF00) >> 8);
+	LCD_Out((y_pos & 0x00FF));
 	
-	if (LCD_InData() != 0x06) LCD_WriteString("Unable to Display Image \n"); 
+	if (LCD_Wait(LCD_Expect(1, REPLY_ACK, 0, WRITE_TIMEOUT_MS)) != LCD_OK) LCD_WriteString("Unable to Display Image \n"); 
+	CurrentSector = 0xFFFFFFFF; // display read through the image, don't know where it stopped 
 }
 
 
 
+void LCD_QueueImage(uint32_t sector, uint16_t x_pos, uint16_t y_pos) { 
+	if (sector != CurrentSector) LCD_SetSectorAddress(sector); 
+	LCD_Out(0xFF);
+	LCD_Out(0x8B);
+	LCD_Out((x_pos & 0xFF00) >> 8);
+	LCD_Out((x_pos & 0x00FF));
+	LCD_Out((y_pos & 0xFF00) >> 8);
+	LCD_Out((y_pos & 0x00FF));
+	LCD_Expect(1, REPLY_ACK, 0, WRITE_TIMEOUT_MS); 
+	CurrentSector = 0xFFFFFFFF; 
+}
+
 /********* FILE SYSTEM FUNCTIONS **********/ 
 
+#define FILE_CHUNK 512       // the most one file write (00 10) takes 
+static uint32_t FileNumber = 0;  // counter value of the next file, its name is IMG_ FileNumber % FILE_NUMBERS 
+static uint32_t FileSearched = 0; // 1 once a taken name has been jumped past by the card's IMG_ count since mount 
+
+// recent names cache: the file count of the card and the last DIR_NAMES names looked up or written, 
+// so counting and checking those names again doesn't need a round trip. it is not a copy of the 
+// directory, a name it hasn't seen still gets asked about. the count comes from one *.* count at 
+// mount and is kept up to date by every file written. all of it is forgotten at unmount 
+#define DIR_NAMES 16 
+static uint32_t DirMounted = 0; 
+static uint32_t DirFiles = 0;              // every file on the card 
+static char DirNames[DIR_NAMES][13];       // names the display has answered for, or we wrote, newest over oldest 
+static uint8_t DirFound[DIR_NAMES];        // 1 if that name is on the card 
+static uint32_t DirNext = 0;               // slot the next new name goes in 
+
+// returns the slot holding file_name, or -1 
+static int32_t DirLookup(const char *file_name) { 
+	if (!DirMounted) return -1; 
+	for (int32_t i = 0; i < DIR_NAMES; ++i) { 
+		if (DirNames[i][0] != '\0' && strcmp(DirNames[i], file_name) == 0) return i; 
+	}
+	return -1; 
+}
+
+static void DirRemember(const char *file_name, uint32_t found) { 
+	if (!DirMounted) return; 
+	int32_t entry = DirLookup(file_name); 
+	if (entry < 0) { 
+		entry = DirNext; 
+		DirNext = (DirNext + 1)%DIR_NAMES; 
+		strncpy(DirNames[entry], file_name, sizeof(DirNames[entry]) - 1); 
+		DirNames[entry][sizeof(DirNames[entry]) - 1] = '\0'; 
+	}
+	DirFound[entry] = found; 
+}
+
+// file count (00 01) without the messages: number of files matching pattern 
+static uint32_t LCD_FileCount(const char *pattern) { 
+	LCD_Out(0x00); 
+	LCD_Out(0x01); 
+	for (int i = 0; pattern[i] != '\0'; ++i) { 
+		LCD_Out(pattern[i]); 
+	}
+	LCD_Out('\0'); 
+	uint32_t ticket = LCD_Expect(3, REPLY_ACK, 0, REPLY_TIMEOUT_MS); 
+	if (LCD_Wait(ticket) != LCD_OK) return 0; 
+	return (LCD_Reply(ticket)[1] << 8) + LCD_Reply(ticket)[2]; 
+}
+
+// file exists without the messages, answered from the recent names cache when it can be 
+// returns 1 if it is there, or if the display didn't say (so nothing gets overwritten) 
+static uint32_t LCD_FileFound(const char *file_name) { 
+	int32_t entry = DirLookup(file_name); 
+	if (entry >= 0) return DirFound[entry]; 
+	// file exists (00 05, name) 
+	LCD_Out(0x00); 
+	LCD_Out(0x05); 
+	for (int i = 0; file_name[i] != '\0'; ++i) { 
+		LCD_Out(file_name[i]); 
+	}
+	LCD_Out('\0'); 
+	uint32_t ticket = LCD_Expect(3, REPLY_ACK, 0, REPLY_TIMEOUT_MS); 
+	if (LCD_Wait(ticket) != LCD_OK) return 1; 
+	uint32_t found = (LCD_Reply(ticket)[2] != 0); 
+	DirRemember(file_name, found); 
+	return found; 
+}
+
+
 void LCD_FileMount() { 
-	while ((UART3_FR_R & UART_FR_TXFF) != 0); // busy wait 
-	UART3_DR_R = 0xFF; 
-	while ((UART3_FR_R & UART_FR_TXFF) != 0); // busy wait 
-	UART3_DR_R = 0x03; 
+	LCD_Out(0xFF); 
+	LCD_Out(0x03); 
 	
 	if (LCD_InData() != 0x06) LCD_WriteString("file mount is fucked\n");  
 	int status_one = LCD_InData(); 
@@ -171,31 +556,31 @@ void LCD_FileMount() {
 	int status_code = ((status_one << 8) + status_two); 
 	if (status_code != 0) LCD_WriteString("successful mounting\n"); 
 	else LCD_WriteString("unsuccessful mounting\n"); 
+	
+	// the one look at the card per mount: how many files there are 
+	for (int i = 0; i < DIR_NAMES; ++i) DirNames[i][0] = '\0'; 
+	DirNext = 0; 
+	DirMounted = 0; 
+	DirFiles = LCD_FileCount("*.*"); 
+	DirMounted = 1; 
+	FileSearched = 0; 
 } 
 
 void LCD_FileDisplayImage(uint16_t handle) { 
-	while ((UART3_FR_R & UART_FR_TXFF) != 0); // busy wait 
-	UART3_DR_R = 0xFF; 
-	while ((UART3_FR_R & UART_FR_TXFF) != 0); // busy wait 
-	UART3_DR_R = 0x11;
+	LCD_Out(0xFF); 
+	LCD_Out(0x11);
 
 	// x coord: 
-	while ((UART3_FR_R & UART_FR_TXFF) != 0); // busy wait 
-	UART3_DR_R = 0x00; 
-	while ((UART3_FR_R & UART_FR_TXFF) != 0); // busy wait 
-	UART3_DR_R = 0x05;
+	LCD_Out(0x00); 
+	LCD_Out(0x05);
 
 	// y coord: 
-	while ((UART3_FR_R & UART_FR_TXFF) != 0); // busy wait 
-	UART3_DR_R = 0x00; 
-	while ((UART3_FR_R & UART_FR_TXFF) != 0); // busy wait 
-	UART3_DR_R = 0x05;
+	LCD_Out(0x00); 
+	LCD_Out(0x05);
 
 	// handle: 	
-	while ((UART3_FR_R & UART_FR_TXFF) != 0); // busy wait 
-	UART3_DR_R = (handle & 0xFF00) >> 8; 
-	while ((UART3_FR_R & UART_FR_TXFF) != 0); // busy wait 
-	UART3_DR_R = (handle & 0x00FF);
+	LCD_Out((handle & 0xFF00) >> 8); 
+	LCD_Out((handle & 0x00FF));
 
 	if (LCD_InData() != 0x06) LCD_WriteString("\nDisplay Image mismatch \n"); 
 	LCD_InData(); 
@@ -204,49 +589,46 @@ void LCD_FileDisplayImage(uint16_t handle) {
 
 // unmount the file system 
 void LCD_FileUnmount() { 
-	while ((UART3_FR_R & UART_FR_TXFF) != 0); // busy wait 
-	UART3_DR_R = 0xFF; 
-	while ((UART3_FR_R & UART_FR_TXFF) != 0); // busy wait 
-	UART3_DR_R = 0x02; 
+	LCD_Out(0xFF); 
+	LCD_Out(0x02); 
 	
 	if (LCD_InData() != 0x06) LCD_WriteString("file unmount is fucked");
 	else LCD_WriteString("file sys unmounted\n");
+	DirMounted = 0; 
 }
 
 void LCD_FileExists(char * file_name) { 
-	while ((UART3_FR_R & UART_FR_TXFF) != 0); // busy wait 
-	UART3_DR_R = 0x00; 
-	while ((UART3_FR_R & UART_FR_TXFF) != 0); // busy wait 
-	UART3_DR_R = 0x05; 
+	int32_t entry = DirLookup(file_name); 
+	if (entry >= 0) { 
+		LCD_WriteString(DirFound[entry] ? "\nfile found!\n" : "\nfile not found\n"); 
+		return; 
+	}
+	LCD_Out(0x00); 
+	LCD_Out(0x05); 
 	
 	for (int i = 0; file_name[i] != '\0'; i++) { 
-		while ((UART3_FR_R & UART_FR_TXFF) != 0); // busy wait 
-		UART3_DR_R = file_name[i];
+		LCD_Out(file_name[i]);
 	}
-	while ((UART3_FR_R & UART_FR_TXFF) != 0); // busy wait 
-	UART3_DR_R = '\0'; // string needs to be null terminated 
+	LCD_Out('\0'); // string needs to be null terminated 
 	
 	
 	if (LCD_InData() != 0x06) LCD_WriteString("\nmiscommunication - LCD_FileExists\n");
 	LCD_InData(); 
-	if (LCD_InData() == 0x01) LCD_WriteString("\nfile found!\n");
+	uint32_t found = (LCD_InData() == 0x01); 
+	DirRemember(file_name, found); 
+	if (found) LCD_WriteString("\nfile found!\n");
 	else LCD_WriteString("\nfile not found\n"); 
 }
 
 int LCD_TotalFileCount() { 
-	while ((UART3_FR_R & UART_FR_TXFF) != 0); // busy wait 
-	UART3_DR_R = 0x00; 
-	while ((UART3_FR_R & UART_FR_TXFF) != 0); // busy wait 
-	UART3_DR_R = 0x01; 
+	if (DirMounted) return DirFiles; 
+	LCD_Out(0x00); 
+	LCD_Out(0x01); 
 	
-	while ((UART3_FR_R & UART_FR_TXFF) != 0); // busy wait 
-	UART3_DR_R = 0x2A; 
-	while ((UART3_FR_R & UART_FR_TXFF) != 0); // busy wait 
-	UART3_DR_R = 0x2E; 
-	while ((UART3_FR_R & UART_FR_TXFF) != 0); // busy wait 
-	UART3_DR_R = 0x2A; 
-	while ((UART3_FR_R & UART_FR_TXFF) != 0); // busy wait 
-	UART3_DR_R = 0x00; 
+	LCD_Out(0x2A); 
+	LCD_Out(0x2E); 
+	LCD_Out(0x2A); 
+	LCD_Out(0x00); 
 	
 	
 	if (LCD_InData() != 0x06) LCD_WriteString("file count is fucked\n");  
@@ -259,22 +641,17 @@ int LCD_TotalFileCount() {
 // returns the handle 
 uint16_t LCD_FileOpen(char * file_name, char mode) { 
 	// command
-	while ((UART3_FR_R & UART_FR_TXFF) != 0); // busy wait 
-	UART3_DR_R = 0x00;
-	while ((UART3_FR_R & UART_FR_TXFF) != 0); // busy wait 
-	UART3_DR_R = 0x0A;
+	LCD_Out(0x00);
+	LCD_Out(0x0A);
 	
 	// file name 
 	for (int i = 0; file_name[i] != '\0'; ++i) { 
-		while ((UART3_FR_R & UART_FR_TXFF) != 0); // busy wait 
-		UART3_DR_R = file_name[i]; 
+		LCD_Out(file_name[i]); 
 	}
-	while ((UART3_FR_R & UART_FR_TXFF) != 0); // busy wait 
-	UART3_DR_R = '\0'; // all strings are null terminated, including file names 
+	LCD_Out('\0'); // all strings are null terminated, including file names 
 	
 	// set the mode 
-	while ((UART3_FR_R & UART_FR_TXFF) != 0); // busy wait 
-	UART3_DR_R = mode; // write mode  
+	LCD_Out(mode); // write mode  
 	
 	// get ack signal: 
 	if (LCD_InData() != 0x06) LCD_WriteString("file open is fucked");  
@@ -287,16 +664,12 @@ uint16_t LCD_FileOpen(char * file_name, char mode) {
 // close the file 
 void LCD_FileClose(uint16_t handle) { 
 	// command
-	while ((UART3_FR_R & UART_FR_TXFF) != 0); // busy wait 
-	UART3_DR_R = 0xFF; 
-	while ((UART3_FR_R & UART_FR_TXFF) != 0); // busy wait 
-	UART3_DR_R = 0x18;
+	LCD_Out(0xFF); 
+	LCD_Out(0x18);
 	
 	// handle 
-	while ((UART3_FR_R & UART_FR_TXFF) != 0); // busy wait 
-	UART3_DR_R = (handle & 0xFF00) >> 8; 
-	while ((UART3_FR_R & UART_FR_TXFF) != 0); // busy wait 
-	UART3_DR_R = (handle & 0xFF); 	
+	LCD_Out((handle & 0xFF00) >> 8); 
+	LCD_Out((handle & 0xFF)); 	
 	
 	if (LCD_InData() != 0x06) LCD_WriteString("file close is fucked"); 
 	LCD_InData(); 
@@ -305,89 +678,104 @@ void LCD_FileClose(uint16_t handle) {
 
 int LCD_FileError() { 
 	// command
-	while ((UART3_FR_R & UART_FR_TXFF) != 0); // busy wait 
-	UART3_DR_R = 0xFF; 
-	while ((UART3_FR_R & UART_FR_TXFF) != 0); // busy wait 
-	UART3_DR_R = 0x1F;
+	LCD_Out(0xFF); 
+	LCD_Out(0x1F);
 	
 	if (LCD_InData() != 0x06) LCD_WriteString("mismatch - lcd_fileerror");
 	LCD_InData(); 
 	return LCD_InData(); 
 }	
 
-/*
+/********* STREAMING FILE WRITER **********/ 
 
-// writing to file once it is opened 
-void LCD_FileWrite(uint16_t num_bytes, uint16_t handle) { 
-	// command
-	while ((UART3_FR_R & UART_FR_TXFF) != 0); // busy wait
-	UART3_DR_R = 0x00; 
-	while ((UART3_FR_R & UART_FR_TXFF) != 0); // busy wait
-	UART3_DR_R = 0x10; 
-	
-	// how many bytes are we sending 
-	if (num_bytes > 0xFF) { 
-		while ((UART3_FR_R & UART_FR_TXFF) != 0); // busy wait
-		UART3_DR_R = (num_bytes & 0xFF00) >> 8;
-		while ((UART3_FR_R & UART_FR_TXFF) != 0); // busy wait
-		UART3_DR_R = (num_bytes & 0xFF); 		
-	} else { 
-		while ((UART3_FR_R & UART_FR_TXFF) != 0); // busy wait
-		UART3_DR_R = 0x00;
-		while ((UART3_FR_R & UART_FR_TXFF) != 0); // busy wait
-		UART3_DR_R = (num_bytes & 0xFF); 		
+char LCD_FileName[13]; 
+uint32_t LCD_FileNumber = 0; 
+uint32_t LCD_FileLength = 0; 
+static uint16_t FileHandle = 0; 
+static uint32_t FileErrors;      // LCD_ReplyErrors + LCD_Timeouts when the file was opened 
+
+// LCD_FileName for FileNumber 
+static void LCD_FileNameFor(const char *extension) { 
+	sprintf(LCD_FileName, "IMG_%04lu.%.3s", (unsigned long)(FileNumber % FILE_NUMBERS), extension); 
+}
+
+uint32_t LCD_FileStreamOpen(const char *extension) { 
+	// the number comes from the counter in EEPROM, and every name is checked against the card 
+	// before it is opened, since 'w' would cut short a file already there (one a pc left, or an 
+	// older picture once the names have come round past IMG_9999). names in the recent names cache 
+	// cost no round trip. a taken name gets searched past, jumping by the card's IMG_ count the 
+	// first time after a mount (a card written somewhere else), and the counter moves past whatever is there 
+	FileNumber = FileCounter_Peek(); 
+	uint32_t probes; 
+	for (probes = 0; probes < FILE_NUMBERS; ++probes, ++FileNumber) { 
+		LCD_FileNameFor(extension); 
+		if (!LCD_FileFound(LCD_FileName)) break; 
+		if (!FileSearched) { 
+			uint32_t name = FileNumber % FILE_NUMBERS; 
+			uint32_t images = LCD_FileCount("IMG_*.*"); 
+			if (images > name + 1 && images <= FILE_NUMBERS) { 
+				probes += images - 1 - name; // loop adds the 1 
+				FileNumber += images - 1 - name; 
+			}
+			FileSearched = 1; 
+		}
 	}
+	if (probes >= FILE_NUMBERS) return 0; // every name is on the card 
 	
-	// actually WRITE the data 
-	for (int z = 0; z < num_bytes; ++z) { 
-		while ((UART3_FR_R & UART_FR_TXFF) != 0); // busy wait
-		UART3_DR_R = image_array[z]; 
+	// open (00 0A, name, mode), comes back as ACK and the handle (0 if it didn't open) 
+	LCD_Out(0x00); 
+	LCD_Out(0x0A); 
+	for (int i = 0; LCD_FileName[i] != '\0'; ++i) { 
+		LCD_Out(LCD_FileName[i]); 
 	}
-	
-	// what is the handle of the file that we're sending to
-	while ((UART3_FR_R & UART_FR_TXFF) != 0); // busy wait
-	UART3_DR_R = (handle & 0xFF00) >> 8; 	
-	while ((UART3_FR_R & UART_FR_TXFF) != 0); // busy wait
-	UART3_DR_R = (handle & 0xFF); 
-	
-	if (LCD_InData() != 0x06) LCD_WriteString("file write is fucked"); 
-	LCD_InData(); 
-	LCD_InData(); 
+	LCD_Out('\0'); 
+	LCD_Out('w'); 
+	uint32_t ticket = LCD_Expect(3, REPLY_STATUS, 0, WRITE_TIMEOUT_MS); 
+	if (LCD_Wait(ticket) != LCD_OK) return 0; 
+	// the name is taken now, whatever happens to the picture 
+	LCD_FileNumber = FileNumber % FILE_NUMBERS; 
+	++FileNumber; 
+	FileCounter_Set(FileNumber); 
+	if (DirLookup(LCD_FileName) < 0 || !DirFound[DirLookup(LCD_FileName)]) ++DirFiles; 
+	DirRemember(LCD_FileName, 1); 
+	FileHandle = (LCD_Reply(ticket)[1] << 8) + LCD_Reply(ticket)[2]; 
+	FileErrors = LCD_ReplyErrors + LCD_Timeouts; 
+	LCD_FileLength = 0; 
+	return 1; 
 }
- 
-// we want to match with "IMG_*" 
-int LCD_CountFiles() { 
-	// command
-	while ((UART3_FR_R & UART_FR_TXFF) != 0); // busy wait 
-	UART3_DR_R = 0x00; 
-	while ((UART3_FR_R & UART_FR_TXFF) != 0); // busy wait 
-	UART3_DR_R = 0x02;
-	
-	// file we looking for 
-	while ((UART3_FR_R & UART_FR_TXFF) != 0); // busy wait 
-	UART3_DR_R = 'I'; 
-	while ((UART3_FR_R & UART_FR_TXFF) != 0); // busy wait 
-	UART3_DR_R = 'M';
-	while ((UART3_FR_R & UART_FR_TXFF) != 0); // busy wait 
-	UART3_DR_R = 'G'; 
-	while ((UART3_FR_R & UART_FR_TXFF) != 0); // busy wait 
-	UART3_DR_R = '_';
-	while ((UART3_FR_R & UART_FR_TXFF) != 0); // busy wait 
-	UART3_DR_R = '*'; 
-	while ((UART3_FR_R & UART_FR_TXFF) != 0); // busy wait 
-	UART3_DR_R = '\0';
-	
-	LCD_InData();
-	
-	int num_files = 0; 
-	num_files |= LCD_InData(); 
-	num_files = num_files << 8; 
-	num_files |= LCD_InData(); 
-	
-	return num_files; 
-}	
 
+void LCD_FileStreamWrite(uint8_t *data, uint32_t length) { 
+	if (FileHandle == 0) return; 
+	while (length > 0) { 
+		uint32_t n = (length < FILE_CHUNK) ? length : FILE_CHUNK; 
+		// write (00 10, size, data, handle), comes back as ACK and the number of bytes written 
+		LCD_Out(0x00); 
+		LCD_Out(0x10); 
+		LCD_Out((n & 0xFF00) >> 8); 
+		LCD_Out((n & 0x00FF)); 
+		LCD_OutBlock(data, n); 
+		LCD_Out((FileHandle & 0xFF00) >> 8); 
+		LCD_Out((FileHandle & 0x00FF)); 
+		LCD_Expect(3, REPLY_STATUS, 0, WRITE_TIMEOUT_MS); 
+		data += n; 
+		length -= n; 
+		LCD_FileLength += n; 
+	}
+}
 
+uint32_t LCD_FileStreamClose() { 
+	if (FileHandle == 0) return 0; 
+	// close (FF 18, handle), ACK and 1 if it closed. its reply comes after every chunk's 
+	LCD_Out(0xFF); 
+	LCD_Out(0x18); 
+	LCD_Out((FileHandle & 0xFF00) >> 8); 
+	LCD_Out((FileHandle & 0x00FF)); 
+	FileHandle = 0; 
+	if (LCD_Wait(LCD_Expect(3, REPLY_STATUS, 0, WRITE_TIMEOUT_MS)) != LCD_OK) return 0; 
+	return (LCD_ReplyErrors + LCD_Timeouts == FileErrors); 
+}
+
+/*
 void LCD_DisplayImage(uint16_t handle) { 
 	// command
 	while ((UART3_FR_R & UART_FR_TXFF) != 0); // busy wait 
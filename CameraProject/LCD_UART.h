@@ -1,11 +1,25 @@
 #include <stdint.h>
+#ifdef HOST_SIM
+#include "tools/sim/tm4c_sim.h" // UART3 and display models, for the storage benchmark 
+#else
 #include "inc/tm4c123gh6pm.h" 
 #include "inc/CortexM.h"
+#endif
 // #include "UART.h"
 
 // will initialize UART3 - using pc6 (u3rx) and pc7 (u3tx) 
 void LCD_UART_Init(void); 
 
+// baud rate the display link is running at right now (the display powers up at 9600) 
+extern uint32_t LCD_Baud; 
+
+// step the display link up from 9600 with the display's set baud command, as far as each new rate 
+// passes a round trip (get version), and stay at the fastest one that did. if the display stops 
+// answering, go back to 9600. if the display was left at another rate by an earlier run, it is found first 
+// returns the baud rate in use, or 0 if the display doesn't answer at any rate 
+// needs TimeBase running (for the timeouts) 
+uint32_t LCD_NegotiateBaud(void); 
+
 // clear the screen 
 void LCD_Clear(void); 
 
@@ -13,35 +27,85 @@ void LCD_Clear(void);
 void LCD_DrawRectangle(void); 
 
 // receiving serial data from the picaso processor in the lcd display 
+// any replies still owed to queued commands are taken (and checked) first 
+// gives up after 100 ms (counted in LCD_Timeouts) and returns 0 
 char LCD_InData(void); 
 
-// use this to write a string to the LCD display 
+// how a display command went 
+#define LCD_OK      0 
+#define LCD_TIMEOUT 1 // reply went quiet for longer than the command's timeout 
+#define LCD_NAK     2 // no ACK 
+#define LCD_FAILED  3 // ACKed, but the status word says it didn't work (sd card writes etc.) 
+
+// bytes go out through a transmit queue that UART3_Handler drains, so the commands marked "queued" 
+// below return as soon as they are copied in, and several can be in flight at once. 
+// the display answers in order, so each reply is matched to its command by length and checked 
+// as it comes back. a bad one (no ACK, or a failed sector write) is counted here 
+extern uint32_t LCD_ReplyErrors; 
+// replies that never came (each command has its own timeout) 
+extern uint32_t LCD_Timeouts; 
+
+// wait until everything queued has gone out and every reply it is owed has come back 
+void LCD_WaitIdle(void); 
+
+// use this to write a string to the LCD display (queued) 
 void LCD_WriteString(char * string); 
 
+/**** BLIT ****/ 
+// RGB565 pixels straight to the screen, no sd card in between: set the window once, hand over 
+// the pixels as they come in (package by package), close. the whole frame is a single command, 
+// so nothing else can go to the display between open and close 
+
+// open a width x height window at x_pos, y_pos (queued) 
+void LCD_BlitOpen(uint16_t x_pos, uint16_t y_pos, uint16_t width, uint16_t height); 
+
+// add pixels, 2 bytes each, high byte first (queued). same shape as the Camera_StartCapture 
+// store callback. bytes past the end of the window (or with no window open) are dropped 
+void LCD_BlitWrite(uint8_t *data, uint32_t length); 
+
+// finish the blit (queued, its ACK is checked like any other reply) 
+// returns 1 if the window got every pixel, 0 if it had to be filled out (or nothing was open) 
+uint32_t LCD_BlitClose(void); 
+
 /**** SD CARD *********/ 
 
 // initialize sd card to perform instructions on 
 void LCD_MediaInit(void);
 
-// assuming no file system, use this to say which 512-byte section of the sd card to write to 
+// assuming no file system, use this to say which 512-byte section of the sd card to write to (queued) 
 void LCD_SetSectorAddress(uint32_t sector_location); 
 
-// write to address defined by most previous set sector address instruction 
+// write to address defined by most previous set sector address instruction (queued) 
+// source is copied, so it can be reused right away 
 void LCD_WriteSector(uint8_t source[]); 
 
+// write one sector to a given address. only sends a set sector address when the sector 
+// isn't the one right after the last sector written, since the display counts up by itself 
+void LCD_WriteSectorAt(uint32_t sector, uint8_t *source); 
+
 // read from most previous set sector address 
 void LCD_ReadSector(uint8_t (*to_populate)[512]); 
 
+// read one sector from a given address (same shape as LCD_WriteSectorAt, set sector address only if it has to) 
+// returns 1 if the display sent it, 0 if not 
+uint32_t LCD_ReadSectorAt(uint32_t sector, uint8_t *destination); 
+
 // flush after writing 
 void LCD_FlushMedia(void);
 
 // display image defined by most previous set sector address instruction 
 void LCD_DisplayImage(uint16_t x_pos, uint16_t y_pos);
 
+// display image at a sector, at x_pos, y_pos (queued, set sector address only if it has to) 
+// for drawing several images back to back, like a gallery page 
+void LCD_QueueImage(uint32_t sector, uint16_t x_pos, uint16_t y_pos); 
+
 /**** FILE SYSTEM ****/ 
 
 
 // mount the file system 
+// also clears the recent names cache and fills in its file count (one *.* count). 
+// FileCounter_Init has to have been called (once, at startup) 
 void LCD_FileMount(void); 
 
 void LCD_FileDisplayImage(uint16_t handle); 
@@ -51,9 +115,11 @@ void LCD_FileDisplayImage(uint16_t handle);
 void LCD_FileUnmount(void); 
 
 // returns 1 if file exists, 0 if not 
+// names the display has recently answered for (and files we wrote) come from the recent names cache 
 void LCD_FileExists(char * file_name); 
 
 // returns the total number of files in the sd card
+// from the recent names cache while mounted, so no round trip 
 int	LCD_TotalFileCount(void);
 
 // opens the file, sets it up for a certain mode 
@@ -66,11 +132,38 @@ void LCD_FileClose(uint16_t handle);
 
 int LCD_FileError(void); 
 
+/**** STREAMING FILE WRITER ****/ 
+// saves a picture as its own file (IMG_0000.JPG, IMG_0001.JPG, ...) while it is coming in, 
+// without holding a frame in ram: every package goes out as one file write, chunks of up to 
+// 512 bytes (the most the display takes at once, and it keeps the per-write overhead down), 
+// all queued back to back. one file at a time. the file system has to be mounted 
+
+// name of the file being written (or last written) 
+extern char LCD_FileName[13]; 
+
+// the nnnn of that name (0 to FILE_NUMBERS - 1, also its thumbnail slot) 
+extern uint32_t LCD_FileNumber; 
+
+// bytes handed to LCD_FileStreamWrite since the file was opened 
+extern uint32_t LCD_FileLength; 
+
+// open the next free IMG_nnnn file for writing. the number comes from FileCounter (EEPROM), 
+// so naming doesn't need a search of the card. each name is still checked before it is opened 
+// (a file exists, one round trip unless the name is in the recent names cache), so nothing on 
+// the card gets overwritten 
+// extension: up to 3 characters, "JPG", "RAW" 
+// returns 1 if it opened, 0 if not (display not answering, or all 10000 names on the card) 
+uint32_t LCD_FileStreamOpen(const char *extension); 
+
+// add bytes to the file (queued). same shape as the Camera_StartCapture store callback, 
+// and data can be reused as soon as it returns 
+void LCD_FileStreamWrite(uint8_t *data, uint32_t length); 
+
+// close the file once every chunk has been written 
+// returns 1 if every chunk and the close were ACKed, 0 if anything went wrong 
+uint32_t LCD_FileStreamClose(void); 
+
 /*
-// actually write data to the file
-// num_bytes: number of bytes we send to the file 
-// handle: associated w file 
-void LCD_FileWrite(uint16_t num_bytes, uint16_t handle); 
 
 // close the file 
 // input: handle associated w file 
@@ -80,9 +173,6 @@ void LCD_FileClose(uint16_t handle);
 // no inputs 
 void LCD_FileUnmount(void); 
 
-// count files in the file system  
-int LCD_CountFiles(void); 
-
 // display image associated with certain handle 
 // void LCD_DisplayImage(uint16_t handle); 
 */ 
\ No newline at end of file
@@ -0,0 +1,230 @@
+#include <string.h>
+#include "Pixel.h"
+
+// the word at a time kernels need REV16 and SMLAD. on a pc (HOST_SIM) the same instructions are 
+// done in C, so tools/pixel_bench.c can run both paths and check they agree 
+#if defined(__ARM_FEATURE_SIMD32)
+#include <arm_acle.h>
+#define PIXEL_WORDS 1 
+#define Rev16(x) __rev16(x) 
+#define Smlad(x, y, sum) __smlad(x, y, sum) 
+#elif defined(HOST_SIM)
+#define PIXEL_WORDS 1 
+static inline uint32_t Rev16(uint32_t x) { 
+	return ((x & 0x00FF00FF) << 8) | ((x >> 8) & 0x00FF00FF); 
+} 
+static inline int32_t Smlad(uint32_t x, uint32_t y, int32_t sum) { 
+	return sum + (int16_t)x*(int16_t)y + (int16_t)(x >> 16)*(int16_t)(y >> 16); 
+} 
+#else
+#define PIXEL_WORDS 0 
+#endif
+
+#define GREY_RED   77 
+#define GREY_GREEN 150 
+#define GREY_BLUE  29 // the three add up to 256, so white stays 255 
+
+uint32_t Pixel_Simd = PIXEL_WORDS; 
+
+// plain C, a pixel at a time 
+
+static uint32_t Red(uint32_t p) { 
+	uint32_t r = (p >> 11) & 0x1F; 
+	return (r << 3) | (r >> 2); 
+} 
+
+static uint32_t Green(uint32_t p) { 
+	uint32_t g = (p >> 5) & 0x3F; 
+	return (g << 2) | (g >> 4); 
+} 
+
+static uint32_t Blue(uint32_t p) { 
+	uint32_t b = p & 0x1F; 
+	return (b << 3) | (b >> 2); 
+} 
+
+static void SwapBytes(uint8_t *destination, const uint8_t *source, uint32_t pixels) { 
+	for (uint32_t i = 0; i < pixels; ++i) { 
+		uint8_t high = source[2*i]; 
+		destination[2*i] = source[2*i + 1]; 
+		destination[2*i + 1] = high; 
+	} 
+} 
+
+static void To888Bytes(uint8_t *destination, const uint8_t *source, uint32_t pixels) { 
+	for (uint32_t i = 0; i < pixels; ++i) { 
+		uint32_t p = (source[2*i] << 8) | source[2*i + 1]; 
+		destination[3*i] = Red(p); 
+		destination[3*i + 1] = Green(p); 
+		destination[3*i + 2] = Blue(p); 
+	} 
+} 
+
+static void From888Bytes(uint8_t *destination, const uint8_t *source, uint32_t pixels) { 
+	for (uint32_t i = 0; i < pixels; ++i) { 
+		destination[2*i] = (source[3*i] & 0xF8) | (source[3*i + 1] >> 5); 
+		destination[2*i + 1] = ((source[3*i + 1] << 3) & 0xE0) | (source[3*i + 2] >> 3); 
+	} 
+} 
+
+static void ToGreyBytes(uint8_t *destination, const uint8_t *source, uint32_t pixels) { 
+	for (uint32_t i = 0; i < pixels; ++i) { 
+		uint32_t p = (source[2*i] << 8) | source[2*i + 1]; 
+		destination[i] = (GREY_RED*Red(p) + GREY_GREEN*Green(p) + GREY_BLUE*Blue(p)) >> 8; 
+	} 
+} 
+
+static void ToBgrBytes(uint8_t *destination, const uint8_t *source, uint32_t pixels) { 
+	for (uint32_t i = 0; i < pixels; ++i) { 
+		uint32_t p = (source[2*i] << 8) | source[2*i + 1]; 
+		destination[3*i] = Blue(p); 
+		destination[3*i + 1] = Green(p); 
+		destination[3*i + 2] = Red(p); 
+	} 
+} 
+
+// a word (two pixels) at a time. each loop does 4 pixels, whatever is left over goes through the plain loop. 
+// memcpy of 4 bytes compiles to one LDR/STR (the m4 does unaligned word accesses) 
+
+#if PIXEL_WORDS
+
+static inline uint32_t Load(const uint8_t *source) { 
+	uint32_t word; 
+	memcpy(&word, source, 4); 
+	return word; 
+} 
+
+static inline void Store(uint8_t *destination, uint32_t word) { 
+	memcpy(destination, &word, 4); 
+} 
+
+// two pixels, low byte first (after Rev16), pixel 0 in the low half -> their channels widened to 
+// 8 bits, pixel 0 in bits 0-7 and pixel 1 in bits 16-23 of each. the masks keep each half's bits in its own half 
+static inline void Widen(uint32_t pixels, uint32_t *red, uint32_t *green, uint32_t *blue) { 
+	*red = ((pixels >> 8) & 0x00F800F8) | ((pixels >> 13) & 0x00070007); 
+	*green = ((pixels >> 3) & 0x00FC00FC) | ((pixels >> 9) & 0x00030003); 
+	*blue = ((pixels << 3) & 0x00F800F8) | ((pixels >> 2) & 0x00070007); 
+} 
+
+// 4 pixels as 3 byte triplets (first, green, last) packed into 3 words. first/last are red/blue 
+// for 888, blue/red for a BMP 
+static inline void Store3(uint8_t *destination, uint32_t first01, uint32_t green01, uint32_t last01, 
+	uint32_t first23, uint32_t green23, uint32_t last23) { 
+	uint32_t pair01 = first01 | (green01 << 8); // bytes first0 green0 first1 green1 
+	uint32_t pair23 = first23 | (green23 << 8); 
+	uint32_t p0 = (pair01 & 0xFFFF) | ((last01 & 0xFF) << 16); 
+	uint32_t p1 = (pair01 >> 16) | (last01 & 0x00FF0000); 
+	uint32_t p2 = (pair23 & 0xFFFF) | ((last23 & 0xFF) << 16); 
+	uint32_t p3 = (pair23 >> 16) | (last23 & 0x00FF0000); 
+	Store(destination, p0 | (p1 << 24)); 
+	Store(destination + 4, (p1 >> 8) | (p2 << 16)); 
+	Store(destination + 8, (p2 >> 16) | (p3 << 8)); 
+} 
+
+static uint32_t SwapWords(uint8_t *destination, const uint8_t *source, uint32_t pixels) { 
+	uint32_t i; 
+	for (i = 0; i + 4 <= pixels; i += 4) { 
+		uint32_t a = Load(&source[2*i]), b = Load(&source[2*i + 4]); 
+		Store(&destination[2*i], Rev16(a)); 
+		Store(&destination[2*i + 4], Rev16(b)); 
+	} 
+	return i; 
+} 
+
+static uint32_t To888Words(uint8_t *destination, const uint8_t *source, uint32_t pixels, uint32_t bgr) { 
+	uint32_t i; 
+	for (i = 0; i + 4 <= pixels; i += 4) { 
+		uint32_t r01, g01, b01, r23, g23, b23; 
+		Widen(Rev16(Load(&source[2*i])), &r01, &g01, &b01); 
+		Widen(Rev16(Load(&source[2*i + 4])), &r23, &g23, &b23); 
+		if (bgr) { 
+			Store3(&destination[3*i], b01, g01, r01, b23, g23, r23); 
+		} else { 
+			Store3(&destination[3*i], r01, g01, b01, r23, g23, b23); 
+		} 
+	} 
+	return i; 
+} 
+
+// one pixel as red | green << 8 | blue << 16 -> RGB565 
+static inline uint32_t Narrow(uint32_t p) { 
+	return ((p & 0xF8) << 8) | ((p >> 5) & 0x07E0) | ((p >> 19) & 0x1F); 
+} 
+
+static uint32_t From888Words(uint8_t *destination, const uint8_t *source, uint32_t pixels) { 
+	uint32_t i; 
+	for (i = 0; i + 4 <= pixels; i += 4) { 
+		uint32_t a = Load(&source[3*i]);     // r0 g0 b0 r1 
+		uint32_t b = Load(&source[3*i + 4]); // g1 b1 r2 g2 
+		uint32_t c = Load(&source[3*i + 8]); // b2 r3 g3 b3 
+		uint32_t p01 = Narrow(a) | (Narrow((a >> 24) | (b << 8)) << 16); 
+		uint32_t p23 = Narrow((b >> 16) | (c << 16)) | (Narrow(c >> 8) << 16); 
+		Store(&destination[2*i], Rev16(p01)); 
+		Store(&destination[2*i + 4], Rev16(p23)); 
+	} 
+	return i; 
+} 
+
+// grey for the two pixels in one word: SMLAD does red*77 + blue*29 in one go, green*150 is the sum it adds to. 
+// green*150 fits in 16 bits, so one multiply does both pixels 
+static inline uint32_t Grey2(uint32_t pixels) { 
+	uint32_t red, green, blue; 
+	Widen(pixels, &red, &green, &blue); 
+	uint32_t weights = GREY_RED | (GREY_BLUE << 16); 
+	uint32_t green150 = green*GREY_GREEN; 
+	uint32_t y0 = Smlad((red & 0xFFFF) | (blue << 16), weights, green150 & 0xFFFF) >> 8; 
+	uint32_t y1 = Smlad((red >> 16) | (blue & 0xFFFF0000), weights, green150 >> 16) >> 8; 
+	return y0 | (y1 << 8); 
+} 
+
+static uint32_t ToGreyWords(uint8_t *destination, const uint8_t *source, uint32_t pixels) { 
+	uint32_t i; 
+	for (i = 0; i + 4 <= pixels; i += 4) { 
+		uint32_t y01 = Grey2(Rev16(Load(&source[2*i]))); 
+		uint32_t y23 = Grey2(Rev16(Load(&source[2*i + 4]))); 
+		Store(&destination[i], y01 | (y23 << 16)); 
+	} 
+	return i; 
+} 
+
+#endif
+
+void Pixel_Swap(uint8_t *destination, const uint8_t *source, uint32_t pixels) { 
+	uint32_t done = 0; 
+#if PIXEL_WORDS
+	if (Pixel_Simd) done = SwapWords(destination, source, pixels); 
+#endif
+	SwapBytes(&destination[2*done], &source[2*done], pixels - done); 
+} 
+
+void Pixel_To888(uint8_t *destination, const uint8_t *source, uint32_t pixels) { 
+	uint32_t done = 0; 
+#if PIXEL_WORDS
+	if (Pixel_Simd) done = To888Words(destination, source, pixels, 0); 
+#endif
+	To888Bytes(&destination[3*done], &source[2*done], pixels - done); 
+} 
+
+void Pixel_From888(uint8_t *destination, const uint8_t *source, uint32_t pixels) { 
+	uint32_t done = 0; 
+#if PIXEL_WORDS
+	if (Pixel_Simd) done = From888Words(destination, source, pixels); 
+#endif
+	From888Bytes(&destination[2*done], &source[3*done], pixels - done); 
+} 
+
+void Pixel_ToGrey(uint8_t *destination, const uint8_t *source, uint32_t pixels) { 
+	uint32_t done = 0; 
+#if PIXEL_WORDS
+	if (Pixel_Simd) done = ToGreyWords(destination, source, pixels); 
+#endif
+	ToGreyBytes(&destination[done], &source[2*done], pixels - done); 
+} 
+
+void Pixel_ToBgr(uint8_t *destination, const uint8_t *source, uint32_t pixels) { 
+	uint32_t done = 0; 
+#if PIXEL_WORDS
+	if (Pixel_Simd) done = To888Words(destination, source, pixels, 1); 
+#endif
+	ToBgrBytes(&destination[3*done], &source[2*done], pixels - done); 
+} 
@@ -0,0 +1,30 @@
+#include <stdint.h>
+
+// block conversions for RGB565 pictures, the camera's RAW format (CAMERA_RAW, high byte first). 
+// each takes pixels from source and writes the converted pixels to destination, any alignment. 
+// on the tm4c (cortex-m4) they go a word at a time with the packed (SIMD) instructions: REV16 to 
+// swap both bytes of two pixels at once, SMLAD for the grey dot product, and whole word loads and 
+// stores where the plain loop goes a byte at a time. anywhere else (or with Pixel_Simd = 0) they 
+// take the plain C loop. both give the same bytes (tools/pixel_bench.c checks and times them) 
+// 5 and 6 bit channels widen to 8 bits with their top bits repeated (31 -> 255), so 565 -> 888 -> 565 
+// gives back the same pixels 
+
+// 1 if the word at a time kernels are built in (cortex-m4, or a pc build with HOST_SIM) and in use. 
+// 0 makes every call take the plain C loop 
+extern uint32_t Pixel_Simd; 
+
+// RGB565 high byte first <-> low byte first (the uint16_t the cpu reads). same both ways, 
+// and destination can be source 
+void Pixel_Swap(uint8_t *destination, const uint8_t *source, uint32_t pixels); 
+
+// RGB565 high byte first -> 3 bytes a pixel: red, green, blue 
+void Pixel_To888(uint8_t *destination, const uint8_t *source, uint32_t pixels); 
+
+// 3 bytes a pixel (red, green, blue) -> RGB565 high byte first. the low bits of each channel are dropped 
+void Pixel_From888(uint8_t *destination, const uint8_t *source, uint32_t pixels); 
+
+// RGB565 high byte first -> one byte of grey a pixel, (77*red + 150*green + 29*blue)/256 
+void Pixel_ToGrey(uint8_t *destination, const uint8_t *source, uint32_t pixels); 
+
+// RGB565 high byte first -> 3 bytes a pixel: blue, green, red, the order of a 24 bit BMP row 
+void Pixel_ToBgr(uint8_t *destination, const uint8_t *source, uint32_t pixels); 
@@ -0,0 +1,53 @@
+#include <stdint.h>
+
+// sector storage straight on an SPI SD card (eDisk.c, SSI0), same calls as the display's sector 
+// functions in LCD_UART.h, so capture code picks a backend by which write it hands SectorBuffer: 
+//   SectorBuffer_Open(0, SDCard_WriteSectorAt);   instead of   SectorBuffer_Open(0, LCD_WriteSectorAt); 
+// consecutive sectors go into one open multi-block write (CMD25), pre-erased when the count is 
+// known (SDCard_Reserve), and the data of every block goes out on uDMA while the next one is coming in. 
+// a write that isn't the next sector, a read, or SDCard_Flush closes the multi-block write. 
+// needs TimeBase (eDisk's timeouts) and the uDMA controller (DMA_UART_Enable) running 
+
+// sector writes the card rejected, or that couldn't be started 
+extern uint32_t SDCard_Errors; 
+
+// bring the card up (slow clock, CRC mode on), then SDCard_Tune 
+// returns 1 if there is a card that answered, 0 if not 
+uint32_t SDCard_Init(void); 
+
+// SSI0 clock divisor the card runs at (80 MHz/SDCard_Divisor), and 1 if it was tuned 
+// (0: the tune couldn't read the card, and the driver's 10 MHz or slower is used) 
+extern uint32_t SDCard_Divisor; 
+extern uint32_t SDCard_Tuned; 
+
+// find the fastest SSI0 clock this card reads back cleanly at: with CRC mode on, the first few 
+// sectors are read over and over at faster and faster clocks, each read checked against its CRC16 
+// and a copy read at 5 MHz. the card then runs one step slower than the fastest clock that passed. 
+// the result is kept in EEPROM under the card's CID, so the next power up with the same card only 
+// checks that clock once more instead of searching again. read only, nothing on the card changes 
+// returns the divisor in use 
+uint32_t SDCard_Tune(void); 
+
+// the next multi-block write pre-erases this many sectors (ACMD23), which saves the card erasing 
+// as it goes. call before the first write of a picture whose size is known 
+void SDCard_Reserve(uint32_t count); 
+
+// say which 512-byte sector of the card the next write goes to 
+void SDCard_SetSectorAddress(uint32_t sector_location); 
+
+// write one sector where the sector address points, which then moves up by one 
+// source is copied, so it can be reused right away 
+void SDCard_WriteSector(uint8_t source[]); 
+
+// write one sector to a given address (same shape as LCD_WriteSectorAt) 
+void SDCard_WriteSectorAt(uint32_t sector, uint8_t *source); 
+
+// read from the sector address, which then moves up by one 
+void SDCard_ReadSector(uint8_t (*to_populate)[512]); 
+
+// read one sector from a given address (same shape as SDCard_WriteSectorAt) 
+// returns 1 if the card sent it, 0 if not 
+uint32_t SDCard_ReadSectorAt(uint32_t sector, uint8_t *destination); 
+
+// close the multi-block write once the last block is programmed (like LCD_FlushMedia) 
+void SDCard_Flush(void); 
@@ -0,0 +1,117 @@
+#include <string.h>
+#include "SectorBuffer.h"
+
+uint32_t SectorBuffer_Length = 0; 
+
+static uint8_t Sector[SECTOR_SIZE]; // partial sector waiting for more data 
+static uint32_t Fill;               // bytes in Sector 
+static uint32_t FirstSector; 
+static uint32_t NextSector;         // where the next whole data sector goes 
+static void (*WriteSector)(uint32_t sector, uint8_t *data); 
+static uint32_t Sequence; 
+static uint32_t Timestamp; 
+static uint32_t Log, Format, Width, Height; 
+static uint32_t Crc;                // CRC32 of the image bytes so far 
+
+// CRC32 (reflected, polynomial 0xEDB88320) a nibble at a time: a 64 byte table instead of 1 KB 
+static const uint32_t CrcTable[16] = { 
+	0x00000000, 0x1DB71064, 0x3B6E20C8, 0x26D930AC, 0x76DC4190, 0x6B6B51F4, 0x4DB26158, 0x5005713C, 
+	0xEDB88320, 0xF00F9344, 0xD6D6A3E8, 0xCB61B38C, 0x9B64C2B0, 0x86D3D2D4, 0xA00AE278, 0xBDBDF21C 
+}; 
+
+uint32_t SectorBuffer_Crc32(uint32_t crc, const uint8_t *data, uint32_t length) { 
+	crc = ~crc; 
+	while (length-- > 0) { 
+		crc ^= *data++; 
+		crc = (crc >> 4) ^ CrcTable[crc & 0x0F]; 
+		crc = (crc >> 4) ^ CrcTable[crc & 0x0F]; 
+	}
+	return ~crc; 
+}
+
+uint32_t SectorBuffer_Get32(const uint8_t *source) { 
+	return source[0] | (source[1] << 8) | (source[2] << 16) | ((uint32_t)source[3] << 24); 
+}
+
+uint32_t SectorBuffer_IsHeader(const uint8_t *sector) { 
+	if (SectorBuffer_Get32(&sector[SECTOR_HEADER_MAGIC_OFFSET]) != SECTOR_HEADER_MAGIC) return 0; 
+	return SectorBuffer_Get32(&sector[SECTOR_HEADER_CHECK_OFFSET]) == SectorBuffer_Crc32(0, sector, SECTOR_HEADER_CHECK_OFFSET); 
+}
+
+static void SectorBuffer_Put32(uint8_t *destination, uint32_t value) { 
+	destination[0] = value & 0xFF; 
+	destination[1] = (value >> 8) & 0xFF; 
+	destination[2] = (value >> 16) & 0xFF; 
+	destination[3] = (value >> 24) & 0xFF; 
+}
+
+void SectorBuffer_Open(uint32_t first_sector, void (*write)(uint32_t sector, uint8_t *data)) { 
+	WriteSector = write; 
+	FirstSector = first_sector; 
+	NextSector = first_sector + 1; 
+	Fill = 0; 
+	SectorBuffer_Length = 0; 
+	Sequence = Timestamp = 0; 
+	Log = Format = Width = Height = 0; 
+	Crc = 0; 
+}
+
+void SectorBuffer_Tag(uint32_t sequence, uint32_t timestamp) { 
+	Sequence = sequence; 
+	Timestamp = timestamp; 
+}
+
+void SectorBuffer_Describe(uint32_t log, uint32_t format, uint32_t width, uint32_t height) { 
+	Log = log; 
+	Format = format; 
+	Width = width; 
+	Height = height; 
+}
+
+void SectorBuffer_Write(uint8_t *data, uint32_t length) { 
+	SectorBuffer_Length += length; 
+	Crc = SectorBuffer_Crc32(Crc, data, length); 
+	// top up a partial sector first 
+	if (Fill > 0) { 
+		uint32_t n = SECTOR_SIZE - Fill; 
+		if (n > length) n = length; 
+		memcpy(&Sector[Fill], data, n); 
+		Fill += n; 
+		data += n; 
+		length -= n; 
+		if (Fill < SECTOR_SIZE) return; 
+		(*WriteSector)(NextSector++, Sector); 
+		Fill = 0; 
+	}
+	// whole sectors go out straight from the caller's buffer 
+	while (length >= SECTOR_SIZE) { 
+		(*WriteSector)(NextSector++, data); 
+		data += SECTOR_SIZE; 
+		length -= SECTOR_SIZE; 
+	}
+	if (length > 0) { 
+		memcpy(Sector, data, length); 
+		Fill = length; 
+	}
+}
+
+uint32_t SectorBuffer_Close() { 
+	if (Fill > 0) { 
+		memset(&Sector[Fill], 0, SECTOR_SIZE - Fill); // only the tail, once per image 
+		(*WriteSector)(NextSector++, Sector); 
+		Fill = 0; 
+	}
+	memset(Sector, 0, SECTOR_SIZE); 
+	SectorBuffer_Put32(&Sector[SECTOR_HEADER_MAGIC_OFFSET], SECTOR_HEADER_MAGIC); 
+	SectorBuffer_Put32(&Sector[SECTOR_HEADER_LENGTH_OFFSET], SectorBuffer_Length); 
+	SectorBuffer_Put32(&Sector[SECTOR_HEADER_SECTORS_OFFSET], NextSector - FirstSector - 1); 
+	SectorBuffer_Put32(&Sector[SECTOR_HEADER_SEQUENCE_OFFSET], Sequence); 
+	SectorBuffer_Put32(&Sector[SECTOR_HEADER_TIMESTAMP_OFFSET], Timestamp); 
+	SectorBuffer_Put32(&Sector[SECTOR_HEADER_FORMAT_OFFSET], Format); 
+	SectorBuffer_Put32(&Sector[SECTOR_HEADER_WIDTH_OFFSET], (Height << 16) | (Width & 0xFFFF)); // both halves in one word 
+	SectorBuffer_Put32(&Sector[SECTOR_HEADER_CRC_OFFSET], Crc); 
+	SectorBuffer_Put32(&Sector[SECTOR_HEADER_LOG_OFFSET], Log); 
+	SectorBuffer_Put32(&Sector[SECTOR_HEADER_CHECK_OFFSET], SectorBuffer_Crc32(0, Sector, SECTOR_HEADER_CHECK_OFFSET)); 
+	(*WriteSector)(FirstSector, Sector); 
+	return NextSector - FirstSector; 
+}
@@ -0,0 +1,61 @@
+#include <stdint.h>
+
+// packs camera payloads (506 byte JPEG packages, short last RAW package, ...) into whole 
+// 512 byte sectors for the storage backend, so every sector write is a full one 
+// layout on the card, starting at first_sector: 
+//   first_sector      header: magic, exact image length in bytes, number of data sectors, 
+//                     sequence number and timestamp (see SectorBuffer_Tag), format, resolution 
+//                     and log id (see SectorBuffer_Describe), CRC32 of the image bytes, and a 
+//                     CRC32 of the header itself 
+//   first_sector + 1  image data, packed back to back 
+// the header is written last by SectorBuffer_Close 
+
+#define SECTOR_SIZE 512 
+#define SECTOR_HEADER_MAGIC 0x324D4143 // "CAM2" when read as bytes 
+
+// header fields, byte offsets inside the header sector (all little endian) 
+#define SECTOR_HEADER_MAGIC_OFFSET   0 
+#define SECTOR_HEADER_LENGTH_OFFSET  4 
+#define SECTOR_HEADER_SECTORS_OFFSET 8 
+#define SECTOR_HEADER_SEQUENCE_OFFSET  12 
+#define SECTOR_HEADER_TIMESTAMP_OFFSET 16 
+#define SECTOR_HEADER_FORMAT_OFFSET  20 // CAMERA_RAW, CAMERA_JPEG 
+#define SECTOR_HEADER_WIDTH_OFFSET   24 // 16 bits 
+#define SECTOR_HEADER_HEIGHT_OFFSET  26 // 16 bits 
+#define SECTOR_HEADER_CRC_OFFSET     28 // CRC32 of the SectorBuffer_Length image bytes 
+#define SECTOR_HEADER_LOG_OFFSET     32 // which log the image belongs to (ImageLog.h), 0 outside of one 
+#define SECTOR_HEADER_CHECK_OFFSET   36 // CRC32 of header bytes 0 to 35 
+#define SECTOR_HEADER_SIZE           40 
+
+// exact number of image bytes written since SectorBuffer_Open 
+extern uint32_t SectorBuffer_Length; 
+
+// start a new image 
+// first_sector: where the header goes, data follows right after it 
+// write: storage backend, writes one whole sector (LCD_WriteSectorAt, etc.) 
+void SectorBuffer_Open(uint32_t first_sector, void (*write)(uint32_t sector, uint8_t *data)); 
+
+// add image bytes. whole sectors go straight to the backend, without a copy when the data 
+// happens to start on a sector boundary. same shape as the Camera_StartCapture store callback 
+void SectorBuffer_Write(uint8_t *data, uint32_t length); 
+
+// set the sequence number and timestamp (ms) that SectorBuffer_Close puts in the header 
+// both are 0 unless this is called after SectorBuffer_Open 
+void SectorBuffer_Tag(uint32_t sequence, uint32_t timestamp); 
+
+// set what the image is, for whoever reads it back off the card (all 0 unless called after SectorBuffer_Open) 
+// log: id of the log the image is part of, format: CAMERA_RAW or CAMERA_JPEG, width/height in pixels 
+void SectorBuffer_Describe(uint32_t log, uint32_t format, uint32_t width, uint32_t height); 
+
+// pad out the last partial sector, then write the header 
+// returns the number of sectors used, header included 
+uint32_t SectorBuffer_Close(void); 
+
+// standard CRC32 (zip, png), carried on from crc: start with 0, feed it the data a piece at a time 
+uint32_t SectorBuffer_Crc32(uint32_t crc, const uint8_t *data, uint32_t length); 
+
+// read a little endian word out of a header 
+uint32_t SectorBuffer_Get32(const uint8_t *source); 
+
+// 1 if sector holds a header whose check CRC matches, 0 if not 
+uint32_t SectorBuffer_IsHeader(const uint8_t *sector); 
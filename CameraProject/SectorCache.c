@@ -0,0 +1,116 @@
+#include <string.h>
+#include "SectorCache.h"
+
+#define SECTOR_SIZE 512 
+
+uint32_t SectorCache_Hits = 0; 
+uint32_t SectorCache_Misses = 0; 
+uint32_t SectorCache_Flushes = 0; 
+uint32_t SectorCache_WriteBacks = 0; 
+
+typedef struct { 
+	uint32_t sector; 
+	uint32_t used;   // Clock when last read or written, 0 if the entry is empty 
+	uint8_t dirty;   // 1 if ram is newer than the card 
+	uint8_t keep;    // SectorCache_Keep 
+} SectorCache_Entry; 
+
+static SectorCache_Entry Entries[SECTOR_CACHE_ENTRIES]; 
+static uint8_t Data[SECTOR_CACHE_ENTRIES][SECTOR_SIZE]; 
+static uint32_t Clock; 
+static void (*WriteSector)(uint32_t sector, uint8_t *data); 
+static uint32_t (*ReadSector)(uint32_t sector, uint8_t *data); 
+static void (*Flush)(void); 
+
+// write back every dirty sector, lowest first 
+static void SectorCache_WriteBack(void) { 
+	uint32_t counted = 0; 
+	for (;;) { 
+		int lowest = -1; 
+		for (int i = 0; i < SECTOR_CACHE_ENTRIES; ++i) { 
+			if (Entries[i].dirty && (lowest < 0 || Entries[i].sector < Entries[lowest].sector)) lowest = i; 
+		} 
+		if (lowest < 0) return; 
+		if (!counted) { 
+			++SectorCache_Flushes; 
+			counted = 1; 
+		} 
+		(*WriteSector)(Entries[lowest].sector, Data[lowest]); 
+		Entries[lowest].dirty = 0; 
+		++SectorCache_WriteBacks; 
+	} 
+} 
+
+void SectorCache_Sync() { 
+	if (WriteSector == 0) return; 
+	SectorCache_WriteBack(); 
+	(*Flush)(); 
+} 
+
+void SectorCache_Init(void (*write)(uint32_t sector, uint8_t *data), uint32_t (*read)(uint32_t sector, uint8_t *data), 
+	void (*flush)(void)) { 
+	SectorCache_Sync(); 
+	WriteSector = write; 
+	ReadSector = read; 
+	Flush = flush; 
+	memset(Entries, 0, sizeof(Entries)); 
+	Clock = 0; 
+} 
+
+static int SectorCache_Find(uint32_t sector) { 
+	for (int i = 0; i < SECTOR_CACHE_ENTRIES; ++i) { 
+		if (Entries[i].used != 0 && Entries[i].sector == sector) return i; 
+	} 
+	return -1; 
+} 
+
+// an entry for a sector that isn't in: an empty one, else the least recently used one that isn't kept 
+// (or of all of them, if they all are). if it is dirty, it goes back with all the others 
+static int SectorCache_Take(uint32_t sector) { 
+	int victim = -1; 
+	for (int i = 0; i < SECTOR_CACHE_ENTRIES; ++i) { 
+		if (Entries[i].used == 0) { 
+			victim = i; 
+			break; 
+		} 
+		if (victim < 0 || Entries[i].keep < Entries[victim].keep 
+			|| (Entries[i].keep == Entries[victim].keep && Entries[i].used < Entries[victim].used)) victim = i; 
+	} 
+	if (Entries[victim].dirty) SectorCache_WriteBack(); 
+	Entries[victim].sector = sector; 
+	Entries[victim].keep = 0; 
+	return victim; 
+} 
+
+void SectorCache_WriteSectorAt(uint32_t sector, uint8_t *data) { 
+	int i = SectorCache_Find(sector); 
+	if (i >= 0) ++SectorCache_Hits; 
+	else { 
+		++SectorCache_Misses; 
+		i = SectorCache_Take(sector); // whole sector, nothing to read first 
+	} 
+	memcpy(Data[i], data, SECTOR_SIZE); 
+	Entries[i].dirty = 1; 
+	Entries[i].used = ++Clock; 
+} 
+
+uint32_t SectorCache_ReadSectorAt(uint32_t sector, uint8_t *data) { 
+	int i = SectorCache_Find(sector); 
+	if (i >= 0) ++SectorCache_Hits; 
+	else { 
+		++SectorCache_Misses; 
+		i = SectorCache_Take(sector); 
+		if (!(*ReadSector)(sector, Data[i])) { 
+			Entries[i].used = 0; 
+			return 0; 
+		} 
+	} 
+	memcpy(data, Data[i], SECTOR_SIZE); 
+	Entries[i].used = ++Clock; 
+	return 1; 
+} 
+
+void SectorCache_Keep(uint32_t sector) { 
+	int i = SectorCache_Find(sector); 
+	if (i >= 0) Entries[i].keep = 1; 
+} 
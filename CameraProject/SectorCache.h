@@ -0,0 +1,40 @@
+#include <stdint.h>
+
+// small write-back sector cache in front of a storage backend (the display's card or the SPI SD card). 
+// reads of a cached sector and writes of any sector stay in ram. dirty sectors go out to the 
+// backend only when 
+//   - SectorCache_Sync is called (end of a picture, closing a file, before going into low power), or 
+//   - a new sector needs a slot and the least recently used one is dirty. 
+// either way every dirty sector goes, lowest first, so sectors that are next to each other reach 
+// the backend back to back. the SD card then writes them in one multi-block write (CMD25), and the 
+// display skips the set sector address between them. 
+// sectors marked with SectorCache_Keep (FAT, directory, log sectors...) stay in over ordinary data 
+// that has been used more recently, so streaming a picture through doesn't push them out 
+
+#define SECTOR_CACHE_ENTRIES 8 // 4 KB of ram 
+
+// reads and writes answered from ram, and those that had to go to the backend 
+extern uint32_t SectorCache_Hits; 
+extern uint32_t SectorCache_Misses; 
+// times dirty sectors were written back, and how many sectors that was in all 
+extern uint32_t SectorCache_Flushes; 
+extern uint32_t SectorCache_WriteBacks; 
+
+// put the cache in front of a backend (anything cached for the last one is synced first) 
+// write/read: one whole sector (SDCard_WriteSectorAt/SDCard_ReadSectorAt, LCD_WriteSectorAt/LCD_ReadSectorAt) 
+// flush: make the backend finish what it has been given (SDCard_Flush, LCD_FlushMedia) 
+void SectorCache_Init(void (*write)(uint32_t sector, uint8_t *data), uint32_t (*read)(uint32_t sector, uint8_t *data), 
+	void (*flush)(void)); 
+
+// same shapes as the backend's own calls, so the cache can go anywhere a backend does (SectorBuffer, ImageLog) 
+// the write copies the sector, so data can be reused right away 
+// the read returns 1 if it got the sector, 0 if the backend couldn't read it 
+void SectorCache_WriteSectorAt(uint32_t sector, uint8_t *data); 
+uint32_t SectorCache_ReadSectorAt(uint32_t sector, uint8_t *data); 
+
+// keep a cached sector in over ordinary data, until it is dropped with SectorCache_Init 
+// (call after reading or writing it) 
+void SectorCache_Keep(uint32_t sector); 
+
+// write every dirty sector back and flush the backend 
+void SectorCache_Sync(void); 
@@ -0,0 +1,150 @@
+#include <string.h>
+#include "Thumbnail.h"
+
+#define SECTOR_SIZE 512 
+#define HEADER_SIZE 6 
+#define COLOUR_16BIT 0x10 
+
+// gallery cells, in pixels. thumbnails sit in the top left of each 
+#define CELL_WIDTH  60 
+#define CELL_HEIGHT 50 
+#define GALLERY_X 0 
+#define GALLERY_Y 20 
+
+static uint8_t Thumb[THUMB_SECTORS*SECTOR_SIZE]; // header, then the pixels as they are finished 
+static uint8_t Stamp[SECTOR_SIZE];              // a slot's last sector, read back by the gallery 
+static uint16_t SumRed[THUMB_WIDTH];   // box sums for the row of thumbnail pixels in progress 
+static uint16_t SumGreen[THUMB_WIDTH]; 
+static uint16_t SumBlue[THUMB_WIDTH]; 
+
+static uint32_t Width;        // picture width 
+static uint32_t Factor;       // picture pixels per thumbnail pixel, each way 
+static uint32_t ThumbWidth, ThumbHeight; 
+static uint32_t X;            // picture column of the next pixel 
+static uint32_t Column;       // thumbnail column it adds to 
+static uint32_t ColumnCount;  // picture columns into that thumbnail column 
+static uint32_t RowCount;     // picture rows into the current thumbnail row 
+static uint32_t Row;          // thumbnail rows finished 
+static int32_t Held;          // first byte of a pixel split across two packages, -1 if none 
+
+void Thumbnail_Open(uint32_t width, uint32_t height) { 
+	// smallest whole factor that fits the box both ways 
+	Factor = (width + THUMB_WIDTH - 1)/THUMB_WIDTH; 
+	uint32_t factor = (height + THUMB_HEIGHT - 1)/THUMB_HEIGHT; 
+	if (factor > Factor) Factor = factor; 
+	if (Factor == 0) Factor = 1; 
+	if (Factor > 8) Factor = 8; // keeps the sums inside 16 bits (64 pixels of 63) 
+	Width = width; 
+	ThumbWidth = width/Factor; 
+	ThumbHeight = height/Factor; 
+	if (ThumbWidth > THUMB_WIDTH) ThumbWidth = THUMB_WIDTH; 
+	if (ThumbHeight > THUMB_HEIGHT) ThumbHeight = THUMB_HEIGHT; 
+	
+	// display image header: width, height, colour mode 
+	memset(Thumb, 0, sizeof(Thumb)); 
+	Thumb[0] = (ThumbWidth >> 8) & 0xFF; 
+	Thumb[1] = ThumbWidth & 0xFF; 
+	Thumb[2] = (ThumbHeight >> 8) & 0xFF; 
+	Thumb[3] = ThumbHeight & 0xFF; 
+	Thumb[4] = COLOUR_16BIT; 
+	Thumb[5] = 0; 
+	memset(SumRed, 0, sizeof(SumRed)); 
+	memset(SumGreen, 0, sizeof(SumGreen)); 
+	memset(SumBlue, 0, sizeof(SumBlue)); 
+	X = Column = ColumnCount = RowCount = Row = 0; 
+	Held = -1; 
+}
+
+// a row of thumbnail pixels is done: average the boxes into RGB565 
+static void Thumbnail_Row(void) { 
+	uint32_t area = Factor*Factor; 
+	uint8_t *out = &Thumb[HEADER_SIZE + Row*ThumbWidth*2]; 
+	for (uint32_t i = 0; i < ThumbWidth; ++i) { 
+		uint32_t pixel = ((SumRed[i]/area) << 11) | ((SumGreen[i]/area) << 5) | (SumBlue[i]/area); 
+		*out++ = (pixel >> 8) & 0xFF; 
+		*out++ = pixel & 0xFF; 
+	}
+	memset(SumRed, 0, sizeof(SumRed)); 
+	memset(SumGreen, 0, sizeof(SumGreen)); 
+	memset(SumBlue, 0, sizeof(SumBlue)); 
+	++Row; 
+}
+
+static void Thumbnail_Pixel(uint32_t pixel) { 
+	if (Column < ThumbWidth) { 
+		SumRed[Column] += (pixel >> 11) & 0x1F; 
+		SumGreen[Column] += (pixel >> 5) & 0x3F; 
+		SumBlue[Column] += pixel & 0x1F; 
+	}
+	if (++ColumnCount == Factor) { 
+		ColumnCount = 0; 
+		++Column; 
+	}
+	if (++X < Width) return; 
+	// end of a picture row 
+	X = Column = ColumnCount = 0; 
+	if (++RowCount < Factor) return; 
+	RowCount = 0; 
+	if (Row < ThumbHeight) Thumbnail_Row(); 
+}
+
+void Thumbnail_Write(uint8_t *data, uint32_t length) { 
+	if (Row >= ThumbHeight || length == 0) return; // got all it needs, the rest is cropped 
+	if (Held >= 0) { 
+		Thumbnail_Pixel((Held << 8) | data[0]); 
+		Held = -1; 
+		++data; 
+		--length; 
+	}
+	while (length >= 2) { 
+		Thumbnail_Pixel((data[0] << 8) | data[1]); 
+		data += 2; 
+		length -= 2; 
+	}
+	if (length) Held = data[0]; 
+}
+
+uint32_t Thumbnail_Close(uint32_t slot, void (*write)(uint32_t sector, uint8_t *data)) { 
+	if (Row < ThumbHeight || slot >= THUMB_SLOTS) return 0; 
+	uint32_t sector = THUMB_FIRST_SECTOR + slot*THUMB_SECTORS; 
+	uint8_t *stamp = &Thumb[(THUMB_SECTORS - 1)*SECTOR_SIZE + THUMB_STAMP_OFFSET]; 
+	for (uint32_t i = 0; i < 4; ++i) { 
+		stamp[i] = (THUMB_MAGIC >> (8*i)) & 0xFF; 
+		stamp[4 + i] = (slot >> (8*i)) & 0xFF; 
+	}
+	for (uint32_t i = 0; i < THUMB_SECTORS; ++i) { 
+		(*write)(sector + i, &Thumb[i*SECTOR_SIZE]); 
+	}
+	return 1; 
+}
+
+// 1 if the slot's last sector carries its stamp 
+static uint32_t Thumbnail_Stamped(uint32_t slot, uint32_t (*read)(uint32_t sector, uint8_t *data)) { 
+	if (!(*read)(THUMB_FIRST_SECTOR + slot*THUMB_SECTORS + THUMB_SECTORS - 1, Stamp)) return 0; 
+	uint32_t magic = 0, number = 0; 
+	for (uint32_t i = 0; i < 4; ++i) { 
+		magic |= (uint32_t)Stamp[THUMB_STAMP_OFFSET + i] << (8*i); 
+		number |= (uint32_t)Stamp[THUMB_STAMP_OFFSET + 4 + i] << (8*i); 
+	}
+	return magic == THUMB_MAGIC && number == slot; 
+}
+
+uint32_t Thumbnail_Gallery(uint32_t page, uint32_t count, uint32_t (*read)(uint32_t sector, uint8_t *data), 
+	void (*draw)(uint32_t sector, uint16_t x, uint16_t y)) { 
+	uint32_t first = page*THUMB_PER_PAGE; 
+	uint32_t cells = 0; 
+	uint32_t stamped = 0; // bit per cell 
+	for (; cells < THUMB_PER_PAGE && first + cells < count && first + cells < THUMB_SLOTS; ++cells) { 
+		if (Thumbnail_Stamped(first + cells, read)) stamped |= 1u << cells; 
+	}
+	// every read is answered before the first draw goes out 
+	uint32_t drawn = 0; 
+	for (uint32_t cell = 0; cell < cells; ++cell) { 
+		if ((stamped & (1u << cell)) == 0) continue; 
+		uint16_t x = GALLERY_X + (cell % THUMB_COLUMNS)*CELL_WIDTH; 
+		uint16_t y = GALLERY_Y + (cell / THUMB_COLUMNS)*CELL_HEIGHT; 
+		(*draw)(THUMB_FIRST_SECTOR + (first + cell)*THUMB_SECTORS, x, y); 
+		++drawn; 
+	}
+	return drawn; 
+}
@@ -0,0 +1,47 @@
+#include <stdint.h>
+
+// thumbnails made while a RAW (RGB565) picture streams through, and a gallery that puts a page 
+// of them on the screen. each thumbnail is a box filtered copy of the picture that fits in 
+// THUMB_WIDTH x THUMB_HEIGHT, stored in its own slot of THUMB_SECTORS sectors in the raw area of the card: 
+//   THUMB_FIRST_SECTOR + slot*THUMB_SECTORS   6 byte display image header (width, height, 16 bit colour), 
+//                                             then the pixels, high byte first 
+//   last 8 bytes of the slot's last sector    THUMB_MAGIC, then the slot number (little endian), 
+//                                             so the gallery can tell a slot that has its thumbnail 
+// so the display can draw one straight off its own card (display image), and a gallery page 
+// costs a couple of short commands per thumbnail no matter how big the pictures are. 
+// JPEG pictures don't get thumbnails (no decoder on the tm4c) 
+
+#define THUMB_WIDTH  40 
+#define THUMB_HEIGHT 30 
+#define THUMB_SECTORS 5          // header + 40*30*2 pixel bytes, rounded up to whole sectors 
+#define THUMB_FIRST_SECTOR 0x10000 // 32 MB in, clear of the photos at sector 0 
+#define THUMB_SLOTS 10000        // one per IMG_nnnn number 
+#define THUMB_MAGIC 0x424D4854   // "THMB" when read as bytes 
+#define THUMB_STAMP_OFFSET (512 - 8) // of the last sector: magic, slot number 
+
+// gallery grid: 4 x 4 = 16 thumbnails a page 
+#define THUMB_COLUMNS 4 
+#define THUMB_ROWS    4 
+#define THUMB_PER_PAGE (THUMB_COLUMNS*THUMB_ROWS) 
+
+// start a thumbnail for a width x height RAW picture 
+void Thumbnail_Open(uint32_t width, uint32_t height); 
+
+// add picture bytes (RGB565, high byte first). same shape as the Camera_StartCapture store callback, 
+// so it can sit next to the real store (see Store_Photo in main.c) 
+void Thumbnail_Write(uint8_t *data, uint32_t length); 
+
+// write the thumbnail to its slot, every sector of it, the one with the stamp last 
+// write: storage backend, writes one whole sector (LCD_WriteSectorAt, etc.) 
+// returns 1 if the thumbnail was complete, 0 if the picture came up short (nothing is written) 
+uint32_t Thumbnail_Close(uint32_t slot, void (*write)(uint32_t sector, uint8_t *data)); 
+
+// draw one page of the gallery: slots page*THUMB_PER_PAGE on, up to count slots in all. 
+// each slot's stamp is read first, and a slot without its own (a JPEG, a failed capture, a number 
+// used on another card, a fresh card) is left as an empty cell instead of drawing whatever is there 
+// read: storage backend, reads one whole sector (LCD_ReadSectorAt, etc.), returns 1 if it got it 
+// draw: puts the image at a sector on the screen at x, y (LCD_QueueImage). the page's thumbnails get 
+// queued back to back after the reads, so the next page can be asked for as soon as this returns 
+// returns the number of thumbnails drawn 
+uint32_t Thumbnail_Gallery(uint32_t page, uint32_t count, uint32_t (*read)(uint32_t sector, uint8_t *data), 
+	void (*draw)(uint32_t sector, uint16_t x, uint16_t y)); 
@@ -0,0 +1,33 @@
+#include "TimeBase.h"
+#include "inc/tm4c123gh6pm.h"
+#include "inc/CortexM.h"
+#include "inc/SysTickInts.h"
+#include "inc/eDisk.h"
+
+#define TICKS_PER_MS 80000 // 80 MHz bus clock 
+
+static volatile uint32_t Milliseconds = 0; 
+
+void TimeBase_Init() { 
+	Milliseconds = 0; 
+	SysTick_Init(TICKS_PER_MS); 
+}
+
+uint32_t TimeBase_Ms() { 
+	return Milliseconds; 
+}
+
+uint32_t TimeBase_Us() { 
+	uint32_t ms, ticks; 
+	// re-read if the tick rolled over while we were looking 
+	do { 
+		ms = Milliseconds; 
+		ticks = NVIC_ST_CURRENT_R; 
+	} while (ms != Milliseconds); 
+	return ms*1000 + (TICKS_PER_MS - 1 - ticks)/(TICKS_PER_MS/1000); 
+}
+
+void SysTick_Handler() { 
+	++Milliseconds; 
+	disk_timerproc(); // eDisk's timeouts count down in ms 
+}
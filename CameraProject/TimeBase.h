@@ -0,0 +1,12 @@
+#include <stdint.h>
+
+// free running millisecond clock for timeouts and latency measurements 
+// uses SysTick interrupts every 1 ms (assuming 80 MHz bus clock) 
+void TimeBase_Init(void); 
+
+// milliseconds since TimeBase_Init 
+uint32_t TimeBase_Ms(void); 
+
+// microseconds since TimeBase_Init, for measuring things shorter than a millisecond 
+// wraps after about 71 minutes 
+uint32_t TimeBase_Us(void); 
@@ -1,8 +1,8 @@
 #include <stdio.h>
 #include "UART.h" 
+#include "TimeBase.h"
 
 // these arrays are, i hope, stored in RAM 
-uint8_t array[6];
 uint8_t image_array[512]; 
 // char image_array_two[512]; 
 
@@ -12,6 +12,39 @@ uint8_t image_array[512];
 #define UART_LCRH_FEN           0x00000010  // UART Enable FIFOs
 #define UART_CTL_UARTEN         0x00000001  // UART Enable
 
+#define UART_FR_BUSY            0x00000008  // UART Busy
+#define UART_IM_RXIM            0x00000010  // UART Receive Interrupt Mask
+#define UART_IM_RTIM            0x00000040  // UART Receive Time-Out Interrupt Mask
+
+#define BIT18                   0x00040000  // uDMA channel 18 (UART4 RX)
+
+#define CMD_SYNC 0x0D 
+#define CMD_ACK  0x0E 
+#define CMD_NAK  0x0F 
+
+// camera link rates to try after sync, slowest first. the camera divides 14.7456 MHz, 
+// so every one of these is exact on its side 
+#define CAMERA_CLOCK 14745600 
+static const uint32_t BaudRates[] = {115200, 230400, 460800, 921600}; 
+#define NUM_BAUD_RATES (sizeof(BaudRates)/sizeof(BaudRates[0])) 
+#define BAUD_REPLY_TIMEOUT_MS 50 
+#define BAUD_CHECKS 3 // SYNC round trips a new rate has to survive 
+
+uint32_t UART_Baud = 115200; 
+
+uint32_t UART_SyncMs = 0; 
+uint32_t UART_SyncAttempts = 0; 
+uint32_t UART_SyncResets = 0; 
+
+uint32_t UART_Recoveries[UART_RECOVER_LEVELS]; 
+uint32_t UART_RecoveryMs[UART_RECOVER_LEVELS]; 
+
+// camera replies collected by UART4_Handler, size is a power of 2 
+#define REPLY_FIFO_SIZE 64 
+static volatile uint8_t ReplyFifo[REPLY_FIFO_SIZE]; 
+static volatile uint32_t ReplyPut = 0; 
+static volatile uint32_t ReplyGet = 0; 
+
 // TODO: find a port for hardware reset
 #define PF1                     (*((volatile uint32_t *)0x40025008))
 
@@ -20,8 +53,10 @@ void UART_Init() {
 	SYSCTL_RCGCUART_R |= 0x10; // activate UART4 
 	SYSCTL_RCGCGPIO_R |=  0x04; 		 // activate port C 
 	UART4_CTL_R &= ~UART_CTL_UARTEN; // disable UART 
-	UART4_IBRD_R = 43; 
-	UART4_FBRD_R = 26; // baud rate calculation stuffs 
+	uint32_t divisor64 = (UART_BusClock()*4 + 115200/2)/115200; // camera always wakes up at 115200 
+	UART4_IBRD_R = divisor64 >> 6;   // 43 at 80 MHz 
+	UART4_FBRD_R = divisor64 & 0x3F; // 26 at 80 MHz, baud rate calculation stuffs 
+	UART_Baud = 115200; 
 	UART4_LCRH_R = (UART_LCRH_WLEN_8|UART_LCRH_FEN); // specifications of the UART 
 	UART4_DMACTL_R |= 0x01; // enables to receive dma (i wonder if this should only be on when reading from image??) -> probs not necessary 
 	UART4_CTL_R |= UART_CTL_UARTEN;       // re-enable UART
@@ -34,26 +69,225 @@ void UART_Init() {
 	PF1 = 0x02; 
 }
 
+uint32_t UART_BusClock() { 
+	uint32_t rcc2 = SYSCTL_RCC2_R; 
+	// PLL_Init: RCC2 in use, 400 MHz PLL, not bypassed, divider in bits 28:22 
+	if ((rcc2&0x80000000) && (rcc2&0x40000000) && (rcc2&0x00000800) == 0) { 
+		return 400000000/(((rcc2>>22)&0x7F)+1); 
+	}
+	return 16000000; // precision internal oscillator, what we come out of reset on 
+}
+
+void UART_SetBaudRate(uint32_t baud) { 
+	// divisor = bus/(16*baud), IBRD is the integer part and FBRD the fraction in 64ths (rounded) 
+	uint32_t divisor64 = (UART_BusClock()*4 + baud/2)/baud; // = 64*bus/(16*baud) 
+	while ((UART4_FR_R & UART_FR_BUSY) != 0); // let the last command finish going out 
+	UART4_CTL_R &= ~UART_CTL_UARTEN; 
+	UART4_IBRD_R = divisor64 >> 6; 
+	UART4_FBRD_R = divisor64 & 0x3F; 
+	UART4_LCRH_R = (UART_LCRH_WLEN_8|UART_LCRH_FEN); // divisors only latch on an LCRH write 
+	UART4_CTL_R |= UART_CTL_UARTEN; 
+	UART_Baud = baud; 
+}
+
+// the camera's ACK of our SYNC, and the camera's own SYNC 
+static uint32_t UART_IsSyncAck(UART_Reply *reply) { 
+	return (reply->id == CMD_ACK && reply->parameter[0] == CMD_SYNC && reply->parameter[2] == 0x00 && reply->parameter[3] == 0x00); 
+}
+static uint32_t UART_IsSync(UART_Reply *reply) { 
+	return (reply->id == CMD_SYNC && reply->parameter[0] == 0x00 && reply->parameter[1] == 0x00 && 
+		reply->parameter[2] == 0x00 && reply->parameter[3] == 0x00); 
+}
+
+uint32_t UART_CheckLink() { 
+	UART_Reply reply; 
+	UART_RxFlush(); 
+	UART_OutSync(); 
+	if (UART_InData(&reply, BAUD_REPLY_TIMEOUT_MS) != UART_OK || !UART_IsSyncAck(&reply)) return 0; 
+	if (UART_InData(&reply, BAUD_REPLY_TIMEOUT_MS) != UART_OK || !UART_IsSync(&reply)) return 0; 
+	UART_OutACK(); 
+	return 1; 
+}
+
+uint32_t UART_Sync(uint32_t timeout_ms) { 
+	UART_Reply reply; 
+	uint32_t start = TimeBase_Ms(); 
+	UART_SyncAttempts = 0; 
+	UART_SyncResets = 0; 
+	if (UART_Baud != BaudRates[0]) UART_SetBaudRate(BaudRates[0]); // camera comes out of reset at 115200 
+	while ((TimeBase_Ms() - start) < timeout_ms) { 
+		Camera_HardwareReset(); 
+		++UART_SyncResets; 
+		for (uint32_t attempt = 0; attempt < UART_SYNC_TRIES && (TimeBase_Ms() - start) < timeout_ms; ++attempt) { 
+			UART_RxFlush(); 
+			UART_OutSync(); 
+			++UART_SyncAttempts; 
+			if (UART_InData(&reply, UART_SYNC_DELAY_MS(attempt)) != UART_OK || !UART_IsSyncAck(&reply)) continue; 
+			// the camera's own SYNC follows its ACK straight away 
+			if (UART_InData(&reply, BAUD_REPLY_TIMEOUT_MS) != UART_OK || !UART_IsSync(&reply)) continue; 
+			UART_OutACK(); 
+			UART_SyncMs = TimeBase_Ms() - start; 
+			return 1; 
+		}
+	}
+	UART_SyncMs = TimeBase_Ms() - start; 
+	return 0; 
+}
+
+// SET BAUD RATE, sent and ACKed at the current rate. camera switches right after its ACK 
+// camera rate = 14.7456 MHz / (2*(first+1)) / (2*(second+1)) 
+static uint32_t UART_OutBaudRate(uint32_t baud) { 
+	uint32_t divider = CAMERA_CLOCK/4/baud; // (first+1)*(second+1) 
+	uint8_t first = divider - 1, second = 0; 
+	while (first > 0x1F) { // first divider is only 5 bits 
+		second = (second+1)*2 - 1; 
+		first = (first+1)/2 - 1; 
+	}
+	UART_Reply reply; 
+	UART_RxFlush(); 
+	UART_OutCommand(0x07, first, second, 0x00, 0x00); 
+	if (UART_InData(&reply, BAUD_REPLY_TIMEOUT_MS) != UART_OK) return 0; 
+	return (reply.id == CMD_ACK && reply.parameter[0] == 0x07); 
+}
+
+uint32_t UART_NegotiateBaud() { 
+	uint32_t good = 0; // index of the fastest rate that passed so far 
+	while (BaudRates[good] != UART_Baud && good + 1 < NUM_BAUD_RATES) ++good; 
+	for (uint32_t next = good + 1; next < NUM_BAUD_RATES; ++next) { 
+		if (!UART_OutBaudRate(BaudRates[next])) break; // camera said no, it is still at the old rate 
+		UART_SetBaudRate(BaudRates[next]); 
+		uint32_t passed = 1; 
+		for (int i = 0; i < BAUD_CHECKS && passed; ++i) passed = UART_CheckLink(); 
+		if (passed) { 
+			good = next; 
+			continue; 
+		}
+		// too fast for the wiring: ask for the last good rate at the bad one and hope it gets through 
+		UART_OutBaudRate(BaudRates[good]); 
+		UART_SetBaudRate(BaudRates[good]); 
+		if (UART_CheckLink()) break; 
+		// camera is somewhere we can't talk to, start over from reset 
+		UART_SetBaudRate(BaudRates[0]); 
+		Camera_HardwareReset(); 
+		return 0; 
+	}
+	return UART_Baud; 
+}
+
+void UART_RxInterruptEnable(uint32_t priority) { 
+	UART_RxFlush(); 
+	UART4_IFLS_R = (UART4_IFLS_R&~0x38)|0x08; // interrupt at 1/4 full (4 bytes), time-out picks up the rest 
+	UART4_ICR_R = UART_IM_RXIM|UART_IM_RTIM; 
+	UART4_IM_R |= UART_IM_RXIM|UART_IM_RTIM; 
+	// UART4 is interrupt number 60: priority lives in bits 7:5 of PRI15, enable is bit 28 of EN1 
+	NVIC_PRI15_R = (NVIC_PRI15_R&0xFFFFFF00)|(priority<<5); 
+	NVIC_EN1_R = 1<<28; 
+}
+
+void UART_RxInterruptDisable() { 
+	UART4_IM_R &= ~(UART_IM_RXIM|UART_IM_RTIM); 
+}
+
+uint32_t UART_RxFlush() { 
+	uint32_t count = 0; 
+	while ((UART4_FR_R & UART_FR_RXFE) == 0) { 
+		(void)UART4_DR_R; 
+		++count; 
+	}
+	ReplyGet = ReplyPut; 
+	return count; 
+}
+
+uint32_t UART_InReply(UART_Reply *reply) { 
+	// every reply starts with 0xAA, drop junk in front of it (line noise, leftover image bytes) 
+	while (ReplyGet != ReplyPut && ReplyFifo[ReplyGet%REPLY_FIFO_SIZE] != 0xAA) { 
+		++ReplyGet; 
+	}
+	if (ReplyPut - ReplyGet < 6) return 0; 
+	reply->id = ReplyFifo[(ReplyGet+1)%REPLY_FIFO_SIZE]; 
+	for (int i = 0; i < 4; ++i) { 
+		reply->parameter[i] = ReplyFifo[(ReplyGet+2+i)%REPLY_FIFO_SIZE]; 
+	}
+	ReplyGet += 6; 
+	return 1; 
+}
+
+void UART4_Handler() { 
+	// uDMA completion for the camera receive engine shows up on this vector too 
+	if (UDMA_CHIS_R & BIT18) DMA_UART_Handler(); 
+	if (UART4_MIS_R & (UART_IM_RXIM|UART_IM_RTIM)) { 
+		UART4_ICR_R = UART_IM_RXIM|UART_IM_RTIM; 
+		while ((UART4_FR_R & UART_FR_RXFE) == 0) { 
+			if (ReplyPut - ReplyGet < REPLY_FIFO_SIZE) ReplyFifo[(ReplyPut++)%REPLY_FIFO_SIZE] = (UART4_DR_R&0xFF); 
+			else (void)UART4_DR_R; // nobody is reading replies, drop it 
+		}
+	}
+}
+
+void UART_OutCommand(uint8_t id, uint8_t p1, uint8_t p2, uint8_t p3, uint8_t p4) { 
+	while ((UART4_FR_R & UART_FR_TXFF) != 0); // busy wait 
+	UART4_DR_R = 0xAA; 
+	while ((UART4_FR_R & UART_FR_TXFF) != 0); // busy wait 
+	UART4_DR_R = id; 
+	while ((UART4_FR_R & UART_FR_TXFF) != 0); // busy wait 
+	UART4_DR_R = p1; 
+	while ((UART4_FR_R & UART_FR_TXFF) != 0); // busy wait 
+	UART4_DR_R = p2; 
+	while ((UART4_FR_R & UART_FR_TXFF) != 0); // busy wait 
+	UART4_DR_R = p3; 
+	while ((UART4_FR_R & UART_FR_TXFF) != 0); // busy wait 
+	UART4_DR_R = p4; 
+}
+
 // we want to receive an acknowledge signal most of the time 
-void UART_InData() {   
-	// 1
-	while ((UART4_FR_R & UART_FR_RXFE) != 0); 
-	array[0] = (UART4_DR_R&0xFF);
-	// 2
-	while ((UART4_FR_R & UART_FR_RXFE) != 0); 
-	array[1] = (UART4_DR_R&0xFF); 
-	// 3
-	while ((UART4_FR_R & UART_FR_RXFE) != 0); 
-	array[2] = (UART4_DR_R&0xFF);
-	// 4
-	while ((UART4_FR_R & UART_FR_RXFE) != 0); 
-	array[3] = (UART4_DR_R&0xFF);
-	// 5
-	while ((UART4_FR_R & UART_FR_RXFE) != 0); 
-	array[4] = (UART4_DR_R&0xFF); 
-	// 6
-	while ((UART4_FR_R & UART_FR_RXFE) != 0); 
-	array[5] = (UART4_DR_R&0xFF); 
+uint32_t UART_InData(UART_Reply *reply, uint32_t ms) { 
+	uint32_t start = TimeBase_Ms(); 
+	uint8_t data[6]; 
+	int i = 0; 
+	while (i < 6) { 
+		while ((UART4_FR_R & UART_FR_RXFE) != 0) { 
+			if ((TimeBase_Ms() - start) > ms) return UART_TIMEOUT; 
+		}
+		data[i] = (UART4_DR_R&0xFF); 
+		if (i > 0 || data[0] == 0xAA) ++i; // every reply starts with 0xAA, drop junk in front of it 
+	}
+	reply->id = data[1]; 
+	for (i = 0; i < 4; ++i) reply->parameter[i] = data[i+2]; 
+	return UART_OK; 
+}
+
+uint32_t UART_Command(uint8_t id, uint8_t p1, uint8_t p2, uint8_t p3, uint8_t p4, UART_Reply *reply) { 
+	UART_RxFlush(); 
+	UART_OutCommand(id, p1, p2, p3, p4); 
+	if (UART_InData(reply, UART_REPLY_TIMEOUT_MS) != UART_OK) return UART_TIMEOUT; 
+	if (reply->id == CMD_NAK) return UART_NAK; 
+	if (reply->id != CMD_ACK || reply->parameter[0] != id) return UART_BAD_REPLY; 
+	return UART_OK; 
+}
+
+uint32_t UART_CommandRecover(uint8_t id, uint8_t p1, uint8_t p2, uint8_t p3, uint8_t p4, UART_Reply *reply) { 
+	uint32_t status = UART_Command(id, p1, p2, p3, p4, reply); 
+	uint32_t start; 
+	// 1. glitched byte: just say it again 
+	for (int i = 0; i < UART_COMMAND_RETRIES && status != UART_OK; ++i) { 
+		start = TimeBase_Ms(); 
+		++UART_Recoveries[UART_RECOVER_RETRY]; 
+		status = UART_Command(id, p1, p2, p3, p4, reply); 
+		UART_RecoveryMs[UART_RECOVER_RETRY] += TimeBase_Ms() - start; 
+	}
+	if (status == UART_OK) return UART_OK; 
+	// 2. camera lost track of the byte stream but kept its settings: sync up again at this rate 
+	start = TimeBase_Ms(); 
+	++UART_Recoveries[UART_RECOVER_RESYNC]; 
+	if (UART_CheckLink() || UART_CheckLink()) status = UART_Command(id, p1, p2, p3, p4, reply); 
+	UART_RecoveryMs[UART_RECOVER_RESYNC] += TimeBase_Ms() - start; 
+	if (status == UART_OK) return UART_OK; 
+	// 3. camera is wedged: reset it. everything it was told before is gone, so the caller starts over 
+	start = TimeBase_Ms(); 
+	++UART_Recoveries[UART_RECOVER_RESET]; 
+	uint32_t synced = UART_Sync(UART_SYNC_TIMEOUT_MS); 
+	UART_RecoveryMs[UART_RECOVER_RESET] += TimeBase_Ms() - start; 
+	return synced ? UART_RESET : status; 
 }
 
 void UART_OutSync() { 
@@ -86,97 +320,21 @@ void UART_OutACK() {
 	UART4_DR_R = 0x00; 
 }
 
-void UART_OutInitial() { 
-	while ((UART4_FR_R & UART_FR_TXFF) != 0); // busy wait 
-	UART4_DR_R = 0xAA; 
-	while ((UART4_FR_R & UART_FR_TXFF) != 0); // busy wait 
-	UART4_DR_R = 0x01; 
-	while ((UART4_FR_R & UART_FR_TXFF) != 0); // busy wait 
-	UART4_DR_R = 0x00; 
-	while ((UART4_FR_R & UART_FR_TXFF) != 0); // busy wait - decides image format (RAW) 
-	UART4_DR_R = 0x08; 
-	while ((UART4_FR_R & UART_FR_TXFF) != 0); // busy wait - decides raw resolution
-	UART4_DR_R = 0x03; // 160 x 120 in RAW 
-	while ((UART4_FR_R & UART_FR_TXFF) != 0); // busy wait - decides jpeg resolution 
-	UART4_DR_R = 0x05; // we are using a 320 x 240 display 
-	
-	UART_InData(); 
-	
-	if (array[0] != 0xAA || array[1] != 0x0E || array[2] != 0x01 || array[4] != 0x00 || array[5] != 0x00) { 
-		LCD_Clear(); 
-		LCD_WriteString("Image Parameters have gone wrong. Please shut down system. \n"); 
-		while (1) {} 
-	}
+uint32_t UART_OutInitial(UART_Reply *reply) { 
+	return UART_CommandRecover(0x01, 0x00, 0x08, 0x03, 0x05, reply); // RAW 16 bit, 160 x 120 RAW, 320 x 240 JPEG 
 } 
 
 // choosing 512 bytes 
-void UART_OutPackageSize() { 
-	while ((UART4_FR_R & UART_FR_TXFF) != 0); // busy wait 
-	UART4_DR_R = 0xAA; 
-	while ((UART4_FR_R & UART_FR_TXFF) != 0); // busy wait 
-	UART4_DR_R = 0x06; 
-	while ((UART4_FR_R & UART_FR_TXFF) != 0); // busy wait 
-	UART4_DR_R = 0x08; 
-	while ((UART4_FR_R & UART_FR_TXFF) != 0); // busy wait 
-	UART4_DR_R = 0x00; 
-	while ((UART4_FR_R & UART_FR_TXFF) != 0); // busy wait 
-	UART4_DR_R = 0x02; 
-	while ((UART4_FR_R & UART_FR_TXFF) != 0); // busy wait 
-	UART4_DR_R = 0x00; 
-	
-	UART_InData(); 
-	
-	if (array[0] != 0xAA || array[1] != 0x0E || array[2] != 0x06 || array[4] != 0x00 || array[5] != 0x00) { 
-		LCD_Clear(); 
-		LCD_WriteString("Package Size has gone wrong. Please shut down system. \n"); 
-		while (1) {} 
-	}
+uint32_t UART_OutPackageSize(UART_Reply *reply) { 
+	return UART_CommandRecover(0x06, 0x08, 0x00, 0x02, 0x00, reply); 
 }
 
-void UART_OutSnapshot() { 
-	while ((UART4_FR_R & UART_FR_TXFF) != 0); // busy wait 
-	UART4_DR_R = 0xAA; 
-	while ((UART4_FR_R & UART_FR_TXFF) != 0); // busy wait 
-	UART4_DR_R = 0x05; 
-	while ((UART4_FR_R & UART_FR_TXFF) != 0); // busy wait 
-	UART4_DR_R = 0x01; // RAW  
-	while ((UART4_FR_R & UART_FR_TXFF) != 0); // busy wait 
-	UART4_DR_R = 0x00; 
-	while ((UART4_FR_R & UART_FR_TXFF) != 0); // busy wait 
-	UART4_DR_R = 0x00; 
-	while ((UART4_FR_R & UART_FR_TXFF) != 0); // busy wait 
-	UART4_DR_R = 0x00; 
-	
-	UART_InData(); 
-	
-	if (array[0] != 0xAA || array[1] != 0x0E || array[2] != 0x05 || array[4] != 0x00 || array[5] != 0x00) { 
-		LCD_Clear(); 
-		LCD_WriteString("Snapshot has gone wrong. Please shut down system. \n"); 
-		while (1) {} 
-	}
+uint32_t UART_OutSnapshot(UART_Reply *reply) { 
+	return UART_CommandRecover(0x05, 0x01, 0x00, 0x00, 0x00, reply); // RAW 
 }
 
-void UART_OutGetPic() { 
-	while ((UART4_FR_R & UART_FR_TXFF) != 0); // busy wait 
-	UART4_DR_R = 0xAA; 
-	while ((UART4_FR_R & UART_FR_TXFF) != 0); // busy wait 
-	UART4_DR_R = 0x04; 
-	while ((UART4_FR_R & UART_FR_TXFF) != 0); // busy wait 
-	UART4_DR_R = 0x02; // RAW  
-	while ((UART4_FR_R & UART_FR_TXFF) != 0); // busy wait 
-	UART4_DR_R = 0x00; 
-	while ((UART4_FR_R & UART_FR_TXFF) != 0); // busy wait 
-	UART4_DR_R = 0x00; 
-	while ((UART4_FR_R & UART_FR_TXFF) != 0); // busy wait 
-	UART4_DR_R = 0x00; 
-	
-	UART_InData(); 
-	
-	if (array[0] != 0xAA || array[1] != 0x0E || array[2] != 0x04 || array[4] != 0x00 || array[5] != 0x00) { 
-		LCD_Clear(); 
-		LCD_WriteString("Get Picture has gone wrong. Please shut down system. \n"); 
-		while (1) {} 
-	}	
+uint32_t UART_OutGetPic(UART_Reply *reply) { 
+	return UART_CommandRecover(0x04, 0x02, 0x00, 0x00, 0x00, reply); // RAW 
 }
 
 void UART_OutCUSTOMACK(uint16_t num_package) { 
@@ -224,12 +382,9 @@ void UART_InNBytes(int32_t N) {
 
 
 void Camera_HardwareReset() { 
-	DisableInterrupts(); 
-	
-	int i; 
-	PF1 ^= 0x02; 
-	for (i = 0; i < 20000000; ++i) {} 
-	PF1 ^= 0x02; 
-		
-	EnableInterrupts(); 
+	// reset is active low, PF1 idles high 
+	uint32_t start = TimeBase_Ms(); 
+	PF1 = 0x00; 
+	while ((TimeBase_Ms() - start) <= UART_RESET_LOW_MS) {} // <= so a tick landing right away still counts as less than 1 ms 
+	PF1 = 0x02; 
 }
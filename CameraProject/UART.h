@@ -4,15 +4,95 @@
 #include "DMA_UART.h"
 #include "LCD_UART.h"
 
-extern uint8_t array[6]; 
 extern uint8_t image_array[512]; 
 // extern char image_array_two[512]; 
 
+// a camera reply, parsed. the caller owns it 
+typedef struct { 
+	uint8_t id;           // 0x0E ACK, 0x0F NAK, 0x0A DATA, 0x0D SYNC 
+	uint8_t parameter[4]; // for an ACK: parameter[0] is the id of the command it ACKs 
+} UART_Reply; 
+
+// status codes for the blocking camera commands 
+#define UART_OK        0 
+#define UART_TIMEOUT   1 // no whole reply in time 
+#define UART_NAK       2 // camera NAKed the command, parameter[2] of the reply has its error number 
+#define UART_BAD_REPLY 3 // a reply, but not the ACK we wanted 
+#define UART_RESET     4 // camera had to be hardware reset and synced to get it back: it answers again, 
+                         // but has forgotten INITIAL, package size, etc. and the link is at 115200 
+
+// how long a blocking command waits for its reply 
+#define UART_REPLY_TIMEOUT_MS 100 
+
+// recovery policy for UART_CommandRecover, cheapest first: send the command again (up to 
+// UART_COMMAND_RETRIES times), then do a SYNC round trip at the current rate and send it again, 
+// then hardware reset and full UART_Sync. the Camera.c state machine follows the same policy 
+#define UART_COMMAND_RETRIES 2 
+#define UART_RECOVER_RETRY   0 
+#define UART_RECOVER_RESYNC  1 
+#define UART_RECOVER_RESET   2 
+#define UART_RECOVER_LEVELS  3 
+
+// how many times each recovery level was needed since power up, and the milliseconds spent in it 
+// (index with UART_RECOVER_*). compare against capture times to see what each failure mode costs 
+extern uint32_t UART_Recoveries[UART_RECOVER_LEVELS]; 
+extern uint32_t UART_RecoveryMs[UART_RECOVER_LEVELS]; 
+
 // initialize to baud rate of: 115200 bits per second   
 void UART_Init(void); 
 
-// read in 6 bytes of consecutive data 
-void UART_InData(void); 
+// baud rate the camera link is running at right now 
+extern uint32_t UART_Baud; 
+
+// bus clock in Hz, worked out from how PLL_Init left the RCC2 register 
+uint32_t UART_BusClock(void); 
+
+// reprogram UART4 for a new baud rate, with IBRD/FBRD computed from the real bus clock 
+// waits for anything still in the transmit fifo to go out first 
+void UART_SetBaudRate(uint32_t baud); 
+
+// after sync: step the camera link up (230400, 460800, 921600) as long as each new rate 
+// passes a SYNC round trip, and settle on the fastest one that did 
+// returns the baud rate in use, or 0 if the camera got lost on the way. in that case 
+// the camera has been hardware reset, the link is back at 115200 and sync has to be redone 
+uint32_t UART_NegotiateBaud(void); 
+
+// turn on receive interrupts so camera replies get queued up instead of polled for 
+// priority: 0 (highest) to 7 (lowest) 
+// leave these off while using the blocking UART_Out* / UART_InData functions 
+void UART_RxInterruptEnable(uint32_t priority); 
+
+// stop queueing replies (e.g. before uDMA takes over the receive side) 
+void UART_RxInterruptDisable(void); 
+
+// pop one 6-byte reply that came in under interrupts 
+// returns 1 and populates reply if a whole one is there, 0 otherwise. never waits 
+uint32_t UART_InReply(UART_Reply *reply); 
+
+// throw away anything queued, and anything sitting in the receive fifo 
+// returns how many bytes were sitting in the receive fifo 
+uint32_t UART_RxFlush(void); 
+
+// output any 6-byte command: 0xAA, id, then the four parameter bytes. does not wait for a reply 
+void UART_OutCommand(uint8_t id, uint8_t p1, uint8_t p2, uint8_t p3, uint8_t p4); 
+
+// read in one 6 byte reply (anything in front of its 0xAA is skipped), giving up after ms milliseconds 
+// returns UART_OK with reply populated, or UART_TIMEOUT 
+uint32_t UART_InData(UART_Reply *reply, uint32_t ms); 
+
+// send a command and wait for its ACK, once 
+// reply: populated with whatever came back (ACK, NAK, ...) 
+// returns UART_OK, UART_TIMEOUT, UART_NAK or UART_BAD_REPLY 
+uint32_t UART_Command(uint8_t id, uint8_t p1, uint8_t p2, uint8_t p3, uint8_t p4, UART_Reply *reply); 
+
+// UART_Command, plus the recovery policy above when it fails 
+// returns UART_OK, UART_RESET (redo the set up, the command was not sent again), or whatever the 
+// last try got if even the reset did not bring the camera back 
+uint32_t UART_CommandRecover(uint8_t id, uint8_t p1, uint8_t p2, uint8_t p3, uint8_t p4, UART_Reply *reply); 
+
+// SYNC round trip at the current rate: we send SYNC, camera ACKs it and sends its own SYNC, we ACK that 
+// returns 1 if the camera took part 
+uint32_t UART_CheckLink(void); 
 
 // read an image one package at a time
 // input instance: tells us what number package we're on
@@ -27,17 +107,19 @@ void UART_OutACK(void);
 // output custom ACK message 
 void UART_OutCUSTOMACK(uint16_t num_package); 
 
-// output Initial message for JPEG images 
-void UART_OutInitial(void); 
+// the fixed set up commands below all go through UART_CommandRecover and return its status 
+
+// output Initial message: RAW 16 bit, 160x120 
+uint32_t UART_OutInitial(UART_Reply *reply); 
 
 // tell the camera what package size we want
-void UART_OutPackageSize(void); 
+uint32_t UART_OutPackageSize(UART_Reply *reply); 
 
 // take a snapshot - this will need to be triggered by a button press, eventually 
-void UART_OutSnapshot(void); 
+uint32_t UART_OutSnapshot(UART_Reply *reply); 
 
 // get the picture back 
-void UART_OutGetPic(void); 
+uint32_t UART_OutGetPic(UART_Reply *reply); 
 
 // get a single byte 
 char UART_ReadSingleByte(void); 
@@ -46,4 +128,26 @@ char UART_ReadSingleByte(void);
 void UART_InNBytes(int32_t N); 
 
 // hardware reset signal to send to camera 
+// holds reset low for UART_RESET_LOW_MS, timed off TimeBase_Ms, so interrupts stay on (and TimeBase must be running) 
+#define UART_RESET_LOW_MS 10 
 void Camera_HardwareReset(void); 
+
+// sync schedule from the uCAM-III datasheet: up to UART_SYNC_TRIES SYNCs, the first one given 
+// 5 ms to be answered and every one after that 1 ms longer than the one before 
+#define UART_SYNC_TRIES 60 
+#define UART_SYNC_DELAY_MS(n) (5 + (n)) 
+
+// give up on syncing after this long by default 
+#define UART_SYNC_TIMEOUT_MS 5000 
+
+// sync statistics for the last UART_Sync, for tuning cold start time 
+extern uint32_t UART_SyncMs;       // from the first reset pulse to the camera's SYNC being ACKed 
+extern uint32_t UART_SyncAttempts; // SYNCs sent 
+extern uint32_t UART_SyncResets;   // reset pulses sent 
+
+// reset the camera and sync with it: SYNC on the datasheet schedule, another reset pulse 
+// every time a whole schedule goes unanswered, until the camera's own SYNC has been ACKed 
+// timeout_ms: hard limit for the whole thing (UART_SYNC_TIMEOUT_MS is a good default) 
+// returns 1 once synced, 0 if the time ran out. the link is at 115200 either way 
+// receive interrupts must be off, and TimeBase running 
+uint32_t UART_Sync(uint32_t timeout_ms); 
@@ -51,12 +51,20 @@
 // SDO   (NC) I2C alternate address for ADXL345 accelerometer
 // Backlight + - Light, backlight connected to +3.3 V
 #include <stdint.h>
+#ifdef HOST_SIM
+#include "../tools/sim/tm4c_sim.h"  /* SSI0, uDMA and card models so the driver can be benchmarked on a pc */
+#else
 #include "../inc/tm4c123gh6pm.h"
-#include "edisk.h"
+#endif
+#include "eDisk.h"
 
 #define SDC_CS_PB0 1
 #define SDC_CS_PD7 0
+#ifdef HOST_SIM
+#define TFT_CS                  Sim_Regs[SIM_TFT_CS]
+#else
 #define TFT_CS                  (*((volatile unsigned long *)0x40004020))
+#endif
 #define TFT_CS_LOW              0           // CS normally controlled by hardware
 #define TFT_CS_HIGH             0x08
 
@@ -83,7 +91,11 @@ void CS_Init(void){
 #if SDC_CS_PB0
 // CS is PB0
 // to change CS to another GPIO, change SDC_CS and CS_Init
+#ifdef HOST_SIM
+#define SDC_CS   Sim_Regs[SIM_SDC_CS]
+#else
 #define SDC_CS   (*((volatile unsigned long *)0x40005004)) 
+#endif
 #define SDC_CS_LOW       0           // CS controlled by software
 #define SDC_CS_HIGH      0x01  
 void CS_Init(void){ 
@@ -173,9 +185,9 @@ void SSI0_Init(unsigned long CPSDVSR){
 
 // SSIClk = PIOSC / (CPSDVSR * (1 + SCR)) = 80 MHz/CPSDVSR
 // 200 for   400,000 bps slow mode, used during initialization
-// 8  for 10,000,000 bps fast mode, used during disk I/O
+// 8  for 10,000,000 bps fast mode, used during disk I/O, until eDisk_SetClock picks another
 #define FCLK_SLOW() { SSI0_CPSR_R = (SSI0_CPSR_R&~SSI_CPSR_CPSDVSR_M)+200; }  
-#define FCLK_FAST() { SSI0_CPSR_R = (SSI0_CPSR_R&~SSI_CPSR_CPSDVSR_M)+8; }
+#define FCLK_FAST() { SSI0_CPSR_R = (SSI0_CPSR_R&~SSI_CPSR_CPSDVSR_M)+FastDivisor; }
 
 // de-asserts the CS pin to the card
 #define CS_HIGH()  SDC_CS = SDC_CS_HIGH;
@@ -215,6 +227,7 @@ void SSI0_Init(unsigned long CPSDVSR){
 #define CMD38  (38)    /* ERASE */
 #define CMD55  (55)    /* APP_CMD */
 #define CMD58  (58)    /* READ_OCR */
+#define CMD59  (59)    /* CRC_ON_OFF */
 
 static volatile DSTATUS Stat = STA_NOINIT;  /* Physical drive status */
 
@@ -222,6 +235,43 @@ static volatile UINT Timer1, Timer2;  /* 1kHz decrement timer stopped at zero (d
 
 static BYTE CardType;      /* Card type flags */
 
+static BYTE StreamOpen;    /* 1 between eDisk_WriteStart and eDisk_WriteStop */
+static BYTE StreamBusy;    /* 1 while a block of the stream is still going out on uDMA */
+static WORD StreamCrc;     /* CRC16 of that block */
+
+static BYTE FastDivisor = 8;  /* CPSDVSR for disk I/O (eDisk_SetClock) */
+static BYTE CrcOn;         /* 1 once the card checks CRCs (CMD59) */
+DWORD eDisk_CrcErrors;     /* data blocks that came in with a bad CRC16 */
+
+/* CRC16-CCITT (polynomial 0x1021, starts at 0) of SD data blocks, a nibble at a time */
+static const WORD Crc16Table[16] = {
+  0x0000, 0x1021, 0x2042, 0x3063, 0x4084, 0x50A5, 0x60C6, 0x70E7,
+  0x8108, 0x9129, 0xA14A, 0xB16B, 0xC18C, 0xD1AD, 0xE1CE, 0xF1EF
+};
+static WORD crc16(const BYTE *buff, UINT n){
+  WORD crc = 0;
+  while(n--){
+    crc = (crc << 4) ^ Crc16Table[(crc >> 12) ^ (*buff >> 4)];
+    crc = (crc << 4) ^ Crc16Table[(crc >> 12) ^ (*buff & 0x0F)];
+    buff++;
+  }
+  return crc;
+}
+
+/* CRC7 of a command packet, shifted up with the stop bit set, ready to send */
+static BYTE crc7(const BYTE *packet, UINT n){
+  BYTE crc = 0, d, i;
+  while(n--){
+    d = *packet++;
+    for(i = 0; i < 8; i++){
+      crc <<= 1;
+      if((d ^ crc) & 0x80) crc ^= 0x09;
+      d <<= 1;
+    }
+  }
+  return (BYTE)((crc << 1) | 0x01);
+}
+
 
 
 /*-----------------------------------------------------------------------*/
@@ -233,7 +283,11 @@ static void init_spi(void){
   SPIxENABLE();    /* Enable SPI function */
   CS_HIGH();       /* Set CS# high */
 
+#ifdef HOST_SIM
+  Sim_Advance(10*(SIM_BUS_CLOCK/1000));  /* 10ms, nothing in the loop lets simulated time pass */
+#else
   for (Timer1 = 10; Timer1; ) ;  /* 10ms */
+#endif
 }
 
 
@@ -344,6 +398,7 @@ static int select(void){
 // Output: 1:OK, 0:Error on timeout
 static int rcvr_datablock(BYTE *buff, UINT btr){
   BYTE token;
+  WORD crc;
   Timer1 = 200;
   do {              /* Wait for DataStart token in timeout of 200ms */
     token = xchg_spi(0xFF);
@@ -352,7 +407,12 @@ static int rcvr_datablock(BYTE *buff, UINT btr){
   if(token != 0xFE) return 0;    /* Function fails if invalid DataStart token or timeout */
 
   rcvr_spi_multi(buff, btr);    /* Store trailing data to the buffer */
-  xchg_spi(0xFF); xchg_spi(0xFF);      /* Discard CRC */
+  crc = xchg_spi(0xFF) << 8;
+  crc |= xchg_spi(0xFF);        /* CRC16, checked if the card is in CRC mode */
+  if (CrcOn && crc != crc16(buff, btr)) {
+    eDisk_CrcErrors++;
+    return 0;
+  }
   return 1;            /* Function succeeded */
 }
 
@@ -368,12 +428,14 @@ static int rcvr_datablock(BYTE *buff, UINT btr){
 // Output: 1:OK, 0:Failed on timeout
 static int xmit_datablock(const BYTE *buff, BYTE token){
   BYTE resp;
+  WORD crc;
   if (!wait_ready(500)) return 0;    /* Wait for card ready */
 
   xchg_spi(token);                   /* Send token */
   if (token != 0xFD) {               /* Send data if token is other than StopTran */
+    crc = crc16(buff, 512);
     xmit_spi_multi(buff, 512);       /* Data */
-    xchg_spi(0xFF); xchg_spi(0xFF);  /* Dummy CRC */
+    xchg_spi((BYTE)(crc >> 8)); xchg_spi((BYTE)crc);  /* CRC16 */
 
     resp = xchg_spi(0xFF);        /* Receive data resp */
     if ((resp & 0x1F) != 0x05)    /* Function fails if the data packet was not accepted */
@@ -391,7 +453,7 @@ static int xmit_datablock(const BYTE *buff, BYTE token){
 //          arg    /* Argument 
 // Outputs: R1 resp (bit7==1:Failed to send)
 static BYTE send_cmd(BYTE cmd, DWORD arg){
-  BYTE n, res;
+  BYTE n, res, packet[5];
   if (cmd & 0x80) {  /* Send a CMD55 prior to ACMD<n> */
     cmd &= 0x7F;
     res = send_cmd(CMD55, 0);
@@ -405,15 +467,13 @@ static BYTE send_cmd(BYTE cmd, DWORD arg){
   }
 
   /* Send command packet */
-  xchg_spi(0x40 | cmd);        /* Start + command index */
-  xchg_spi((BYTE)(arg >> 24));    /* Argument[31..24] */
-  xchg_spi((BYTE)(arg >> 16));    /* Argument[23..16] */
-  xchg_spi((BYTE)(arg >> 8));      /* Argument[15..8] */
-  xchg_spi((BYTE)arg);        /* Argument[7..0] */
-  n = 0x01;              /* Dummy CRC + Stop */
-  if (cmd == CMD0) n = 0x95;      /* Valid CRC for CMD0(0) */
-  if (cmd == CMD8) n = 0x87;      /* Valid CRC for CMD8(0x1AA) */
-  xchg_spi(n);
+  packet[0] = 0x40 | cmd;        /* Start + command index */
+  packet[1] = (BYTE)(arg >> 24);  /* Argument[31..24] */
+  packet[2] = (BYTE)(arg >> 16);  /* Argument[23..16] */
+  packet[3] = (BYTE)(arg >> 8);   /* Argument[15..8] */
+  packet[4] = (BYTE)arg;          /* Argument[7..0] */
+  for (n = 0; n < 5; n++) xchg_spi(packet[n]);
+  xchg_spi(crc7(packet, 5));      /* CRC + Stop, always valid so CRC mode can be on */
 
   /* Receive command resp */
   if (cmd == CMD12) xchg_spi(0xFF);  /* Diacard following one byte when CMD12 */
@@ -474,6 +534,8 @@ DSTATUS eDisk_Init(BYTE drv){
     }
   }
   CardType = ty;  /* Card type */
+  CrcOn = 0;
+  if (ty && send_cmd(CMD59, 1) == 0) CrcOn = 1;  /* Card checks CRCs from now on, and so do we */
   deselect();
 
   if (ty) {      /* OK */
@@ -511,6 +573,7 @@ DSTATUS eDisk_Status(BYTE drv){
 DRESULT eDisk_Read(BYTE drv, BYTE *buff, DWORD sector, UINT count){
   if (drv || !count) return RES_PARERR;    /* Check parameter */
   if (Stat & STA_NOINIT) return RES_NOTRDY;  /* Check if drive is ready */
+  if (StreamOpen) eDisk_WriteStop();         /* Finish a streaming write first */
 
   if (!(CardType & CT_BLOCK)) sector *= 512;  /* LBA ot BA conversion (byte addressing cards) */
 
@@ -564,6 +627,7 @@ DRESULT eDisk_Write(BYTE drv, const BYTE *buff, DWORD sector, UINT count){
   if (drv || !count) return RES_PARERR;    /* Check parameter */
   if (Stat & STA_NOINIT) return RES_NOTRDY;  /* Check drive status */
   if (Stat & STA_PROTECT) return RES_WRPRT;  /* Check write protect */
+  if (StreamOpen) eDisk_WriteStop();         /* Finish a streaming write first */
 
   if (!(CardType & CT_BLOCK)) sector *= 512;  /* LBA ==> BA conversion (byte addressing cards) */
 
@@ -603,9 +667,155 @@ DRESULT eDisk_WriteBlock (
   return eDisk_Write(0,buff,sector,1);  // 1 block
 }
 
+/*-----------------------------------------------------------------------*/
+/* Streaming multi-block write                                           */
+/*-----------------------------------------------------------------------*/
+// One CMD25 is kept open across calls, so sectors can be handed over one
+// at a time as they are ready. The 512 data bytes of each block go out on
+// uDMA channel 11 (SSI0 TX), and eDisk_WriteNext returns as soon as they
+// are started. The CRC and data response of a block are collected at the
+// start of the next call (or by eDisk_WriteStop).
+// The uDMA controller and its control table are set up by DMA_UART_Init.
+extern uint32_t ucControlTable[256];
+#define CH11  (11*4)
+#define BIT11 0x00000800
+
+// start the data of one block on uDMA, SSI0 TX requests it
+static void dma_xmit_block(const BYTE *buff){
+  UDMA_CHMAP1_R &= ~0x0000F000;   // channel 11 encoding 0 is SSI0 TX
+  UDMA_PRIOCLR_R = BIT11;         // default, not high priority
+  UDMA_ALTCLR_R = BIT11;          // use primary control
+  UDMA_USEBURSTCLR_R = BIT11;     // responds to both burst and single requests
+  UDMA_REQMASKCLR_R = BIT11;      // allow the uDMA controller to recognize requests for this channel
+  ucControlTable[CH11]   = (uint32_t)(buff+511);  // last address
+  ucControlTable[CH11+1] = (uint32_t)&SSI0_DR_R;  // fixed
+  ucControlTable[CH11+2] = 0xC0008001+(511<<4);   // DMA Channel Control Word (DMACHCTL)
+/* DMACHCTL          Bits    Value Description
+   DSTINC            31:30   11    no destination address increment
+   DSTSIZE           29:28   00    8-bit destination data size
+   SRCINC            27:26   00    8-bit source address increment
+   SRCSIZE           25:24   00    8-bit source data size
+   reserved          23:18   0     Reserved
+   ARBSIZE           17:14   0010  Arbitrates after 4 transfers (half the fifo)
+   XFERSIZE          13:4    511   Transfer count items
+   NXTUSEBURST       3       0     N/A for this transfer type
+   XFERMODE          2:0     001   Use basic transfer mode
+  */
+  SSI0_DMACTL_R |= SSI_DMACTL_TXDMAE;
+  UDMA_ENASET_R = BIT11;          // channel 11 clears itself when done
+}
+
+// wait for the uDMA block to leave, collect CRC and data response
+// Output: 1:OK, 0:Rejected
+static int finish_block(void){
+  BYTE resp;
+  if (!StreamBusy) return 1;
+  StreamBusy = 0;
+  while(UDMA_ENASET_R&BIT11){};
+  SSI0_DMACTL_R &= ~SSI_DMACTL_TXDMAE;
+  while((SSI0_SR_R&SSI_SR_BSY)==SSI_SR_BSY){};
+  while(SSI0_SR_R&SSI_SR_RNE){ resp = SSI0_DR_R; } // nothing came back worth keeping, the fifo overran
+  SSI0_ICR_R = SSI_ICR_RORIC;
+  xchg_spi((BYTE)(StreamCrc >> 8)); xchg_spi((BYTE)StreamCrc);  /* CRC16 */
+  resp = xchg_spi(0xFF);           /* Receive data resp */
+  return ((resp & 0x1F) == 0x05);
+}
+
+//*************** eDisk_WriteStart ***********
+// Open a multi-block write
+// Inputs: sector number of SD card to start at
+//         count  number of blocks to pre-erase (ACMD23), 0 if not known
+// Outputs: result (see DRESULT)
+DRESULT eDisk_WriteStart(DWORD sector, UINT count){
+  if (Stat & STA_NOINIT) return RES_NOTRDY;  /* Check drive status */
+  if (Stat & STA_PROTECT) return RES_WRPRT;  /* Check write protect */
+  if (StreamOpen) eDisk_WriteStop();
+
+  if (!(CardType & CT_BLOCK)) sector *= 512;  /* LBA ==> BA conversion (byte addressing cards) */
+
+  if (count && (CardType & CT_SDC)) send_cmd(ACMD23, count);  /* Pre-erase the blocks about to be written */
+  if (send_cmd(CMD25, sector) != 0) {  /* WRITE_MULTIPLE_BLOCK */
+    deselect();
+    return RES_ERROR;
+  }
+  StreamOpen = 1;
+  return RES_OK;
+}
+
+//*************** eDisk_WriteNext ***********
+// Send the next block of an open multi-block write
+// Inputs: pointer to 512 bytes, which have to stay put until the next
+//         eDisk_WriteNext or eDisk_WriteStop (uDMA is still reading them)
+// Outputs: result (see DRESULT), RES_ERROR if the card rejected the last block
+DRESULT eDisk_WriteNext(const BYTE *buff){
+  if (!StreamOpen) return RES_PARERR;
+  if (!finish_block()) return RES_ERROR;
+  StreamCrc = crc16(buff, 512);              /* While the card gets ready */
+  if (!wait_ready(500)) return RES_ERROR;    /* Wait for card ready */
+  xchg_spi(0xFC);                            /* Data token for CMD25 */
+  dma_xmit_block(buff);
+  StreamBusy = 1;
+  return RES_OK;
+}
+
+//*************** eDisk_WriteStop ***********
+// Finish the last block and close the multi-block write (STOP_TRAN token)
+// Inputs: none
+// Outputs: result (see DRESULT)
+DRESULT eDisk_WriteStop(void){
+  int ok;
+  if (!StreamOpen) return RES_OK;
+  ok = finish_block();
+  if (!xmit_datablock(0, 0xFD)) ok = 0;      /* STOP_TRAN token */
+  if (!wait_ready(500)) ok = 0;              /* Card programs the last blocks */
+  deselect();
+  StreamOpen = 0;
+  return ok ? RES_OK : RES_ERROR;
+}
+
 #endif
 
 
+/*-----------------------------------------------------------------------*/
+/* Clock and card identity                                               */
+/*-----------------------------------------------------------------------*/
+
+//*************** eDisk_SetClock ***********
+// Set the SSI0 clock used for disk I/O: 80 MHz/cpsdvsr
+// Inputs: cpsdvsr, even from 2 to 254 (8 is the 10 MHz the driver starts with)
+// Outputs: none
+void eDisk_SetClock(BYTE cpsdvsr){
+  if (cpsdvsr < 2) cpsdvsr = 2;
+  FastDivisor = cpsdvsr & 0xFE;
+  if (!(Stat & STA_NOINIT)) FCLK_FAST();
+}
+
+//*************** eDisk_GetClock ***********
+// Outputs: the CPSDVSR disk I/O runs at
+BYTE eDisk_GetClock(void){
+  return FastDivisor;
+}
+
+//*************** eDisk_CrcMode ***********
+// Outputs: 1 if the card and the driver check CRCs on every transfer
+BYTE eDisk_CrcMode(void){
+  return CrcOn;
+}
+
+//*************** eDisk_ReadCID ***********
+// Read the card's 16 byte CID register (manufacturer, product, serial number)
+// Inputs: pointer to 16 bytes of RAM
+// Outputs: result (see DRESULT)
+DRESULT eDisk_ReadCID(BYTE *cid){
+  DRESULT res = RES_ERROR;
+  if (Stat & STA_NOINIT) return RES_NOTRDY;
+  if (StreamOpen) eDisk_WriteStop();
+  if ((send_cmd(CMD10, 0) == 0) && rcvr_datablock(cid, 16)) res = RES_OK;
+  deselect();
+  return res;
+}
+
+
 /*-----------------------------------------------------------------------*/
 /* Miscellaneous drive controls other than data read/write               */
 /*-----------------------------------------------------------------------*/
@@ -197,7 +197,85 @@ DRESULT eDisk_WriteBlock (
     DWORD sector);      /* Start sector number (LBA) */
 
 
+/**
+ * @details  Open a multi-block write (CMD25) that stays open across calls,
+ * so blocks can be sent one at a time as they become ready.
+ * Any other read or write closes it first.
+ * @param  sector sector number of SD card to start at: 0,1,2,...
+ * @param  count number of blocks to pre-erase (ACMD23), 0 if not known
+ * @return result (0 means OK)
+ * @brief  Start a streaming write.
+ */
+DRESULT eDisk_WriteStart (
+    DWORD sector,       /* Start sector number (LBA) */
+    UINT count);        /* Blocks to pre-erase */
+
+
+/**
+ * @details  Send the next block of the open write. The data goes out on
+ * uDMA channel 11 and this returns as soon as it has started, so the
+ * buffer has to stay put until the next eDisk_WriteNext or eDisk_WriteStop.
+ * The uDMA controller has to be set up already (DMA_UART_Init).
+ * @param  buff pointer to RAM buffer with 512 bytes of data
+ * @return result (0 means OK), RES_ERROR if the card rejected the last block
+ * @brief  Stream one block.
+ */
+DRESULT eDisk_WriteNext (
+    const BYTE *buff);  /* Pointer to the data to be written */
+
+
+/**
+ * @details  Finish the last block and close the streaming write.
+ * @param  none
+ * @return result (0 means OK)
+ * @brief  Stop a streaming write.
+ */
+DRESULT eDisk_WriteStop (void);
+
+
 #endif
+
+/**
+ * @details  Set the SSI0 clock for disk I/O to 80 MHz/cpsdvsr.
+ * The driver starts at 8 (10 MHz), initialization always runs at 400 kHz.
+ * @param  cpsdvsr even divisor from 2 to 254
+ * @return none
+ * @brief  Set the fast clock.
+ */
+void eDisk_SetClock (BYTE cpsdvsr);
+
+/**
+ * @details  Divisor set by eDisk_SetClock.
+ * @param  none
+ * @return CPSDVSR used for disk I/O
+ * @brief  Get the fast clock.
+ */
+BYTE eDisk_GetClock (void);
+
+/**
+ * @details  eDisk_Init turns on CRC checking (CMD59). From then on every
+ * command carries its CRC7, every block carries its CRC16, and a block that
+ * comes in with a bad CRC16 fails the read (counted in eDisk_CrcErrors).
+ * @param  none
+ * @return 1 if the card accepted CRC mode, 0 if not (CRCs are sent, but not checked)
+ * @brief  Is CRC mode on.
+ */
+BYTE eDisk_CrcMode (void);
+
+/**
+ * \brief Data blocks received with a bad CRC16
+ */
+extern DWORD eDisk_CrcErrors;
+
+/**
+ * @details  Read the card's CID register: manufacturer, product name and
+ * revision, serial number and date. Tells one card from another.
+ * @param  cid pointer to 16 bytes of RAM
+ * @return result (0 means OK)
+ * @brief  Read the card identity.
+ */
+DRESULT eDisk_ReadCID (
+    BYTE *cid);         /* 16 bytes */
 /**
  * @details  Enable SDC chip select, so it is an output
  * @param  none
@@ -5,6 +5,16 @@
 #include "inc/Timer1A.h" 
 #include "inc/Unified_Port_Init.h"
 #include "UART0.h" 
+#include "Camera.h" 
+#include "TimeBase.h" 
+#include "SectorBuffer.h" 
+#include "Thumbnail.h" 
+#include "FileCounter.h" 
+#include "SDCard.h" 
+#include "ImageLog.h" 
+#include "SectorCache.h" 
+#include "Fat32.h" 
+#include <stdio.h> 
 
 // these things are mostly predetermined by the programmer, i think. see no purpose in giving user control of these things. 
 //#define PACKAGE_SIZE 506 
@@ -96,148 +106,60 @@ void LCD_main1() {
 }
 
 
+// photos go into an append-only log in the raw area of the card, below the thumbnails (ImageLog.h), 
+// so each one gets its own slot and a pc can pull them all off the card (tools/imagelog_extract.c) 
+#define PHOTO_LOG_SECTOR 0 
+#define PHOTO_LOG_SLOTS ((THUMB_FIRST_SECTOR - PHOTO_LOG_SECTOR - 1)/IMAGELOG_SLOT_SECTORS) 
+#define PHOTO_WIDTH  160 // what Camera_SetFormat gives you unless told otherwise 
+#define PHOTO_HEIGHT 120 
+
 void LCD_Camera_main2() { 
 	DisableInterrupts();
 	PLL_Init(Bus80MHz);  
 	Unified_Port_Init(); // initialize all ports 
 	LCD_UART_Init(); // initialize lcd communication 
 	UART_Init(); 		// initialize camera communication 
-	Timer1A_Init(UART_OutSync, SyncTime * 80000, 2); // timer allows us to sync with camera module 
+	DMA_UART_Enable(); // camera packages come in over uDMA channel 18 
+	TimeBase_Init(); 			// millisecond clock for camera timeouts 
 	EnableInterrupts(); 
+	LCD_NegotiateBaud(); 	// display link up from 9600, every sector write is that much shorter 
 	
 	
 	/***** CAMERA SET UP START*****/ 
 	LCD_WriteString("Setting up camera... \n"); 
 	// initialize the SD card to be ready to accept RAW image data 
 	LCD_MediaInit(); 	
+	if (ImageLog_Open(PHOTO_LOG_SECTOR, PHOTO_LOG_SLOTS, LCD_WriteSectorAt, LCD_ReadSectorAt, LCD_FlushMedia) == IMAGELOG_UNREADABLE) { 
+		LCD_WriteString("Unable to read the photo log \n"); 
+	}
 	
-	// need to send a reset signal to camera before syncing 
-	Camera_HardwareReset(); 
-	UART_InData(); 
 	LCD_WriteString("Syncing... \n"); 
-	uint8_t SyncFailureCounter = 0; 
-	while (array[0] != 0xAA || array[1] != 0x0E || array[2] != 0x0D || array[4] != 0x00 || array[5] != 0x00) { 
-		UART_InData();  
-		++SyncFailureCounter; 
-		if (SyncFailureCounter == 10) { 
-			Camera_HardwareReset(); 
-			SyncFailureCounter = 0; 
-		}
-	} 
-	LCD_WriteString("Syncing 2... \n"); 
-	// once we've gotten here, we've read our ACK signal, and can stop sending sync signals: 
-	Timer1A_Stop(); 
-	// reading our CAMERA'S SYNC signal: 
-	LCD_WriteString("Syncing 3... \n");
-	UART_InData(); 
-	LCD_WriteString("Syncing 4... \n"); 
-	if (array[0] != 0xAA || array[1] != 0x0D || array[2] != 0x00 || array[3] != 0x00 || array[4] != 0x00 || array[5] != 0x00) { 
+	if (!UART_Sync(UART_SYNC_TIMEOUT_MS)) { 
 		LCD_Clear(); 
 		LCD_WriteString("Sync has gone wrong. Please shut down system. \n"); 
 		while (1) {} 
-	}		
-	UART_OutACK(); 
+	}
 	LCD_WriteString("Done setting up camera... \n"); 
 	/***** CAMERA SET UP END*****/ 
 	
 	/***** TAKING THE PHOTO START*****/ 
 	LCD_WriteString("Taking photo... \n"); 
 	
-	UART_OutInitial(); 
-	if (array[0] != 0xAA || array[1] != 0x0E || array[2] != 0x01 || array[4] != 0x00 || array[5] != 0x00) { 
+	// every step goes out as soon as the camera ACKs the previous one, no more 100 ms waits 
+	uint32_t picture = ImageLog_Begin(CAMERA_RAW, PHOTO_WIDTH, PHOTO_HEIGHT); // next slot of the log, header written last 
+	Camera_StartCapture(SectorBuffer_Write); 
+	uint32_t status; 
+	while ((status = Camera_Poll()) == CAMERA_BUSY) {} 
+	uint32_t logged = (status == CAMERA_DONE) && ImageLog_Close(TimeBase_Ms()); 
+	LCD_FlushMedia(); 
+	if (status == CAMERA_ERROR) { 
 		LCD_Clear(); 
-		LCD_WriteString("Image Parameters have gone wrong. Please shut down system. \n"); 
+		LCD_WriteString("Taking photo has gone wrong. Please shut down system. \n"); 
 		while (1) {} 
 	}
-	
-	LCD_WriteString("Out Initial Done... \n"); 
-	
-	UART_OutPackageSize(); 
-	if (array[0] != 0xAA || array[1] != 0x0E || array[2] != 0x06 || array[4] != 0x00 || array[5] != 0x00) { 
-		LCD_Clear(); 
-		LCD_WriteString("Package Size has gone wrong. Please shut down system. \n"); 
-		while (1) {} 
-	}
-	
-	LCD_WriteString("Out Package Done... \n"); 
-	
-	UART_OutSnapshot(); 
-	if (array[0] != 0xAA || array[1] != 0x0E || array[2] != 0x05 || array[4] != 0x00 || array[5] != 0x00) { 
-		LCD_Clear(); 
-		LCD_WriteString("Snapshot has gone wrong. Please shut down system. \n"); 
-		while (1) {} 
-	}
-	
-	LCD_WriteString("Out Snapshot Done... \n"); 
-	
-	for (int z = 0; z < 800000; ++z) {} // 100 ms delay to allow camera to chill 
-	
-	UART_OutGetPic(); 
-	if (array[0] != 0xAA || array[1] != 0x0E || array[2] != 0x04 || array[4] != 0x00 || array[5] != 0x00) { 
-		LCD_Clear(); 
-		LCD_WriteString("Get Picture has gone wrong. Please shut down system. \n"); 
-		while (1) {} 
-	}	
-	
-	LCD_WriteString("Out Get Pic Done... \n"); 
-	
-	for (int z = 0; z < 800000; ++z) {} // 100 ms delay to allow camera to chill 
-	
-	// get the number of 512-byte transfers: 
-	UART_InData(); 
-	if (array[0] != 0xAA || array[1] != 0x0A || array[2] != 0x02) {
-		LCD_Clear(); 
-		LCD_WriteString("Transferring has gone wrong. Please shut down system. \n"); 
-		while (1) {} 
-	} 
-	int32_t NUM_BYTES = (((array[5] & 0xFF) << 16) + ((array[4] & 0xFF) << 8) + array[3]);  
-	int32_t NUM_TRANSFERS = NUM_BYTES / 512;  
-	
-	LCD_WriteString("Get Transfer Size Done... \n"); 
-	
-	uint16_t current_package_number = 0; 
-	LCD_SetSectorAddress(current_package_number); // start at beginning of SD card 
-	int32_t num_bytes_left = NUM_BYTES; 
-	while (current_package_number < NUM_TRANSFERS) { 
-		UART_OutCUSTOMACK(current_package_number); 
-		
-		for (int z = 0; z < 800000; ++z) {} // 100 ms delay to allow camera to chill 
-		
-		if (num_bytes_left >= 512) { 
-			UART_InNBytes(512); // populating image array 
-		}	else { 
-			UART_InNBytes(num_bytes_left);
-		}					
-				
-		LCD_WriteString("Image Array populated! \n");
-		
-		// now write to sector in SD card: 	
-		LCD_WriteSector(image_array); 
-		LCD_FlushMedia(); 	
-		
-		//---------- BAD 
-		
-		
-		if (current_package_number == 3) { 
-			LCD_SetSectorAddress(0); 
-			LCD_DisplayImage(0, 30); 
-			LCD_SetSectorAddress(1); 
-			LCD_DisplayImage(0, 30); 
-			LCD_SetSectorAddress(2); 
-			LCD_DisplayImage(0, 30); 
-			LCD_SetSectorAddress(3); 
-			LCD_DisplayImage(0, 30); 
-		}
-		
-		//---------- BAD 	
-			
-		++current_package_number; 
-		num_bytes_left -= 512; 
-		
-		// and then finally: clear image array in order to be ready for next transfer 
-		for (uint16_t k = 0; k < 512; ++k) {  
-			image_array[k] = 0; 
-		}
+	if (!logged) { 
+		LCD_WriteString("Saving Photo Failed, not in the log \n"); // too big for its slot, or no log open 
+		return; 
 	}
 	
 	LCD_WriteString("Done taking photo... \n"); 
@@ -245,7 +167,7 @@ void LCD_Camera_main2() {
 	
 	/***** SHOWING THE PHOTO START *****/ 
 	LCD_WriteString("Showing photo... \n"); 
-	LCD_SetSectorAddress(0); 
+	LCD_SetSectorAddress(picture); // right after the picture's header 
 	LCD_DisplayImage(0, 0); 
 	
 	/***** SHOWING THE PHOTO END *****/ 
@@ -327,33 +249,31 @@ void file_system_main4() {
 
 
 void Initialize_Camera_Routine() { 
-	Timer1A_Init(UART_OutSync, SyncTime * 80000, 2); // timer allows us to sync with camera module 
-	
-	Camera_HardwareReset(); // good idea to send out a reset signal at the beginning of initialization
-	UART_InData(); 					// this UART_InData() tries to catch an ACK signal 
 	LCD_WriteString("Syncing... \n"); 
-	uint8_t SyncFailureCounter = 0; 
-	while (array[0] != 0xAA || array[1] != 0x0E || array[2] != 0x0D || array[4] != 0x00 || array[5] != 0x00) { 
-		UART_InData();  
-		++SyncFailureCounter; 
-		if (SyncFailureCounter == 10) { 
-			Camera_HardwareReset(); 
-			SyncFailureCounter = 0; 
-		}
-	} 
-	// once we've gotten here, we've read our ACK signal, and can stop sending sync signals: 
-	Timer1A_Stop(); 
-	
-	// reading our CAMERA'S SYNC signal: 
-	UART_InData(); 
-	// analyze sync signal sent from camera
-	if (array[0] != 0xAA || array[1] != 0x0D || array[2] != 0x00 || array[3] != 0x00 || array[4] != 0x00 || array[5] != 0x00) { 
+	char message[48]; 
+	if (!UART_Sync(UART_SYNC_TIMEOUT_MS)) { 
 		LCD_Clear(); 
 		LCD_WriteString("Sync has gone wrong. Please shut down system.\n"); 
 		while (1) {} 
-	}		
+	}
+	sprintf(message, "Synced in %lu ms, %lu SYNCs, %lu resets\n", (unsigned long)UART_SyncMs, 
+		(unsigned long)UART_SyncAttempts, (unsigned long)UART_SyncResets); 
+	LCD_WriteString(message); 
+	
+	// raw frames are most of our shot-to-shot time, so get the link as fast as the wiring allows 
+	if (UART_NegotiateBaud() == 0) { 
+		// camera got lost switching rates and was reset, sync again and stay at 115200 
+		LCD_WriteString("Baud rate negotiation failed, staying at 115200\n"); 
+		if (!UART_Sync(UART_SYNC_TIMEOUT_MS)) { 
+			LCD_WriteString("Sync has gone wrong. Please shut down system.\n"); 
+			while (1) {} 
+		}
+	}
 	
-	UART_OutACK(); 
+	sprintf(message, "Camera link at %lu baud\n", (unsigned long)UART_Baud); 
+	LCD_WriteString(message); 
+	sprintf(message, "Display link at %lu baud\n", (unsigned long)LCD_Baud); 
+	LCD_WriteString(message); 
 	LCD_WriteString("Successful Initialize Routine\n"); 
 	
 }
@@ -361,33 +281,12 @@ void Initialize_Camera_Routine() {
 
 
 void Take_Photo_Routine() { 
-	// define the parameters of photo 
-	UART_OutInitial(); 
-	
-	// define size of image 
-	UART_OutPackageSize(); 
-	
-	// take snapshot
-	UART_OutSnapshot(); 
-	
-	for (int z = 0; z < 800000; ++z) {} // 100 ms delay to allow camera to chill 
-		
-	UART_OutGetPic(); 
-	
-	for (int z = 0; z < 800000; ++z) {} // 100 ms delay to allow camera to chill 
-	
-	// get the number of 512-byte transfers: 
-	UART_InData(); 
-	if (array[0] != 0xAA || array[1] != 0x0A || array[2] != 0x02) {
-		LCD_Clear(); 
-		LCD_WriteString("Transferring has gone wrong. Please shut down system. \n"); 
-		while (1) {} 
-	} 
-	int32_t NUM_BYTES = (((array[5] & 0xFF) << 16) + ((array[4] & 0xFF) << 8) + array[3]);  
-	int32_t NUM_TRANSFERS = NUM_BYTES / 512;  
-	
 	/**** set up lcd sd card ****/ 
 	LCD_MediaInit(); 
+	if (ImageLog_Open(PHOTO_LOG_SECTOR, PHOTO_LOG_SLOTS, LCD_WriteSectorAt, LCD_ReadSectorAt, LCD_FlushMedia) == IMAGELOG_UNREADABLE) { 
+		LCD_WriteString("Unable to read the photo log \n"); 
+	}
+	if (ImageLog_Torn) LCD_WriteString("Last photo was cut short, it is left out \n"); 
 	
 	// upon testing, seems like there will be about 75 transfers. we're going to have to populate 512 byte array, and send it off. 
 	// not enough space to have x9600 bytes on our tm4c all at the same time. 
@@ -395,47 +294,33 @@ void Take_Photo_Routine() {
 	
 	LCD_WriteString("Beginning transfer now \n");
 	
-	LCD_SetSectorAddress(0); 
-	UART_OutCUSTOMACK(0); 
-	
-	for (int z = 0; z < 800000; ++z) {} // 100 ms delay to allow camera to chill
-	
-	UART_InNBytes(512); 
-		
-	LCD_WriteSector(image_array);
-	
-	LCD_SetSectorAddress(0); 
-	
-	/*
-	uint16_t current_package_number = 0; 
-	LCD_SetSectorAddress(0); 
-	int32_t num_bytes_left = NUM_BYTES; 
-	while (current_package_number < NUM_TRANSFERS) { 
-		UART_OutCUSTOMACK(current_package_number); 
-		
-		for (int z = 0; z < 800000; ++z) {} // 100 ms delay to allow camera to chill 
-		
-		if (num_bytes_left >= 512) { 
-			UART_InNBytes(512); // populating image array 
-		}	else { 
-			UART_InNBytes(num_bytes_left);
-		}					
-		
-		// now write to sector in SD card: 	
-		LCD_WriteSector(image_array); 
-		LCD_FlushMedia(); 
-		
-		++current_package_number; 
-		num_bytes_left -= 512; 
-		
-		// and then finally: clear image array in order to be ready for next transfer 
-		for (uint16_t k = 0; k < 512; ++k) {  
-			image_array[k] = 0; 
-		}
+	// the camera state machine sends each command the moment the last one is ACKed, and 
+	// packages stream in over uDMA while the previous one goes out to the sd card. 
+	// SectorBuffer packs them into whole sectors of the log's next slot, and the header with the exact 
+	// length goes in after them. sector writes are queued, so a package is handed off as soon as it is copied out 
+	uint32_t errors = LCD_ReplyErrors + LCD_Timeouts; 
+	uint32_t picture = ImageLog_Begin(CAMERA_RAW, PHOTO_WIDTH, PHOTO_HEIGHT); 
+	Camera_StartCapture(SectorBuffer_Write); 
+	uint32_t status; 
+	while ((status = Camera_Poll()) == CAMERA_BUSY) {} 
+	uint32_t logged = (status == CAMERA_DONE) && ImageLog_Close(TimeBase_Ms()); 
+	LCD_FlushMedia(); // waits for the queued writes to be ACKed too 
+	if (LCD_ReplyErrors + LCD_Timeouts != errors) LCD_WriteString("Write Media Attempt Failed \n"); 
+	
+	LCD_SetSectorAddress(picture); // picture starts after the header 
+	
+	if (status == CAMERA_ERROR) { 
+		LCD_WriteString("Take Photo Failed \n"); 
+		return; 
+	}
+	if (!logged) { 
+		LCD_WriteString("Saving Photo Failed, not in the log \n"); // too big for its slot, or no log open 
+		return; 
 	}
-	*/ 
 	
-	LCD_WriteString("Take Photo Success \n");
+	char message[48]; 
+	sprintf(message, "Take Photo Success %lu ms, photo %lu\n", (unsigned long)Camera_CaptureMs, (unsigned long)ImageLog_Next - 1); 
+	LCD_WriteString(message);
 	
 }
 
@@ -445,7 +330,10 @@ void sdcard_camera_main5() {
 	Unified_Port_Init(); // initialize all ports 
 	LCD_UART_Init(); // initialize lcd communication 
 	UART_Init(); 		// initialize camera communication 
+	DMA_UART_Enable(); // camera packages come in over uDMA channel 18 
+	TimeBase_Init(); 			// millisecond clock for camera timeouts 
 	EnableInterrupts(); 
+	LCD_NegotiateBaud(); 	// display link up from 9600, every sector write is that much shorter 
 	
 	// Clear the screen at start: 
 	LCD_Clear(); 
@@ -466,6 +354,373 @@ void sdcard_camera_main5() {
 	
 }
 
+#define PREVIEW_FRAMES 320 
+#define PREVIEW_WIDTH 80 
+#define PREVIEW_HEIGHT 60 
+
+void Viewfinder_Routine() { 
+	// frames are blitted straight to the screen as the packages come in, the sd card never sees them. 
+	// every time a frame is done the camera is already working on the next one 
+	LCD_BlitOpen(20, 20, PREVIEW_WIDTH, PREVIEW_HEIGHT); 
+	Camera_StartPreview(LCD_BlitWrite); 
+	uint32_t status; 
+	char message[40]; 
+	while ((status = Camera_Poll()) == CAMERA_BUSY || status == CAMERA_FRAME) { 
+		if (status == CAMERA_BUSY) continue; 
+		LCD_BlitClose(); 
+		if ((Camera_Frames % CAMERA_FPS_FRAMES) == 0) { 
+			sprintf(message, "%lu.%lu fps\n", (unsigned long)Camera_Fps10/10, (unsigned long)Camera_Fps10%10); 
+			LCD_WriteString(message); 
+		}
+		if (Camera_Frames >= PREVIEW_FRAMES) Camera_StopPreview(); // a frame still on its way gets dropped 
+		else LCD_BlitOpen(20, 20, PREVIEW_WIDTH, PREVIEW_HEIGHT); 
+	}
+	LCD_BlitClose(); 
+	
+	if (status == CAMERA_ERROR) LCD_WriteString("Viewfinder Failed \n"); 
+}
+
+// viewfinder test: live 80x60 preview on the display with a frame rate readout 
+void viewfinder_main6() { 
+	DisableInterrupts();
+	PLL_Init(Bus80MHz);  
+	Unified_Port_Init(); 
+	LCD_UART_Init(); 
+	UART_Init(); 
+	DMA_UART_Enable(); 
+	TimeBase_Init(); 
+	EnableInterrupts(); 
+	LCD_NegotiateBaud(); 
+	
+	LCD_Clear(); 
+	Initialize_Camera_Routine(); 
+	Viewfinder_Routine(); 
+}
+
+// armed camera: SW1 on the launchpad (PF4, low while pressed) takes a picture with nothing but SNAPSHOT and GET PICTURE 
+// between the press and the shot. the camera is kept alive (and re-synced if it drops off) 
+// while we wait, and every shot reports its shutter lag 
+void Armed_Routine() { 
+	LCD_MediaInit(); 
+	if (ImageLog_Open(PHOTO_LOG_SECTOR, PHOTO_LOG_SLOTS, LCD_WriteSectorAt, LCD_ReadSectorAt, LCD_FlushMedia) == IMAGELOG_UNREADABLE) { 
+		LCD_WriteString("Unable to read the photo log \n"); 
+	}
+	Camera_Arm(); 
+	char message[40]; 
+	uint32_t status; 
+	while (1) { 
+		status = Camera_Poll(); 
+		if (status == CAMERA_ERROR) LCD_WriteString("Camera lost, re-arming \n"); 
+		if (status != CAMERA_ARMED || (SW1 & 0x10) != 0) continue; 
+		
+		uint32_t picture = ImageLog_Begin(CAMERA_RAW, PHOTO_WIDTH, PHOTO_HEIGHT); 
+		Camera_Shoot(SectorBuffer_Write); 
+		while ((status = Camera_Poll()) == CAMERA_BUSY) {} 
+		uint32_t logged = (status == CAMERA_DONE) && ImageLog_Close(TimeBase_Ms()); 
+		LCD_FlushMedia(); 
+		if (logged) { 
+			LCD_SetSectorAddress(picture); // picture starts after the header 
+			LCD_DisplayImage(20, 20); 
+			sprintf(message, "lag %lu us, %lu ms\n", (unsigned long)Camera_ShutterUs, (unsigned long)Camera_CaptureMs); 
+			LCD_WriteString(message); 
+		}
+		else if (status == CAMERA_DONE) LCD_WriteString("Saving Photo Failed, not in the log \n"); 
+		else LCD_WriteString("Take Photo Failed \n"); 
+		while ((SW1 & 0x10) == 0) { Camera_Poll(); } // wait for the switch to be let go 
+	}
+}
+
+// armed camera test: sync and negotiate once, then shoot on every press of SW1 
+void armed_main7() { 
+	DisableInterrupts();
+	PLL_Init(Bus80MHz);  
+	Unified_Port_Init(); 
+	LCD_UART_Init(); 
+	UART_Init(); 
+	DMA_UART_Enable(); 
+	TimeBase_Init(); 
+	EnableInterrupts(); 
+	LCD_NegotiateBaud(); 
+	
+	LCD_Clear(); 
+	Initialize_Camera_Routine(); 
+	Armed_Routine(); 
+}
+
+#define BURST_FRAMES 8 
+
+// burst: BURST_FRAMES pictures back to back, each in the next slot of the photo log (header 
+// carries the log's sequence number and the frame's snapshot time), then the frame rate 
+void Burst_Routine() { 
+	LCD_MediaInit(); 
+	if (ImageLog_Open(PHOTO_LOG_SECTOR, PHOTO_LOG_SLOTS, LCD_WriteSectorAt, LCD_ReadSectorAt, LCD_FlushMedia) == IMAGELOG_UNREADABLE) { 
+		LCD_WriteString("Unable to read the photo log \n"); 
+	}
+	
+	ImageLog_Begin(CAMERA_RAW, PHOTO_WIDTH, PHOTO_HEIGHT); 
+	Camera_StartBurst(BURST_FRAMES, SectorBuffer_Write); 
+	uint32_t status; 
+	uint32_t unlogged = 0; // frames ImageLog_Close left out, their slots get the next frame 
+	while ((status = Camera_Poll()) == CAMERA_BUSY || status == CAMERA_FRAME) { 
+		if (status == CAMERA_BUSY) continue; 
+		// frame is in, the camera is already taking the next one. closing it waits for one media flush 
+		if (!ImageLog_Close(Camera_FrameMs)) ++unlogged; 
+		ImageLog_Begin(CAMERA_RAW, PHOTO_WIDTH, PHOTO_HEIGHT); 
+	}
+	if (status == CAMERA_DONE && !ImageLog_Close(Camera_FrameMs)) ++unlogged; 
+	LCD_FlushMedia(); 
+	
+	char message[48]; 
+	if (status == CAMERA_ERROR) sprintf(message, "Burst Failed after %lu frames\n", (unsigned long)Camera_Frames); 
+	else sprintf(message, "%lu frames, %lu.%lu fps\n", (unsigned long)Camera_Frames, 
+		(unsigned long)Camera_Fps10/10, (unsigned long)Camera_Fps10%10); 
+	LCD_WriteString(message); 
+	if (unlogged) { 
+		sprintf(message, "Saving Photo Failed, %lu not in the log \n", (unsigned long)unlogged); 
+		LCD_WriteString(message); 
+	}
+}
+
+// burst test: sync and negotiate, then one burst 
+void burst_main8() { 
+	DisableInterrupts();
+	PLL_Init(Bus80MHz);  
+	Unified_Port_Init(); 
+	LCD_UART_Init(); 
+	UART_Init(); 
+	DMA_UART_Enable(); 
+	TimeBase_Init(); 
+	EnableInterrupts(); 
+	LCD_NegotiateBaud(); 
+	
+	LCD_Clear(); 
+	Initialize_Camera_Routine(); 
+	Burst_Routine(); 
+}
+
+// a JPEG straight into the next free IMG_nnnn.JPG on the display's card, nothing buffered 
+void Save_Photo_Routine() { 
+	LCD_MediaInit(); 
+	LCD_FileMount(); 
+	
+	Camera_SetFormat(CAMERA_JPEG, CAMERA_JPEG_640x480); 
+	if (!LCD_FileStreamOpen("JPG")) { 
+		LCD_WriteString("Unable to open a file \n"); 
+		return; 
+	}
+	Camera_StartCapture(LCD_FileStreamWrite); 
+	uint32_t status; 
+	while ((status = Camera_Poll()) == CAMERA_BUSY) {} 
+	uint32_t closed = LCD_FileStreamClose(); 
+	
+	char message[48]; 
+	if (status == CAMERA_ERROR) sprintf(message, "Take Photo Failed \n"); 
+	else if (!closed) sprintf(message, "Saving %s Failed \n", LCD_FileName); 
+	else sprintf(message, "%s, %lu bytes, %lu ms\n", LCD_FileName, (unsigned long)LCD_FileLength, (unsigned long)Camera_CaptureMs); 
+	LCD_WriteString(message); 
+}
+
+// file test: sync and negotiate, then save one photo as a file 
+void file_camera_main9() { 
+	DisableInterrupts();
+	PLL_Init(Bus80MHz);  
+	Unified_Port_Init(); 
+	LCD_UART_Init(); 
+	UART_Init(); 
+	DMA_UART_Enable(); 
+	TimeBase_Init(); 
+	FileCounter_Init(); // the picture counter, read once 
+	EnableInterrupts(); 
+	LCD_NegotiateBaud(); 
+	
+	LCD_Clear(); 
+	Initialize_Camera_Routine(); 
+	Save_Photo_Routine(); 
+}
+
+#define GALLERY_WIDTH  160 
+#define GALLERY_HEIGHT 120 
+
+// the store callback for gallery photos: the file gets the picture, the thumbnail gets a look at it on the way 
+static void Store_Photo(uint8_t *data, uint32_t length) { 
+	LCD_FileStreamWrite(data, length); 
+	Thumbnail_Write(data, length); 
+}
+
+// take a RAW photo into IMG_nnnn.RAW with its thumbnail in slot nnnn, then show the gallery a page 
+// at a time, SW1 stepping to the next page (back to the first after the last one) 
+void Gallery_Routine() { 
+	LCD_MediaInit(); 
+	LCD_FileMount(); 
+	
+	Camera_SetFormat(CAMERA_RAW, CAMERA_RAW_160x120); 
+	if (LCD_FileStreamOpen("RAW")) { 
+		Thumbnail_Open(GALLERY_WIDTH, GALLERY_HEIGHT); 
+		Camera_StartCapture(Store_Photo); 
+		uint32_t status; 
+		while ((status = Camera_Poll()) == CAMERA_BUSY) {} 
+		if (!LCD_FileStreamClose() || status == CAMERA_ERROR) LCD_WriteString("Take Photo Failed \n"); 
+		else Thumbnail_Close(LCD_FileNumber, LCD_WriteSectorAt); 
+		LCD_FlushMedia(); 
+	}
+	
+	uint32_t handed = FileCounter_Peek(); // every number below it has been handed out, not all with a thumbnail 
+	uint32_t count = (handed < THUMB_SLOTS) ? handed : THUMB_SLOTS; // names come round after THUMB_SLOTS 
+	uint32_t pages = (count + THUMB_PER_PAGE - 1)/THUMB_PER_PAGE; 
+	uint32_t page = (handed > 0) ? ((handed - 1) % THUMB_SLOTS)/THUMB_PER_PAGE : 0; // the newest photo's page first 
+	char message[32]; 
+	while (pages > 0) { 
+		LCD_Clear(); 
+		Thumbnail_Gallery(page, count, LCD_ReadSectorAt, LCD_QueueImage); 
+		sprintf(message, "page %lu of %lu\n", (unsigned long)page + 1, (unsigned long)pages); 
+		LCD_WriteString(message); 
+		while ((SW1 & 0x10) != 0) {} // wait for SW1 
+		while ((SW1 & 0x10) == 0) {} 
+		page = (page + 1) % pages; 
+	}
+}
+
+// gallery test: sync and negotiate, one photo, then page through the thumbnails 
+void gallery_main10() { 
+	DisableInterrupts();
+	PLL_Init(Bus80MHz);  
+	Unified_Port_Init(); 
+	LCD_UART_Init(); 
+	UART_Init(); 
+	DMA_UART_Enable(); 
+	TimeBase_Init(); 
+	FileCounter_Init(); // the picture counter, read once 
+	EnableInterrupts(); 
+	LCD_NegotiateBaud(); 
+	
+	LCD_Clear(); 
+	Initialize_Camera_Routine(); 
+	Gallery_Routine(); 
+}
+
+#define SDCARD_WIDTH  160 
+#define SDCARD_HEIGHT 120 
+
+// same photo as Take_Photo_Routine, but onto the SPI SD card: one pre-erased multi-block write 
+// instead of a set sector address and a sector write over the display link per sector. 
+// the log goes through the sector cache, so the picture reaches the card SECTOR_CACHE_ENTRIES 
+// sectors at a time, each lot carrying on the same multi-block write 
+void SD_Photo_Routine() { 
+	if (!SDCard_Init()) { 
+		LCD_WriteString("No SD card on SSI0 \n"); 
+		return; 
+	}
+	char message[48]; 
+	sprintf(message, "SD card at %lu kHz%s\n", 80000UL/SDCard_Divisor, SDCard_Tuned ? "" : " (not tuned)"); 
+	LCD_WriteString(message); 
+	SectorCache_Init(SDCard_WriteSectorAt, SDCard_ReadSectorAt, SDCard_Flush); 
+	ImageLog_Open(PHOTO_LOG_SECTOR, PHOTO_LOG_SLOTS, SectorCache_WriteSectorAt, SectorCache_ReadSectorAt, SectorCache_Sync); 
+	SectorCache_Keep(PHOTO_LOG_SECTOR); 
+	SectorCache_Sync(); // a new log's sector goes down before any picture 
+	Camera_SetFormat(CAMERA_RAW, CAMERA_RAW_160x120); 
+	SDCard_Reserve((SDCARD_WIDTH*SDCARD_HEIGHT*2 + 511)/512); // the picture's sectors, the header comes later 
+	uint32_t errors = SDCard_Errors; 
+	ImageLog_Begin(CAMERA_RAW, SDCARD_WIDTH, SDCARD_HEIGHT); 
+	Camera_StartCapture(SectorBuffer_Write); 
+	uint32_t status; 
+	while ((status = Camera_Poll()) == CAMERA_BUSY) {} 
+	uint32_t logged = (status == CAMERA_DONE) && ImageLog_Close(TimeBase_Ms()); // syncs the picture, then writes its header 
+	SectorCache_Sync(); 
+	
+	if (status == CAMERA_ERROR) sprintf(message, "Take Photo Failed \n"); 
+	else if (!logged) sprintf(message, "Saving Photo Failed, not in the log \n"); 
+	else if (SDCard_Errors != errors) sprintf(message, "Write Media Attempt Failed \n"); 
+	else sprintf(message, "Take Photo Success %lu ms, photo %lu\n", (unsigned long)Camera_CaptureMs, (unsigned long)ImageLog_Next - 1); 
+	LCD_WriteString(message); 
+	sprintf(message, "cache %lu hits, %lu misses, %lu flushes\n", (unsigned long)SectorCache_Hits, 
+		(unsigned long)SectorCache_Misses, (unsigned long)SectorCache_Flushes); 
+	LCD_WriteString(message); 
+}
+
+// SPI SD card test: display for messages only, photo onto the card on SSI0 
+void sdspi_camera_main11() { 
+	DisableInterrupts();
+	PLL_Init(Bus80MHz);  
+	Unified_Port_Init(); 
+	LCD_UART_Init(); 
+	UART_Init(); 
+	DMA_UART_Enable(); // also sets up the uDMA controller the card's writes use 
+	TimeBase_Init(); 
+	EnableInterrupts(); 
+	LCD_NegotiateBaud(); 
+	
+	LCD_Clear(); 
+	Initialize_Camera_Routine(); 
+	SD_Photo_Routine(); 
+}
+
+// a RAW photo into IMG_nnnn.RAW on a FAT32 card on SSI0, readable on a pc straight out of the camera. 
+// the file's clusters are set aside up front, so the picture is one pre-erased multi-block write, 
+// and the FAT and directory are only written once it is all on the card. 
+// not the same card as the photo log: the log's slots sit on top of where a file system would be 
+void SD_File_Routine() { 
+	if (!SDCard_Init()) { 
+		LCD_WriteString("No SD card on SSI0 \n"); 
+		return; 
+	}
+	SectorCache_Init(SDCard_WriteSectorAt, SDCard_ReadSectorAt, SDCard_Flush); 
+	if (Fat32_Mount(SDCard_WriteSectorAt) != FAT32_OK) { 
+		LCD_WriteString("No FAT32 on the SD card \n"); 
+		return; 
+	}
+	// next number from the EEPROM counter, past anything a pc (or an earlier round of names) left on the card 
+	char name[16]; 
+	uint32_t number = FileCounter_Peek(); 
+	uint32_t probes; 
+	for (probes = 0; probes < FILE_NUMBERS; ++probes, ++number) { 
+		sprintf(name, "IMG_%04lu.RAW", (unsigned long)(number % FILE_NUMBERS)); 
+		if (!Fat32_Exists(name)) break; 
+	}
+	if (probes >= FILE_NUMBERS) { 
+		LCD_WriteString("No free IMG_ name on the SD card \n"); 
+		return; 
+	}
+	FileCounter_Set(number + 1); // the name is taken now, whatever happens to the picture 
+	
+	char message[48]; 
+	uint32_t result = Fat32_Create(name, SDCARD_WIDTH*SDCARD_HEIGHT*2); 
+	if (result != FAT32_OK) { 
+		sprintf(message, "Creating %s Failed (%lu)\n", name, (unsigned long)result); 
+		LCD_WriteString(message); 
+		return; 
+	}
+	Camera_SetFormat(CAMERA_RAW, CAMERA_RAW_160x120); 
+	SDCard_Reserve(Fat32_Reserved); 
+	uint32_t errors = SDCard_Errors; 
+	Camera_StartCapture(Fat32_Write); 
+	uint32_t status; 
+	while ((status = Camera_Poll()) == CAMERA_BUSY) {} 
+	result = (status == CAMERA_DONE) ? Fat32_Close() : FAT32_OK; 
+	
+	if (status == CAMERA_ERROR) sprintf(message, "Take Photo Failed \n"); // the file was never closed, nothing points at it 
+	else if (result != FAT32_OK || SDCard_Errors != errors) sprintf(message, "Saving %s Failed \n", name); 
+	else sprintf(message, "%s, %lu bytes, %lu ms\n", name, (unsigned long)Fat32_Length, (unsigned long)Camera_CaptureMs); 
+	LCD_WriteString(message); 
+}
+
+// FAT32 SD card test: display for messages only, photo into a file on the card on SSI0 
+void sdfat_camera_main12() { 
+	DisableInterrupts();
+	PLL_Init(Bus80MHz);  
+	Unified_Port_Init(); 
+	LCD_UART_Init(); 
+	UART_Init(); 
+	DMA_UART_Enable(); 
+	TimeBase_Init(); 
+	FileCounter_Init(); // the picture counter, read once 
+	EnableInterrupts(); 
+	LCD_NegotiateBaud(); 
+	
+	LCD_Clear(); 
+	Initialize_Camera_Routine(); 
+	SD_File_Routine(); 
+}
+
 int main() { 
 	sdcard_camera_main5(); 
 	
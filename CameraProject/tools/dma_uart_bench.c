@@ -0,0 +1,96 @@
+// dma_uart_bench.c
+// runs the DMA_UART.c receive engine against the UART4/uDMA model in sim/ and reports
+// how many picture bytes per second the capture loop gets through, compared to the old
+// polled loop (CUSTOMACK, 100 ms wait, UART_InNBytes, store, clear image_array).
+// build (from CameraProject):
+//   gcc -O2 -no-pie -DHOST_SIM -I. -o dma_uart_bench tools/dma_uart_bench.c tools/sim/tm4c_sim.c DMA_UART.c
+// usage: ./dma_uart_bench [camera baud] [picture bytes]
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "DMA_UART.h"
+
+#define STORE_OVERHEAD 5   // command and ack bytes around every sector write on the display link
+
+static uint8_t Picture[640*480*2];
+static uint8_t Stored[640*480*2];
+
+// on the board this is in UART.c, which also queues command replies
+void UART4_Handler(void) {
+	if (UDMA_CHIS_R & 0x00040000) DMA_UART_Handler();
+}
+
+// what storing one package costs: sector write over the display's serial link
+static uint64_t StoreCycles(uint32_t length, uint32_t store_baud) {
+	if (store_baud == 0) return 0; // display/copy only
+	return (uint64_t)(length + STORE_OVERHEAD)*Sim_ByteCycles(store_baud);
+}
+
+// legacy loop from main.c: one package at a time, nothing overlaps
+static double Polled(uint32_t length, uint32_t baud, uint32_t store_baud) {
+	uint64_t cycles = 0;
+	for (uint32_t offset = 0; offset < length; offset += DMA_UART_BUFFER_SIZE) {
+		uint32_t n = length - offset;
+		if (n > DMA_UART_BUFFER_SIZE) n = DMA_UART_BUFFER_SIZE;
+		cycles += 6*Sim_ByteCycles(baud);     // UART_OutCUSTOMACK
+		cycles += SIM_BUS_CLOCK/10;            // "100 ms delay to allow camera to chill"
+		cycles += n*Sim_ByteCycles(baud);     // UART_InNBytes
+		cycles += StoreCycles(n, store_baud); // LCD_WriteSector
+		cycles += 512*4;                       // clearing image_array byte by byte
+	}
+	return (double)length*SIM_BUS_CLOCK/cycles;
+}
+
+// ping-pong engine, camera packages requested as buffers free up
+static double Engine(uint32_t length, uint32_t baud, uint32_t store_baud, double *host_ns) {
+	struct timespec t0, t1;
+	Sim_Reset();
+	DMA_UART_Enable();
+	Sim_Camera_Load(Picture, length, DMA_UART_BUFFER_SIZE, baud);
+	memset(Stored, 0, length);
+	DMA_UART_RxStalls = 0;
+	clock_gettime(CLOCK_MONOTONIC, &t0);
+	DMA_UART_RxStart(length, Sim_Camera_Request, 2);
+	uint32_t offset = 0;
+	while (!DMA_UART_RxDone()) {
+		uint32_t n;
+		uint8_t *package = DMA_UART_RxGet(&n);
+		if (package == 0) { // nothing ready, wait for the next byte like WaitForInterrupt would
+			Sim_Advance(Sim_ByteCycles(baud));
+			continue;
+		}
+		memcpy(&Stored[offset], package, n);
+		offset += n;
+		Sim_Advance(StoreCycles(n, store_baud));
+		DMA_UART_RxRelease();
+	}
+	clock_gettime(CLOCK_MONOTONIC, &t1);
+	*host_ns = (t1.tv_sec - t0.tv_sec)*1e9 + (t1.tv_nsec - t0.tv_nsec);
+	if (offset != length || memcmp(Stored, Picture, length) != 0 || Sim_UART4_Overruns) {
+		printf("  data mismatch: %u of %u bytes, %u overruns\n", offset, length, Sim_UART4_Overruns);
+	}
+	return (double)length*SIM_BUS_CLOCK/Sim_Cycles;
+}
+
+int main(int argc, char **argv) {
+	uint32_t baud = (argc > 1) ? strtoul(argv[1], 0, 0) : 115200;
+	uint32_t length = (argc > 2) ? strtoul(argv[2], 0, 0) : 160*120*2;
+	static const uint32_t store_bauds[] = {9600, 115200, 921600, 0};
+	if (length > sizeof(Picture)) length = sizeof(Picture);
+	for (uint32_t i = 0; i < length; ++i) Picture[i] = (uint8_t)(i*7 + (i>>8));
+
+	printf("camera link %u baud, %u byte picture, %u buffers of %u bytes\n",
+		baud, length, DMA_UART_NUM_BUFFERS, DMA_UART_BUFFER_SIZE);
+	printf("%-12s %14s %14s %8s %12s\n", "storage", "polled B/s", "ping-pong B/s", "stalls", "host ns/B");
+	for (uint32_t i = 0; i < sizeof(store_bauds)/sizeof(store_bauds[0]); ++i) {
+		double host_ns;
+		double polled = Polled(length, baud, store_bauds[i]);
+		double engine = Engine(length, baud, store_bauds[i], &host_ns);
+		char name[16];
+		if (store_bauds[i]) snprintf(name, sizeof(name), "%u", store_bauds[i]);
+		else snprintf(name, sizeof(name), "none");
+		printf("%-12s %14.0f %14.0f %8u %12.2f\n", name, polled, engine, DMA_UART_RxStalls, host_ns/length);
+	}
+	return 0;
+}
@@ -0,0 +1,99 @@
+// fat32_copy.c
+// copies files into the root directory of a FAT32 card image with Fat32.c, the same code
+// (and the same SectorCache in front of it) the camera writes pictures with, so a card image
+// made on a PC can be checked with fsck.fat and mtools afterwards
+// build (from CameraProject):
+//   gcc -O2 -I. -o fat32_copy tools/fat32_copy.c Fat32.c SectorCache.c
+// usage: ./fat32_copy card.img file...   (each file goes in under its own name, which has to be 8.3)
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "Fat32.h"
+#include "SectorCache.h"
+
+#define SECTOR_SIZE 512
+
+static FILE *Card;
+static uint32_t DataWrites, MetaWrites, Reads, Seeks;
+static uint32_t LastData = 0xFFFFFFFF;
+
+static void WriteSector(uint32_t sector, uint8_t *data) {
+	fseeko(Card, (off_t)sector*SECTOR_SIZE, SEEK_SET);
+	fwrite(data, 1, SECTOR_SIZE, Card);
+}
+
+// picture data, counting the times the card would have had to start a new multi-block write
+static void WriteData(uint32_t sector, uint8_t *data) {
+	if (sector != LastData + 1) ++Seeks;
+	LastData = sector;
+	++DataWrites;
+	WriteSector(sector, data);
+}
+
+static void WriteMeta(uint32_t sector, uint8_t *data) {
+	++MetaWrites;
+	WriteSector(sector, data);
+}
+
+static uint32_t ReadSector(uint32_t sector, uint8_t *data) {
+	++Reads;
+	if (fseeko(Card, (off_t)sector*SECTOR_SIZE, SEEK_SET) != 0) return 0;
+	return fread(data, 1, SECTOR_SIZE, Card) == SECTOR_SIZE;
+}
+
+static void Flush(void) {
+	fflush(Card);
+}
+
+int main(int argc, char **argv) {
+	if (argc < 3) {
+		fprintf(stderr, "usage: %s card.img file...\n", argv[0]);
+		return 2;
+	}
+	Card = fopen(argv[1], "r+b");
+	if (Card == 0) {
+		perror(argv[1]);
+		return 1;
+	}
+	SectorCache_Init(WriteMeta, ReadSector, Flush);
+	if (Fat32_Mount(WriteData) != FAT32_OK) {
+		fprintf(stderr, "no FAT32 file system on %s\n", argv[1]);
+		return 1;
+	}
+	int failed = 0;
+	for (int i = 2; i < argc; ++i) {
+		FILE *in = fopen(argv[i], "rb");
+		if (in == 0) {
+			perror(argv[i]);
+			failed = 1;
+			continue;
+		}
+		fseeko(in, 0, SEEK_END);
+		uint32_t size = ftello(in);
+		rewind(in);
+		const char *name = strrchr(argv[i], '/');
+		name = name ? name + 1 : argv[i];
+		DataWrites = MetaWrites = Reads = Seeks = 0;
+		LastData = 0xFFFFFFFF;
+		uint32_t result = Fat32_Create(name, size);
+		if (result == FAT32_OK) {
+			printf("%-12s %8u bytes, %u sectors set aside in one run ", name, size, Fat32_Reserved);
+			// odd sized pieces, the way the camera's capture hands them over
+			uint8_t buffer[700];
+			size_t n;
+			while ((n = fread(buffer, 1, sizeof(buffer), in)) > 0) Fat32_Write(buffer, n);
+			result = Fat32_Close();
+		}
+		fclose(in);
+		if (result != FAT32_OK) {
+			printf("%-12s failed (%u)\n", name, result);
+			failed = 1;
+			continue;
+		}
+		printf("-> %u data sectors in %u runs, %u FAT/directory writes, %u reads\n", DataWrites, Seeks, MetaWrites, Reads);
+	}
+	printf("cache: %u hits, %u misses, %u write backs; %u free clusters\n",
+		SectorCache_Hits, SectorCache_Misses, SectorCache_WriteBacks, Fat32_FreeClusters);
+	fclose(Card);
+	return failed;
+}
@@ -0,0 +1,144 @@
+// imagelog_extract.c
+// pulls every picture out of the photo log (ImageLog.h) on a dump of the card
+// (dd if=/dev/sdX of=card.img, or just the raw area). RAW pictures come out as 24 bit BMPs,
+// JPEGs as they are. the end of the log is found with ImageLog_Find, the same search the
+// camera does, and every picture is checked against its header and data CRC32s before it is saved.
+// build (from CameraProject):
+//   gcc -O2 -I. -o imagelog_extract tools/imagelog_extract.c ImageLog.c SectorBuffer.c Pixel.c
+// usage: ./imagelog_extract card.img [log sector] [output prefix]
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "ImageLog.h"
+#include "SectorBuffer.h"
+#include "Camera.h"
+#include "Pixel.h"
+
+static FILE *Card;
+
+// ImageLog.c stamps new logs with the time, nothing here makes one
+uint32_t TimeBase_Us(void) {
+	return 0;
+}
+
+static uint32_t ReadSector(uint32_t sector, uint8_t *data) {
+	if (fseeko(Card, (off_t)sector*SECTOR_SIZE, SEEK_SET) != 0) return 0;
+	return fread(data, 1, SECTOR_SIZE, Card) == SECTOR_SIZE;
+}
+
+static void Put16(uint8_t *destination, uint32_t value) {
+	destination[0] = value & 0xFF;
+	destination[1] = (value >> 8) & 0xFF;
+}
+
+static void Put32(uint8_t *destination, uint32_t value) {
+	Put16(destination, value & 0xFFFF);
+	Put16(destination + 2, value >> 16);
+}
+
+// RGB565, high byte first, top row first -> bottom-up 24 bit BMP
+static int WriteBmp(const char *name, const uint8_t *pixels, uint32_t width, uint32_t height) {
+	uint32_t stride = (width*3 + 3) & ~3u;
+	uint8_t header[54] = {'B', 'M'};
+	Put32(&header[2], 54 + stride*height);
+	Put32(&header[10], 54);
+	Put32(&header[14], 40);
+	Put32(&header[18], width);
+	Put32(&header[22], height);
+	Put16(&header[26], 1);
+	Put16(&header[28], 24);
+	Put32(&header[34], stride*height);
+	FILE *out = fopen(name, "wb");
+	if (out == 0) return 0;
+	fwrite(header, 1, sizeof(header), out);
+	uint8_t *row = calloc(stride, 1);
+	for (uint32_t y = height; y-- > 0; ) {
+		Pixel_ToBgr(row, &pixels[y*width*2], width);
+		fwrite(row, 1, stride, out);
+	}
+	free(row);
+	return fclose(out) == 0;
+}
+
+static int WriteRaw(const char *name, const uint8_t *data, uint32_t length) {
+	FILE *out = fopen(name, "wb");
+	if (out == 0) return 0;
+	fwrite(data, 1, length, out);
+	return fclose(out) == 0;
+}
+
+int main(int argc, char **argv) {
+	if (argc < 2) {
+		fprintf(stderr, "usage: %s card.img [log sector] [output prefix]\n", argv[0]);
+		return 2;
+	}
+	uint32_t first = (argc > 2) ? strtoul(argv[2], 0, 0) : 0;
+	const char *prefix = (argc > 3) ? argv[3] : "photo";
+	Card = fopen(argv[1], "rb");
+	if (Card == 0) {
+		perror(argv[1]);
+		return 1;
+	}
+	if (!ImageLog_Find(first, ReadSector)) {
+		fprintf(stderr, "no photo log at sector %u\n", first);
+		return 1;
+	}
+	uint8_t log[SECTOR_SIZE];
+	ReadSector(first, log);
+	uint32_t id = SectorBuffer_Get32(&log[IMAGELOG_ID_OFFSET]);
+	uint32_t slots = SectorBuffer_Get32(&log[IMAGELOG_SLOTS_OFFSET]);
+	uint32_t oldest = (ImageLog_Next > slots) ? ImageLog_Next - slots : 0;
+	printf("log %08X, %u slots, %u pictures written, end found in %u reads\n", id, slots, ImageLog_Next, ImageLog_Reads);
+	if (ImageLog_Torn) printf("picture %u was cut short (header without its data), left out\n", ImageLog_Next);
+
+	uint8_t *data = malloc((IMAGELOG_SLOT_SECTORS - 1)*SECTOR_SIZE);
+	uint32_t saved = 0;
+	for (uint32_t n = oldest; n < ImageLog_Next; ++n) {
+		uint8_t header[SECTOR_SIZE];
+		uint32_t sector = ImageLog_Sector(n);
+		printf("%6u ", n);
+		if (!ReadSector(sector, header) || !SectorBuffer_IsHeader(header)
+			|| SectorBuffer_Get32(&header[SECTOR_HEADER_LOG_OFFSET]) != id
+			|| SectorBuffer_Get32(&header[SECTOR_HEADER_SEQUENCE_OFFSET]) != n) {
+			printf("no header\n");
+			continue;
+		}
+		uint32_t length = SectorBuffer_Get32(&header[SECTOR_HEADER_LENGTH_OFFSET]);
+		uint32_t sectors = SectorBuffer_Get32(&header[SECTOR_HEADER_SECTORS_OFFSET]);
+		uint32_t format = SectorBuffer_Get32(&header[SECTOR_HEADER_FORMAT_OFFSET]);
+		uint32_t size = SectorBuffer_Get32(&header[SECTOR_HEADER_WIDTH_OFFSET]);
+		uint32_t width = size & 0xFFFF, height = size >> 16;
+		uint32_t ms = SectorBuffer_Get32(&header[SECTOR_HEADER_TIMESTAMP_OFFSET]);
+		printf("%-4s %3ux%-3u %7u bytes %9u ms ", (format == CAMERA_JPEG) ? "JPEG" : "RAW", width, height, length, ms);
+		if (sectors >= IMAGELOG_SLOT_SECTORS || length > sectors*SECTOR_SIZE) {
+			printf("bad length\n");
+			continue;
+		}
+		uint32_t i;
+		for (i = 0; i < sectors; ++i) {
+			if (!ReadSector(sector + 1 + i, &data[i*SECTOR_SIZE])) break;
+		}
+		if (i < sectors || SectorBuffer_Crc32(0, data, length) != SectorBuffer_Get32(&header[SECTOR_HEADER_CRC_OFFSET])) {
+			printf("CRC mismatch\n"); // torn by a power loss while the slot was being written again
+			continue;
+		}
+		char name[256];
+		int ok;
+		if (format == CAMERA_JPEG) {
+			snprintf(name, sizeof(name), "%s_%06u.jpg", prefix, n);
+			ok = WriteRaw(name, data, length);
+		} else if (width*height*2 <= length) {
+			snprintf(name, sizeof(name), "%s_%06u.bmp", prefix, n);
+			ok = WriteBmp(name, data, width, height);
+		} else {
+			snprintf(name, sizeof(name), "%s_%06u.raw", prefix, n); // short of pixels, keep the bytes
+			ok = WriteRaw(name, data, length);
+		}
+		printf("%s%s\n", name, ok ? "" : " (write failed)");
+		saved += ok;
+	}
+	printf("%u saved\n", saved);
+	free(data);
+	fclose(Card);
+	return 0;
+}
@@ -0,0 +1,683 @@
+// storage_sim.c
+// SD card on SSI0 and display on UART3, for running inc/eDisk.c, SDCard.c and LCD_UART.c on a pc.
+// only what those drivers rely on is modelled:
+//  - SSI0 exchanges a byte per data register write, 8 deep receive fifo that overruns,
+//    uDMA channel 11 feeding the transmit side (basic mode, the whole transfer at once)
+//  - the card answers the SPI mode commands eDisk uses (single block reads, single and
+//    multi-block writes, CRC mode, CID), holds DO low while it programs, and checks CRCs
+//  - UART3 with 16 byte fifos, fifo level and receive time-out interrupts on vector 59
+//  - the display runs one command at a time and answers after a fixed latency, at its own rate
+//  - EEPROM words, read and written through EERDWR
+#include <stdio.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include "tm4c_sim.h"
+#include "storage_sim.h"
+
+#define SECTOR      512
+#define US(n)       ((uint64_t)(n)*(SIM_BUS_CLOCK/1000000))
+#define BIT11       0x00000800
+#define CH11        (11*4)
+#define SPI_FIFO    8
+#define UART_FIFO   16
+#define OUT_MAX     (SECTOR + 16)   // most the card or the display owes at once
+#define UART3_IRQ   0x08000000      // interrupt 59, bit 27 of EN1
+#define UART_CTL_UARTEN 0x00000001
+#define UART_FR_TXFF    0x00000020
+#define UART_FR_RXFE    0x00000010
+#define UART_FR_BUSY    0x00000008
+#define UART_RXRIS      0x00000010
+#define UART_TXRIS      0x00000020
+#define UART_RTRIS      0x00000040
+#define EEPROM_WORDS    (32*16)
+
+Sim_StorageStats Sim_Storage;
+
+extern uint32_t ucControlTable[256];
+void UART3_Handler(void) __attribute__((weak)); // tools that only use the card don't link LCD_UART.c
+
+static uint16_t Crc16(const uint8_t *data, uint32_t length) {
+	uint16_t crc = 0;
+	while (length-- > 0) {
+		crc ^= (uint16_t)(*data++) << 8;
+		for (int i = 0; i < 8; ++i) crc = (crc & 0x8000) ? (crc << 1) ^ 0x1021 : crc << 1;
+	}
+	return crc;
+}
+
+// CRC7 of a command, shifted up with the stop bit, as it comes last in the packet
+static uint8_t Crc7(const uint8_t *data, uint32_t length) {
+	uint8_t crc = 0;
+	while (length-- > 0) {
+		uint8_t d = *data++;
+		for (int i = 0; i < 8; ++i) {
+			crc <<= 1;
+			if ((d ^ crc) & 0x80) crc ^= 0x09;
+			d <<= 1;
+		}
+	}
+	return (uint8_t)((crc << 1) | 0x01);
+}
+
+// a card or display image: made if it isn't there, grown to the size asked for
+static int OpenImage(const char *path, uint32_t sectors) {
+	int file = open(path, O_RDWR|O_CREAT, 0644);
+	if (file < 0) return -1;
+	off_t size = (off_t)sectors*SECTOR;
+	if (lseek(file, 0, SEEK_END) < size && ftruncate(file, size) != 0) {
+		close(file);
+		return -1;
+	}
+	return file;
+}
+
+// bytes owed to the other end, each ready at some time (and, for the display, sent at some rate)
+typedef struct {
+	uint8_t data[OUT_MAX];
+	uint64_t ready[OUT_MAX];
+	uint64_t cycles[OUT_MAX];
+	int get, put;
+} Queue;
+
+static void Queue_Clear(Queue *queue) {
+	queue->get = queue->put = 0;
+}
+
+static void Queue_Add(Queue *queue, uint8_t data, uint64_t ready, uint64_t cycles) {
+	if (queue->get == queue->put) queue->get = queue->put = 0;
+	if (queue->put == OUT_MAX) return;
+	queue->data[queue->put] = data;
+	queue->ready[queue->put] = ready;
+	queue->cycles[queue->put++] = cycles;
+}
+
+/*-------------------------------- SD card --------------------------------*/
+
+static Sim_SdConfig Sd;
+static int SdFile = -1;
+static enum { CARD_COMMAND, CARD_SINGLE, CARD_MULTI, CARD_DATA } CardState;
+static uint8_t Command[6];
+static int CommandLength;
+static int App;                  // the last command was CMD55
+static int Idle;                 // until ACMD41 has been going for init_us
+static int Initialising;
+static uint64_t InitStart;
+static int CrcMode;
+static int Multi;                // the block coming in belongs to a CMD25
+static uint32_t WriteSector;
+static uint32_t Erased;          // blocks still pre-erased by ACMD23
+static uint8_t Block[SECTOR + 2];
+static int BlockLength;
+static uint64_t Busy;            // programming until then, DO held low
+static Queue CardOut;
+
+static const uint8_t Cid[16] = { 0x03, 'S', 'D', 'S', 'I', 'M', '0', '1', 0x10, 0x12, 0x34, 0x56, 0x78, 0x01, 0x6A, 0x01 };
+
+static uint8_t SpiRx[SPI_FIFO];
+static int SpiCount, SpiGet;
+static int DmaActive;
+static uint64_t DmaDone;
+
+static uint32_t Eeprom[EEPROM_WORDS];
+static uint32_t EepromSlot;      // word EERDWR showed last
+static uint32_t EepromShown;     // and what it showed
+
+static uint32_t SpiKhz(void) {
+	uint32_t divisor = Sim_Regs[SIM_SSI0_CPSR] & SSI_CPSR_CPSDVSR_M;
+	uint32_t scr = (Sim_Regs[SIM_SSI0_CR0] & SSI_CR0_SCR_M) >> 8;
+	if (divisor < 2) divisor = 2;
+	return SIM_BUS_CLOCK/1000/(divisor*(1 + scr));
+}
+
+static uint64_t SpiByteCycles(void) {
+	uint32_t divisor = Sim_Regs[SIM_SSI0_CPSR] & SSI_CPSR_CPSDVSR_M;
+	uint32_t scr = (Sim_Regs[SIM_SSI0_CR0] & SSI_CR0_SCR_M) >> 8;
+	if (divisor < 2) divisor = 2;
+	return 8*(uint64_t)divisor*(1 + scr);
+}
+
+static void Reply(uint8_t data) {
+	Queue_Add(&CardOut, data, Sim_Cycles, 0);
+}
+
+// data token, data and CRC16, the first byte ready at ready. read too fast for the wiring,
+// a bit of the data comes back wrong (the CRC is of what the card meant to send)
+static void SendData(const uint8_t *data, uint32_t length, uint64_t ready) {
+	int garbled = Sd.max_khz && SpiKhz() > Sd.max_khz;
+	uint16_t crc = Crc16(data, length);
+	Queue_Add(&CardOut, 0xFE, ready, 0);
+	for (uint32_t i = 0; i < length; ++i) Queue_Add(&CardOut, (garbled && i == length/2) ? data[i] ^ 0x01 : data[i], ready, 0);
+	Queue_Add(&CardOut, crc >> 8, ready, 0);
+	Queue_Add(&CardOut, crc & 0xFF, ready, 0);
+}
+
+static void CardCommand(void) {
+	uint8_t cmd = Command[0] & 0x3F;
+	uint32_t arg = ((uint32_t)Command[1] << 24) | ((uint32_t)Command[2] << 16) | ((uint32_t)Command[3] << 8) | Command[4];
+	uint8_t r1 = Idle ? 0x01 : 0x00;
+	int app = App;
+	App = 0;
+	++Sim_Storage.sd_commands;
+	if ((CrcMode || cmd == 0 || cmd == 8) && Crc7(Command, 5) != Command[5]) {
+		++Sim_Storage.sd_crc_errors;
+		Reply(r1 | 0x08);
+		return;
+	}
+	switch (cmd) {
+	case 0:
+		Idle = 1;
+		Initialising = 0;
+		CrcMode = 0;
+		Reply(0x01);
+		break;
+	case 8:
+		Reply(r1);
+		Reply(0x00); Reply(0x00); Reply((arg >> 8) & 0x0F); Reply(arg & 0xFF);
+		break;
+	case 55:
+		App = 1;
+		Reply(r1);
+		break;
+	case 41:
+		if (!app) {
+			Reply(r1 | 0x04);
+			break;
+		}
+		if (!Initialising) {
+			Initialising = 1;
+			InitStart = Sim_Cycles;
+		}
+		if (Sim_Cycles - InitStart >= US(Sd.init_us)) Idle = 0;
+		Reply(Idle ? 0x01 : 0x00);
+		break;
+	case 58:
+		Reply(r1);
+		Reply(0xC0); Reply(0xFF); Reply(0x80); Reply(0x00); // powered up, block addressed
+		break;
+	case 59:
+		CrcMode = arg & 1;
+		Reply(r1);
+		break;
+	case 10:
+		Reply(r1);
+		SendData(Cid, sizeof(Cid), Sim_Cycles + US(Sd.access_us));
+		break;
+	case 17: {
+		uint8_t data[SECTOR];
+		if (arg >= Sd.sectors || pread(SdFile, data, SECTOR, (off_t)arg*SECTOR) != SECTOR) {
+			Reply(r1 | 0x40);
+			break;
+		}
+		Reply(r1);
+		SendData(data, SECTOR, Sim_Cycles + US(Sd.access_us));
+		++Sim_Storage.sd_blocks_read;
+		break;
+	}
+	case 23:
+		if (!app) {
+			Reply(r1 | 0x04);
+			break;
+		}
+		Erased = arg & 0x007FFFFF;
+		Reply(r1);
+		break;
+	case 24:
+	case 25:
+		if (arg >= Sd.sectors) {
+			Reply(r1 | 0x40);
+			break;
+		}
+		Reply(r1);
+		WriteSector = arg;
+		CardState = (cmd == 24) ? CARD_SINGLE : CARD_MULTI;
+		break;
+	case 12:
+		Queue_Clear(&CardOut);
+		Reply(r1);
+		break;
+	case 16:
+		Reply(r1);
+		break;
+	default:
+		Reply(r1 | 0x04); // illegal command
+	}
+}
+
+static void CardBlock(void) {
+	uint16_t crc = ((uint16_t)Block[SECTOR] << 8) | Block[SECTOR + 1];
+	int ok = !CrcMode || crc == Crc16(Block, SECTOR);
+	if (!ok) ++Sim_Storage.sd_crc_errors;
+	else if (WriteSector < Sd.sectors && pwrite(SdFile, Block, SECTOR, (off_t)WriteSector*SECTOR) == SECTOR) {
+		++Sim_Storage.sd_blocks_written;
+	}
+	Reply(ok ? 0x05 : 0x0B); // data accepted, or CRC error
+	if (Multi) {
+		Busy = Sim_Cycles + US(Erased ? Sd.erased_us : Sd.block_us);
+		if (Erased) --Erased;
+		++WriteSector;
+		CardState = CARD_MULTI;
+	}
+	else {
+		Busy = Sim_Cycles + US(Sd.single_us);
+		CardState = CARD_COMMAND;
+	}
+}
+
+static void CardIn(uint8_t data) {
+	switch (CardState) {
+	case CARD_COMMAND:
+		if (CommandLength == 0 && (data & 0xC0) != 0x40) return; // bus idle
+		Command[CommandLength++] = data;
+		if (CommandLength == 6) {
+			CommandLength = 0;
+			CardCommand();
+		}
+		return;
+	case CARD_SINGLE:
+	case CARD_MULTI:
+		if ((data == 0xFE && CardState == CARD_SINGLE) || (data == 0xFC && CardState == CARD_MULTI)) {
+			Multi = (CardState == CARD_MULTI);
+			BlockLength = 0;
+			CardState = CARD_DATA;
+		}
+		else if (data == 0xFD && CardState == CARD_MULTI) {
+			Busy = Sim_Cycles + US(Sd.stop_us);
+			Erased = 0;
+			CardState = CARD_COMMAND;
+		}
+		return;
+	case CARD_DATA:
+		Block[BlockLength++] = data;
+		if (BlockLength == SECTOR + 2) CardBlock();
+		return;
+	}
+}
+
+// one byte each way on the wire
+static uint8_t Exchange(uint8_t data) {
+	uint8_t out = 0xFF;
+	++Sim_Storage.spi_bytes;
+	if (Sim_Regs[SIM_SDC_CS] & 0x01) {
+		// deselected: whatever the card was saying is gone, but programming goes on
+		CommandLength = 0;
+		Queue_Clear(&CardOut);
+		if (CardState == CARD_DATA) CardState = CARD_COMMAND; // half a block is thrown away
+		return out;
+	}
+	if (CardOut.get < CardOut.put) {
+		if (CardOut.ready[CardOut.get] <= Sim_Cycles) out = CardOut.data[CardOut.get++];
+	}
+	else if (Sim_Cycles < Busy) out = 0x00;
+	CardIn(data);
+	return out;
+}
+
+static void SpiReceive(uint8_t data) {
+	if (SpiCount == SPI_FIFO) return; // overrun
+	SpiRx[(SpiGet + SpiCount++)%SPI_FIFO] = data;
+}
+
+static uint32_t Ssi0_DR_Value(void) {
+	return SpiCount ? SpiRx[SpiGet] : 0;
+}
+
+static void Ssi0_DR_Read(void) {
+	if (SpiCount == 0) return;
+	SpiGet = (SpiGet + 1)%SPI_FIFO;
+	--SpiCount;
+}
+
+static void Ssi0_DR_Write(uint32_t value) {
+	SpiReceive(Exchange(value & 0xFF));
+	Sim_Advance(SpiByteCycles() + Sd.gap_cycles);
+}
+
+static uint32_t Ssi0_SR_Value(void) {
+	return SSI_SR_TNF | (SpiCount ? SSI_SR_RNE : 0) | (DmaActive ? SSI_SR_BSY : 0);
+}
+
+static const Sim_Port Ssi0_DR = { Ssi0_DR_Value, Ssi0_DR_Read, Ssi0_DR_Write };
+static const Sim_Port Ssi0_SR = { Ssi0_SR_Value, 0, 0 };
+
+static uint64_t Sd_Next(void) {
+	return DmaActive ? DmaDone : SIM_NEVER;
+}
+
+static void Sd_Event(void) {
+	if (DmaActive && Sim_Cycles >= DmaDone) {
+		DmaActive = 0;
+		Sim_Regs[SIM_UDMA_ENASET] &= ~BIT11;
+	}
+}
+
+static void Sd_Access(int reg) {
+	// EERDWR: a write shows up as a changed value, then it shows the word EEBLOCK/EEOFFSET point at
+	if (Sim_Regs[SIM_EEPROM_EERDWR] != EepromShown) Eeprom[EepromSlot] = Sim_Regs[SIM_EEPROM_EERDWR];
+	EepromSlot = ((Sim_Regs[SIM_EEPROM_EEBLOCK]*16) + (Sim_Regs[SIM_EEPROM_EEOFFSET] & 0x0F))%EEPROM_WORDS;
+	Sim_Regs[SIM_EEPROM_EERDWR] = EepromShown = Eeprom[EepromSlot];
+	// channel 11 enabled with SSI0 asking for it: the whole block is clocked out from here
+	if (!DmaActive && (Sim_Regs[SIM_UDMA_ENASET] & BIT11) && (Sim_Regs[SIM_SSI0_DMACTL] & SSI_DMACTL_TXDMAE)) {
+		uint32_t control = ucControlTable[CH11 + 2];
+		uint32_t count = ((control >> 4) & 0x3FF) + 1;
+		const uint8_t *source = (const uint8_t *)(uintptr_t)ucControlTable[CH11] - (count - 1);
+		if ((control & 0x07) != 0) {
+			for (uint32_t i = 0; i < count; ++i) SpiReceive(Exchange(source[i]));
+			ucControlTable[CH11 + 2] = control & ~0x00003FF7;
+			DmaActive = 1;
+			DmaDone = Sim_Cycles + count*SpiByteCycles();
+		}
+	}
+	// polling the enable bit while the block is going out
+	if (reg == SIM_UDMA_ENASET && DmaActive) Sim_Advance(DmaDone - Sim_Cycles);
+}
+
+static const Sim_Device SdDevice = { Sd_Next, Sd_Event, Sd_Access, 0 };
+
+int Sim_Sd_Open(const Sim_SdConfig *config) {
+	Sd = *config;
+	if (SdFile >= 0) close(SdFile);
+	SdFile = OpenImage(Sd.path, Sd.sectors);
+	if (SdFile < 0) return 0;
+	CardState = CARD_COMMAND;
+	CommandLength = 0;
+	App = 0;
+	Idle = 1;
+	Initialising = 0;
+	CrcMode = 0;
+	Erased = 0;
+	Busy = 0;
+	Queue_Clear(&CardOut);
+	SpiCount = SpiGet = 0;
+	DmaActive = 0;
+	for (int i = 0; i < EEPROM_WORDS; ++i) Eeprom[i] = 0xFFFFFFFF; // erased
+	EepromSlot = 0;
+	Sim_Regs[SIM_EEPROM_EERDWR] = EepromShown = Eeprom[0];
+	Sim_Regs[SIM_SDC_CS] = 0x01;
+	Sim_AddPort(SIM_SSI0_DR, &Ssi0_DR);
+	Sim_AddPort(SIM_SSI0_SR, &Ssi0_SR);
+	Sim_AddDevice(&SdDevice);
+	return 1;
+}
+
+/*-------------------------------- display --------------------------------*/
+
+static Sim_DisplayConfig Display;
+static int DisplayFile = -1;
+
+// UART3
+static uint8_t TxFifo[UART_FIFO];
+static int TxCount, TxGet;
+static int Shifting;             // a byte is on its way out
+static uint8_t ShiftByte;
+static uint64_t ShiftCycles;     // at the rate the uart had when it started
+static uint64_t ShiftDone;
+static uint8_t RxFifo[UART_FIFO];
+static int RxCount, RxGet;
+static uint32_t Ris;
+static uint64_t RxTimeout = SIM_NEVER;
+static int InHandler;
+
+// the display end
+static uint64_t DisplayCycles;   // its byte time at the rate it is set to
+static uint8_t Cmd[SECTOR + 8];
+static int CmdLength;
+static uint32_t DisplaySector;
+static uint64_t DisplayFree;     // done with the last command then
+static Queue DisplayOut;
+static uint64_t LineFree;        // the reply byte on the wire is in by then
+
+static const struct { uint16_t index; uint32_t baud; } Rates[] = {
+	{6, 9600}, {13, 115200}, {15, 281250}, {17, 401785}, {18, 562500}, {19, 703125}
+};
+
+// byte time at the rate UART3 is programmed for, 0 while it is off
+static uint64_t UartCycles(void) {
+	uint64_t divisor64 = Sim_Regs[SIM_UART3_IBRD]*64 + (Sim_Regs[SIM_UART3_FBRD] & 0x3F);
+	if ((Sim_Regs[SIM_UART3_CTL] & UART_CTL_UARTEN) == 0 || divisor64 == 0) return 0;
+	return divisor64*10/4; // 16 clocks a bit, 10 bits
+}
+
+// a byte gets across if the two ends' rates are within 3%, and the wiring carries that rate
+static int SameRate(uint64_t a, uint64_t b) {
+	uint64_t difference = (a > b) ? a - b : b - a;
+	if (a == 0 || b == 0 || difference*100 >= 3*b) return 0;
+	return Display.max_baud == 0 || (uint64_t)SIM_BUS_CLOCK*10/b <= Display.max_baud + Display.max_baud/50;
+}
+
+static int FifoLevel(uint32_t select) {
+	static const int levels[] = { 2, 4, 8, 12, 14 };
+	return (select < 5) ? levels[select] : 8;
+}
+
+static void DisplayReply(uint8_t data, uint64_t ready) {
+	Queue_Add(&DisplayOut, data, ready, DisplayCycles);
+}
+
+static void DisplayStatus(uint32_t ok, uint64_t ready) {
+	DisplayReply(0x06, ready);
+	DisplayReply(0x00, ready);
+	DisplayReply(ok ? 0x01 : 0x00, ready);
+}
+
+// bytes of the command started in Cmd, 0 if not known yet
+static int CommandLengthOf(void) {
+	if (CmdLength < 2) return 0;
+	uint16_t op = ((uint16_t)Cmd[0] << 8) | Cmd[1];
+	switch (op) {
+	case 0xFF89: case 0xFF8A: case 0xFFCD: case 0x0016: case 0x001B: return 2;
+	case 0xFF92: return 6;
+	case 0x0026: return 4;
+	case 0x0017: return 2 + SECTOR;
+	case 0x0018: return (CmdLength > 2 && Cmd[CmdLength - 1] == 0) ? CmdLength : (int)sizeof(Cmd) + 1;
+	}
+	return -1;
+}
+
+static void DisplayCommand(void) {
+	uint16_t op = ((uint16_t)Cmd[0] << 8) | Cmd[1];
+	uint64_t start = (Sim_Cycles > DisplayFree) ? Sim_Cycles : DisplayFree;
+	uint64_t ready = start + US(Display.command_us) + (uint64_t)CmdLength*Display.byte_ns*(SIM_BUS_CLOCK/1000000)/1000;
+	uint8_t data[SECTOR];
+	++Sim_Storage.display_commands;
+	switch (op) {
+	case 0xFF89: // media init
+		DisplayStatus(1, ready);
+		break;
+	case 0xFF92: // set sector address
+		DisplaySector = ((uint32_t)Cmd[2] << 24) | ((uint32_t)Cmd[3] << 16) | ((uint32_t)Cmd[4] << 8) | Cmd[5];
+		DisplayReply(0x06, ready);
+		break;
+	case 0xFF8A: // flush media
+		ready += US(Display.flush_us);
+		DisplayStatus(1, ready);
+		break;
+	case 0xFFCD: // clear screen
+		DisplayReply(0x06, ready);
+		break;
+	case 0x0017: { // write sector
+		ready += US(Display.write_us);
+		uint32_t ok = DisplaySector < Display.sectors && pwrite(DisplayFile, &Cmd[2], SECTOR, (off_t)DisplaySector*SECTOR) == SECTOR;
+		++DisplaySector;
+		DisplayStatus(ok, ready);
+		break;
+	}
+	case 0x0016: { // read sector
+		ready += US(Display.read_us);
+		uint32_t ok = DisplaySector < Display.sectors && pread(DisplayFile, data, SECTOR, (off_t)DisplaySector*SECTOR) == SECTOR;
+		++DisplaySector;
+		DisplayStatus(ok, ready);
+		for (int i = 0; i < SECTOR; ++i) DisplayReply(ok ? data[i] : 0, ready);
+		break;
+	}
+	case 0x001B: // get version
+		DisplayReply(0x06, ready);
+		DisplayReply(0x01, ready);
+		DisplayReply(0x00, ready);
+		break;
+	case 0x0026: { // set baud: takes the new rate right away, ACKs at it a while later
+		uint16_t index = ((uint16_t)Cmd[2] << 8) | Cmd[3];
+		int known = 0;
+		for (uint32_t i = 0; i < sizeof(Rates)/sizeof(Rates[0]); ++i) {
+			if (Rates[i].index != index) continue;
+			DisplayCycles = Sim_ByteCycles(Rates[i].baud);
+			known = 1;
+		}
+		if (known) ready += US(1000*(uint64_t)Display.baud_ms);
+		DisplayReply(known ? 0x06 : 0x15, ready);
+		break;
+	}
+	case 0x0018: // put string: ACK and the length
+		DisplayReply(0x06, ready);
+		DisplayReply(0x00, ready);
+		DisplayReply(CmdLength - 3, ready);
+		break;
+	}
+	DisplayFree = ready;
+}
+
+static void DisplayIn(uint8_t data) {
+	if (CmdLength == sizeof(Cmd)) CmdLength = 0;
+	Cmd[CmdLength++] = data;
+	int length = CommandLengthOf();
+	if (length < 0) { // not a command it knows: drop a byte and look again
+		memmove(Cmd, Cmd + 1, --CmdLength);
+		return;
+	}
+	if (length == 0 || CmdLength < length) return;
+	DisplayCommand();
+	CmdLength = 0;
+}
+
+static void TxStart(void) {
+	uint64_t cycles = UartCycles();
+	if (Shifting || TxCount == 0 || cycles == 0) return;
+	int level = FifoLevel(Sim_Regs[SIM_UART3_IFLS] & 0x07);
+	ShiftByte = TxFifo[TxGet];
+	TxGet = (TxGet + 1)%UART_FIFO;
+	if (TxCount-- > level && TxCount <= level) Ris |= UART_TXRIS;
+	Shifting = 1;
+	ShiftCycles = cycles;
+	ShiftDone = Sim_Cycles + cycles;
+}
+
+static uint64_t Arrival(void) {
+	if (DisplayOut.get == DisplayOut.put) return SIM_NEVER;
+	uint64_t start = DisplayOut.ready[DisplayOut.get];
+	if (start < LineFree) start = LineFree;
+	return start + DisplayOut.cycles[DisplayOut.get];
+}
+
+static uint32_t Uart3_DR_Value(void) {
+	return RxCount ? RxFifo[RxGet] : 0;
+}
+
+static void Uart3_DR_Read(void) {
+	if (RxCount == 0) return;
+	RxGet = (RxGet + 1)%UART_FIFO;
+	--RxCount;
+}
+
+static void Uart3_DR_Write(uint32_t value) {
+	if (TxCount == UART_FIFO) {
+		++Sim_Storage.uart_lost;
+		return;
+	}
+	TxFifo[(TxGet + TxCount++)%UART_FIFO] = value & 0xFF;
+	TxStart();
+}
+
+static uint32_t Uart3_FR_Value(void) {
+	return ((TxCount == UART_FIFO) ? UART_FR_TXFF : 0) | (RxCount ? 0 : UART_FR_RXFE) | ((Shifting || TxCount) ? UART_FR_BUSY : 0);
+}
+
+static uint32_t Uart3_MIS_Value(void) {
+	return Ris & Sim_Regs[SIM_UART3_IM];
+}
+
+static const Sim_Port Uart3_DR = { Uart3_DR_Value, Uart3_DR_Read, Uart3_DR_Write };
+static const Sim_Port Uart3_FR = { Uart3_FR_Value, 0, 0 };
+static const Sim_Port Uart3_MIS = { Uart3_MIS_Value, 0, 0 };
+
+static uint64_t Display_Next(void) {
+	uint64_t next = Shifting ? ShiftDone : SIM_NEVER;
+	uint64_t arrival = Arrival();
+	if (arrival < next) next = arrival;
+	if (RxTimeout < next) next = RxTimeout;
+	return next;
+}
+
+static void Display_Interrupt(void) {
+	// the handler clears what it takes, a few rounds is plenty
+	for (int i = 0; i < 8; ++i) {
+		if (InHandler || !UART3_Handler || Sim_InterruptsOff()) return;
+		if ((Ris & Sim_Regs[SIM_UART3_IM]) == 0 || (Sim_Regs[SIM_NVIC_EN1] & UART3_IRQ) == 0) return;
+		InHandler = 1;
+		UART3_Handler();
+		Sim_Sync();
+		InHandler = 0;
+	}
+}
+
+static void Display_Event(void) {
+	if (Shifting && Sim_Cycles >= ShiftDone) {
+		++Sim_Storage.uart_tx_bytes;
+		if (SameRate(ShiftCycles, DisplayCycles)) DisplayIn(ShiftByte);
+		else ++Sim_Storage.uart_lost;
+		Shifting = 0;
+		TxStart();
+	}
+	if (Arrival() <= Sim_Cycles) {
+		uint64_t cycles = DisplayOut.cycles[DisplayOut.get];
+		uint8_t data = DisplayOut.data[DisplayOut.get++];
+		uint64_t uart = UartCycles();
+		LineFree = Sim_Cycles;
+		++Sim_Storage.uart_rx_bytes;
+		if (!SameRate(uart, cycles) || RxCount == UART_FIFO) ++Sim_Storage.uart_lost;
+		else {
+			RxFifo[(RxGet + RxCount++)%UART_FIFO] = data;
+			if (RxCount >= FifoLevel((Sim_Regs[SIM_UART3_IFLS] >> 3) & 0x07)) Ris |= UART_RXRIS;
+			RxTimeout = Sim_Cycles + uart*32/10; // 32 bit times without another byte
+		}
+	}
+	if (RxTimeout <= Sim_Cycles) {
+		if (RxCount) Ris |= UART_RTRIS;
+		RxTimeout = SIM_NEVER;
+	}
+	Display_Interrupt();
+}
+
+static void Display_Access(int reg) {
+	(void)reg;
+	if (Sim_Regs[SIM_UART3_ICR]) {
+		Ris &= ~Sim_Regs[SIM_UART3_ICR];
+		Sim_Regs[SIM_UART3_ICR] = 0;
+	}
+	TxStart(); // the uart may just have been turned back on
+	Display_Interrupt();
+}
+
+static const Sim_Device DisplayDevice = { Display_Next, Display_Event, Display_Access, Display_Interrupt };
+
+int Sim_Display_Open(const Sim_DisplayConfig *config) {
+	Display = *config;
+	if (DisplayFile >= 0) close(DisplayFile);
+	DisplayFile = OpenImage(Display.path, Display.sectors);
+	if (DisplayFile < 0) return 0;
+	TxCount = TxGet = RxCount = RxGet = 0;
+	Shifting = 0;
+	Ris = 0;
+	RxTimeout = SIM_NEVER;
+	InHandler = 0;
+	DisplayCycles = Sim_ByteCycles(9600); // powers up at 9600
+	CmdLength = 0;
+	DisplaySector = 0;
+	DisplayFree = 0;
+	LineFree = 0;
+	Queue_Clear(&DisplayOut);
+	Sim_AddPort(SIM_UART3_DR, &Uart3_DR);
+	Sim_AddPort(SIM_UART3_FR, &Uart3_FR);
+	Sim_AddPort(SIM_UART3_MIS, &Uart3_MIS);
+	Sim_AddDevice(&DisplayDevice);
+	return 1;
+}
@@ -0,0 +1,56 @@
+// storage_sim.h
+// models of the two places the camera stores pictures, so tools can run the real storage
+// drivers on a pc (-DHOST_SIM, see tm4c_sim.h):
+//  - an SD card in SPI mode on SSI0, CS on PB0 (inc/eDisk.c, SDCard.c), with the uDMA channel 11
+//    block transmit and the EEPROM words SDCard_Tune keeps its clock in
+//  - the display on UART3 (LCD_UART.c), answering the Picaso media, sector and set baud commands
+// both keep their sectors in a file, so what the drivers wrote can be checked afterwards.
+// latencies are per command, link costs per byte, all in the model's virtual time
+#ifndef __STORAGE_SIM_H__
+#define __STORAGE_SIM_H__
+#include <stdint.h>
+
+typedef struct {
+	const char *path;     // card image, made (sparse) if it isn't there
+	uint32_t sectors;     // card size, 512 byte sectors
+	uint32_t init_us;     // power up: ACMD41 says "idle" for this long
+	uint32_t access_us;   // single block read (CMD17), or CID read: command to data token
+	uint32_t single_us;   // busy after a single block write (CMD24)
+	uint32_t block_us;    // busy after each block of a multi-block write (CMD25)...
+	uint32_t erased_us;   // ...if ACMD23 had it pre-erased
+	uint32_t stop_us;     // busy after the stop token
+	uint32_t max_khz;     // fastest SPI clock the wiring carries, data read faster than this comes back corrupted
+	uint32_t gap_cycles;  // cpu time between the bytes of a polled exchange (xchg_spi's loop)
+} Sim_SdConfig;
+
+typedef struct {
+	const char *path;     // the display's card image
+	uint32_t sectors;
+	uint32_t command_us;  // every command, before its reply starts
+	uint32_t read_us;     // on top, sector read
+	uint32_t write_us;    // on top, sector write
+	uint32_t flush_us;    // on top, flush media
+	uint32_t baud_ms;     // set baud: the ACK comes this long after the command, at the new rate
+	uint32_t byte_ns;     // display time for every byte it takes in, on top of the wire
+	uint32_t max_baud;    // fastest rate the wiring carries, bytes sent faster are lost (0: no limit)
+} Sim_DisplayConfig;
+
+// what went over the wires since Sim_Sd_Open/Sim_Display_Open
+typedef struct {
+	uint64_t spi_bytes;         // bytes clocked on SSI0 (each one goes both ways)
+	uint32_t sd_commands;
+	uint32_t sd_blocks_read;
+	uint32_t sd_blocks_written;
+	uint32_t sd_crc_errors;     // commands and blocks the card turned down for a bad CRC
+	uint64_t uart_tx_bytes;     // to the display
+	uint64_t uart_rx_bytes;     // from the display
+	uint32_t display_commands;
+	uint32_t uart_lost;         // bytes sent while the two ends were at different rates, or into a full fifo
+} Sim_StorageStats;
+extern Sim_StorageStats Sim_Storage;
+
+// attach a model (after Sim_Reset). returns 0 if its image can't be opened
+int Sim_Sd_Open(const Sim_SdConfig *config);
+int Sim_Display_Open(const Sim_DisplayConfig *config);
+
+#endif
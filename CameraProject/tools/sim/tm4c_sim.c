@@ -0,0 +1,291 @@
+// tm4c_sim.c
+// model of the UART4 receive side and uDMA channel 18 that DMA_UART.c drives
+// only the parts of the hardware the camera engine relies on are modelled:
+//  - camera sends requested packages back to back at the link baud rate
+//  - 16 byte uart receive fifo, bytes are lost (overrun) when it is full
+//  - uDMA basic and ping-pong modes with primary/alternate control structures
+//  - completion interrupt on the UART4 vector, held off while the I bit is set
+// other peripherals plug in as ports and devices (storage_sim.c), and share the same clock
+#include <stdio.h>
+#include <stdlib.h>
+#include "tm4c_sim.h"
+
+#define FIFO_SIZE   16
+#define BIT18       0x00040000
+#define CH18        (18*4)
+#define ALTCH18     (128+18*4)
+#define MAX_REQUESTS 1024
+#define MAX_DEVICES  4
+#define ACCESS_CYCLES 4      // a port access from the driver, and a pass round its polling loop
+#define MARK 0x80000000      // the value of a port was handed out and not written over
+#define MS_CYCLES (SIM_BUS_CLOCK/1000)
+
+volatile uint32_t Sim_Regs[SIM_NUM_REGS];
+uint64_t Sim_Cycles;
+uint32_t Sim_UART4_Overruns;
+
+extern uint32_t ucControlTable[256];
+void UART4_Handler(void);
+
+static int IBit;                 // 1 while interrupts are disabled
+static int Waiting;              // completion interrupt waiting for the I bit to clear
+
+static uint8_t Fifo[FIFO_SIZE];
+static uint32_t FifoGet, FifoPut;
+
+static const uint8_t *CamData;
+static uint32_t CamLength, CamPackageSize;
+static uint64_t CamByteCycles;
+static uint32_t Requests[MAX_REQUESTS];
+static uint32_t RequestGet, RequestPut;
+static uint32_t CamOffset, CamEnd;   // bytes of the package currently on the wire
+static int CamBusy;
+static uint64_t CamNextByte;         // when the next byte finishes arriving
+
+static const Sim_Port *Ports[SIM_NUM_REGS];
+static int Pending = -1;             // port handed out by the last Sim_Access
+static const Sim_Device *Devices[MAX_DEVICES];
+static int NumDevices;
+static int Advancing;                // 1 inside Sim_Advance (handlers run in no time)
+void (*Sim_MsTick)(void);
+
+uint64_t Sim_ByteCycles(uint32_t baud) {
+	return ((uint64_t)SIM_BUS_CLOCK*10 + baud - 1)/baud;
+}
+
+void Sim_Reset(void) {
+	for (int i = 0; i < SIM_NUM_REGS; ++i) Sim_Regs[i] = 0;
+	if (((uintptr_t)ucControlTable) >> 32) {
+		fprintf(stderr, "tm4c_sim: control table above 4 GB, build with -no-pie\n");
+		exit(1);
+	}
+	Sim_Regs[SIM_SYSCTL_PRSSI] = Sim_Regs[SIM_SYSCTL_PRGPIO] = Sim_Regs[SIM_SYSCTL_PREEPROM] = 0xFFFFFFFF; // all ready
+	for (int i = 0; i < SIM_NUM_REGS; ++i) Ports[i] = 0;
+	Pending = -1;
+	NumDevices = 0;
+	Sim_Cycles = 0;
+	Sim_UART4_Overruns = 0;
+	IBit = 0;
+	Waiting = 0;
+	FifoGet = FifoPut = 0;
+	RequestGet = RequestPut = 0;
+	CamBusy = 0;
+	CamNextByte = 0;
+}
+
+void Sim_Camera_Load(const uint8_t *data, uint32_t length, uint32_t package_size, uint32_t baud) {
+	CamData = data;
+	CamLength = length;
+	CamPackageSize = package_size;
+	CamByteCycles = Sim_ByteCycles(baud);
+	RequestGet = RequestPut = 0;
+	CamBusy = 0;
+}
+
+void Sim_Camera_Request(uint32_t package) {
+	if (RequestPut - RequestGet < MAX_REQUESTS) Requests[(RequestPut++)%MAX_REQUESTS] = package;
+}
+
+void Sim_AddPort(int reg, const Sim_Port *port) {
+	Ports[reg] = port;
+}
+
+void Sim_AddDevice(const Sim_Device *device) {
+	if (NumDevices < MAX_DEVICES) Devices[NumDevices++] = device;
+}
+
+int Sim_InterruptsOff(void) {
+	return IBit;
+}
+
+// what the driver did with the last port it was handed
+static void Resolve(void) {
+	int reg = Pending;
+	if (reg < 0) return;
+	Pending = -1;
+	if ((Sim_Regs[reg] & MARK) == 0) {
+		if (Ports[reg]->write) Ports[reg]->write(Sim_Regs[reg]);
+	}
+	else if (Ports[reg]->read) Ports[reg]->read();
+}
+
+static void Access(int reg) {
+	Resolve();
+	for (int i = 0; i < NumDevices; ++i) {
+		if (Devices[i]->access) Devices[i]->access(reg);
+	}
+}
+
+void Sim_Sync(void) {
+	Access(-1);
+}
+
+// move the clock, with a tick every millisecond on the way
+static void Time(uint64_t to) {
+	while (Sim_Cycles < to) {
+		uint64_t tick = (Sim_Cycles/MS_CYCLES + 1)*MS_CYCLES;
+		if (tick > to) {
+			Sim_Cycles = to;
+			break;
+		}
+		Sim_Cycles = tick;
+		if (Sim_MsTick) Sim_MsTick();
+	}
+}
+
+volatile uint32_t *Sim_Access(int reg) {
+	Access(reg);
+	Sim_Advance(ACCESS_CYCLES);
+	if (Ports[reg]) {
+		Sim_Regs[reg] = MARK | Ports[reg]->value();
+		Pending = reg;
+	}
+	return &Sim_Regs[reg];
+}
+
+static void Interrupt(void) {
+	if (IBit || (Sim_Regs[SIM_NVIC_EN1]&(1u<<28)) == 0) {
+		Waiting = 1;
+		return;
+	}
+	Waiting = 0;
+	Sim_Regs[SIM_UDMA_CHIS] |= BIT18;
+	UART4_Handler();
+	Sim_Regs[SIM_UDMA_CHIS] = 0;
+}
+
+// the set/clear register pairs are plain variables here, fold the clears in
+static void Registers(void) {
+	Sim_Regs[SIM_UDMA_ALTSET] &= ~Sim_Regs[SIM_UDMA_ALTCLR];
+	Sim_Regs[SIM_UDMA_ALTCLR] = 0;
+	Sim_Regs[SIM_UDMA_ENASET] &= ~Sim_Regs[SIM_UDMA_ENACLR];
+	Sim_Regs[SIM_UDMA_ENACLR] = 0;
+	Sim_Regs[SIM_NVIC_EN1] &= ~Sim_Regs[SIM_NVIC_DIS1];
+	Sim_Regs[SIM_NVIC_DIS1] = 0;
+}
+
+volatile uint32_t *Sim_Set(int reg) {
+	Access(reg);
+	Registers();
+	return &Sim_Regs[reg];
+}
+
+// move fifo bytes into memory while channel 18 is on
+static void Dma(void) {
+	Registers();
+	while (FifoGet != FifoPut && (Sim_Regs[SIM_UDMA_ENASET]&BIT18) && (Sim_Regs[SIM_UART4_DMACTL]&0x01)) {
+		uint32_t index = (Sim_Regs[SIM_UDMA_ALTSET]&BIT18) ? ALTCH18 : CH18;
+		uint32_t control = ucControlTable[index+2];
+		uint32_t mode = control&0x07;
+		if (mode == 0) { // ran into a stopped structure
+			Sim_Regs[SIM_UDMA_ENASET] &= ~BIT18;
+			break;
+		}
+		uint32_t remaining = ((control>>4)&0x3FF)+1;
+		uint8_t *destination = (uint8_t *)(uintptr_t)ucControlTable[index+1];
+		*(destination-(remaining-1)) = Fifo[(FifoGet++)%FIFO_SIZE];
+		--remaining;
+		if (remaining == 0) {
+			ucControlTable[index+2] = control&~0x3FF7;
+			if (mode == 3) Sim_Regs[SIM_UDMA_ALTSET] ^= BIT18;
+			else Sim_Regs[SIM_UDMA_ENASET] &= ~BIT18;
+			Interrupt();
+			Registers();
+		} else {
+			ucControlTable[index+2] = (control&~0x3FF0)|((remaining-1)<<4);
+		}
+	}
+}
+
+// next camera byte or device event, whichever comes first. device: which one, -1 for the camera
+static uint64_t NextEvent(int *device) {
+	uint64_t next = CamBusy ? CamNextByte : SIM_NEVER;
+	*device = -1;
+	for (int i = 0; i < NumDevices; ++i) {
+		uint64_t t = Devices[i]->next ? Devices[i]->next() : SIM_NEVER;
+		if (t < next) {
+			next = t;
+			*device = i;
+		}
+	}
+	return next;
+}
+
+void Sim_Advance(uint64_t cycles) {
+	if (Advancing) return;
+	Sim_Sync(); // a byte the driver just wrote takes its time before anything else happens
+	Advancing = 1;
+	uint64_t end = Sim_Cycles + cycles;
+	for (;;) {
+		if (!CamBusy && RequestGet != RequestPut) {
+			uint32_t package = Requests[(RequestGet++)%MAX_REQUESTS];
+			CamOffset = package*CamPackageSize;
+			CamEnd = CamOffset + CamPackageSize;
+			if (CamEnd > CamLength) CamEnd = CamLength;
+			if (CamOffset < CamEnd) {
+				CamBusy = 1;
+				if (CamNextByte < Sim_Cycles) CamNextByte = Sim_Cycles;
+				CamNextByte += CamByteCycles;
+			}
+		}
+		int device;
+		uint64_t next = NextEvent(&device);
+		if (next > end) break;
+		Time(next);
+		if (device >= 0) {
+			Devices[device]->event();
+			Dma();
+			continue;
+		}
+		if (FifoPut - FifoGet < FIFO_SIZE) Fifo[(FifoPut++)%FIFO_SIZE] = CamData[CamOffset];
+		else ++Sim_UART4_Overruns;
+		if (++CamOffset == CamEnd) CamBusy = 0;
+		else CamNextByte += CamByteCycles;
+		Dma();
+	}
+	Time(end);
+	Dma();
+	Advancing = 0;
+}
+
+void Sim_Idle(void) {
+	int device;
+	Sim_Sync();
+	uint64_t next = NextEvent(&device);
+	if (next > Sim_Cycles + MS_CYCLES) next = Sim_Cycles + MS_CYCLES;
+	Sim_Advance((next > Sim_Cycles) ? next - Sim_Cycles : 0);
+}
+
+// let every device take an interrupt that was waiting for the I bit
+static void Unmasked(void) {
+	Sim_Sync();
+	for (int i = 0; i < NumDevices; ++i) {
+		if (Devices[i]->interrupt) Devices[i]->interrupt();
+	}
+}
+
+void DisableInterrupts(void) {
+	IBit = 1;
+}
+
+void EnableInterrupts(void) {
+	IBit = 0;
+	if (Waiting) Interrupt();
+	Dma();
+	Unmasked();
+}
+
+long StartCritical(void) {
+	long sr = IBit;
+	IBit = 1;
+	return sr;
+}
+
+void EndCritical(long sr) {
+	IBit = (int)sr;
+	if (!IBit) {
+		if (Waiting) Interrupt();
+		Dma();
+		Unmasked();
+	}
+}
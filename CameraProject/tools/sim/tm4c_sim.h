@@ -0,0 +1,204 @@
+// tm4c_sim.h
+// host (linux) stand-ins for the TM4C123 registers the camera drivers touch,
+// so a driver can be compiled with -DHOST_SIM and run against a model of the hardware.
+// time is virtual: everything is counted in 80 MHz bus cycles.
+// the uDMA model reads pointers back out of the 32-bit control table, so build with -no-pie
+// (statics then live below 4 GB and survive the cast to uint32_t)
+// the storage peripherals (SSI0 and the SD card, UART3 and the display) are modelled in storage_sim.c
+#ifndef __TM4C_SIM_H__
+#define __TM4C_SIM_H__
+#include <stdint.h>
+
+#define SIM_BUS_CLOCK 80000000
+
+enum {
+	SIM_SYSCTL_RCGCDMA, SIM_SYSCTL_RCGCUART, SIM_SYSCTL_RCGCGPIO,
+	SIM_UDMA_CFG, SIM_UDMA_CTLBASE, SIM_UDMA_CHMAP2, SIM_UDMA_PRIOCLR, SIM_UDMA_ALTSET, SIM_UDMA_ALTCLR,
+	SIM_UDMA_USEBURSTCLR, SIM_UDMA_REQMASKCLR, SIM_UDMA_ENASET, SIM_UDMA_ENACLR, SIM_UDMA_CHIS,
+	SIM_UART4_DR, SIM_UART4_FR, SIM_UART4_DMACTL, SIM_UART4_IM, SIM_UART4_ICR,
+	SIM_NVIC_EN1, SIM_NVIC_DIS1, SIM_NVIC_PRI15,
+	// storage_sim.c
+	SIM_SYSCTL_RCGCSSI, SIM_SYSCTL_PRSSI, SIM_SYSCTL_PRGPIO, SIM_SYSCTL_RCGCEEPROM, SIM_SYSCTL_PREEPROM,
+	SIM_SYSCTL_SREEPROM,
+	SIM_GPIO_PORTA_AFSEL, SIM_GPIO_PORTA_AMSEL, SIM_GPIO_PORTA_DATA, SIM_GPIO_PORTA_DEN, SIM_GPIO_PORTA_DIR,
+	SIM_GPIO_PORTA_DR4R, SIM_GPIO_PORTA_PCTL, SIM_GPIO_PORTA_PUR,
+	SIM_GPIO_PORTB_AMSEL, SIM_GPIO_PORTB_DEN, SIM_GPIO_PORTB_DIR, SIM_GPIO_PORTB_DR4R, SIM_GPIO_PORTB_PCTL,
+	SIM_GPIO_PORTB_PUR,
+	SIM_GPIO_PORTC_AFSEL, SIM_GPIO_PORTC_AMSEL, SIM_GPIO_PORTC_DEN, SIM_GPIO_PORTC_PCTL,
+	SIM_SDC_CS, SIM_TFT_CS,
+	SIM_SSI0_CPSR, SIM_SSI0_CR0, SIM_SSI0_CR1, SIM_SSI0_DMACTL, SIM_SSI0_DR, SIM_SSI0_ICR, SIM_SSI0_SR,
+	SIM_UDMA_CHMAP1,
+	SIM_UART3_DR, SIM_UART3_FR, SIM_UART3_IM, SIM_UART3_MIS, SIM_UART3_ICR, SIM_UART3_CTL,
+	SIM_UART3_IBRD, SIM_UART3_FBRD, SIM_UART3_LCRH, SIM_UART3_IFLS,
+	SIM_NVIC_PRI14,
+	SIM_EEPROM_EEBLOCK, SIM_EEPROM_EEOFFSET, SIM_EEPROM_EERDWR, SIM_EEPROM_EEDONE, SIM_EEPROM_EESUPP,
+	SIM_NUM_REGS
+};
+extern volatile uint32_t Sim_Regs[SIM_NUM_REGS];
+
+// the set half of a set/clear register pair: any pending write to the clear half is applied first
+volatile uint32_t *Sim_Set(int reg);
+
+#define SYSCTL_RCGCDMA_R    Sim_Regs[SIM_SYSCTL_RCGCDMA]
+#define SYSCTL_RCGCUART_R   Sim_Regs[SIM_SYSCTL_RCGCUART]
+#define SYSCTL_RCGCGPIO_R   Sim_Regs[SIM_SYSCTL_RCGCGPIO]
+#define UDMA_CFG_R          Sim_Regs[SIM_UDMA_CFG]
+#define UDMA_CTLBASE_R      Sim_Regs[SIM_UDMA_CTLBASE]
+#define UDMA_CHMAP2_R       Sim_Regs[SIM_UDMA_CHMAP2]
+#define UDMA_PRIOCLR_R      Sim_Regs[SIM_UDMA_PRIOCLR]
+#define UDMA_ALTSET_R       (*Sim_Set(SIM_UDMA_ALTSET))
+#define UDMA_ALTCLR_R       Sim_Regs[SIM_UDMA_ALTCLR]
+#define UDMA_USEBURSTCLR_R  Sim_Regs[SIM_UDMA_USEBURSTCLR]
+#define UDMA_REQMASKCLR_R   Sim_Regs[SIM_UDMA_REQMASKCLR]
+#define UDMA_ENASET_R       (*Sim_Set(SIM_UDMA_ENASET))
+#define UDMA_ENACLR_R       Sim_Regs[SIM_UDMA_ENACLR]
+#define UDMA_CHIS_R         Sim_Regs[SIM_UDMA_CHIS]
+#define UART4_DR_R          Sim_Regs[SIM_UART4_DR]
+#define UART4_FR_R          Sim_Regs[SIM_UART4_FR]
+#define UART4_DMACTL_R      Sim_Regs[SIM_UART4_DMACTL]
+#define UART4_IM_R          Sim_Regs[SIM_UART4_IM]
+#define UART4_ICR_R         Sim_Regs[SIM_UART4_ICR]
+#define NVIC_EN1_R          (*Sim_Set(SIM_NVIC_EN1))
+#define NVIC_DIS1_R         Sim_Regs[SIM_NVIC_DIS1]
+#define NVIC_PRI15_R        Sim_Regs[SIM_NVIC_PRI15]
+
+// registers with side effects (data registers, status flags) go through Sim_Access, see below
+#define SYSCTL_RCGCSSI_R    Sim_Regs[SIM_SYSCTL_RCGCSSI]
+#define SYSCTL_PRSSI_R      Sim_Regs[SIM_SYSCTL_PRSSI]
+#define SYSCTL_PRGPIO_R     Sim_Regs[SIM_SYSCTL_PRGPIO]
+#define SYSCTL_RCGCEEPROM_R Sim_Regs[SIM_SYSCTL_RCGCEEPROM]
+#define SYSCTL_PREEPROM_R   Sim_Regs[SIM_SYSCTL_PREEPROM]
+#define SYSCTL_SREEPROM_R   Sim_Regs[SIM_SYSCTL_SREEPROM]
+#define GPIO_PORTA_AFSEL_R  Sim_Regs[SIM_GPIO_PORTA_AFSEL]
+#define GPIO_PORTA_AMSEL_R  Sim_Regs[SIM_GPIO_PORTA_AMSEL]
+#define GPIO_PORTA_DATA_R   Sim_Regs[SIM_GPIO_PORTA_DATA]
+#define GPIO_PORTA_DEN_R    Sim_Regs[SIM_GPIO_PORTA_DEN]
+#define GPIO_PORTA_DIR_R    Sim_Regs[SIM_GPIO_PORTA_DIR]
+#define GPIO_PORTA_DR4R_R   Sim_Regs[SIM_GPIO_PORTA_DR4R]
+#define GPIO_PORTA_PCTL_R   Sim_Regs[SIM_GPIO_PORTA_PCTL]
+#define GPIO_PORTA_PUR_R    Sim_Regs[SIM_GPIO_PORTA_PUR]
+#define GPIO_PORTB_AMSEL_R  Sim_Regs[SIM_GPIO_PORTB_AMSEL]
+#define GPIO_PORTB_DEN_R    Sim_Regs[SIM_GPIO_PORTB_DEN]
+#define GPIO_PORTB_DIR_R    Sim_Regs[SIM_GPIO_PORTB_DIR]
+#define GPIO_PORTB_DR4R_R   Sim_Regs[SIM_GPIO_PORTB_DR4R]
+#define GPIO_PORTB_PCTL_R   Sim_Regs[SIM_GPIO_PORTB_PCTL]
+#define GPIO_PORTB_PUR_R    Sim_Regs[SIM_GPIO_PORTB_PUR]
+#define GPIO_PORTC_AFSEL_R  Sim_Regs[SIM_GPIO_PORTC_AFSEL]
+#define GPIO_PORTC_AMSEL_R  Sim_Regs[SIM_GPIO_PORTC_AMSEL]
+#define GPIO_PORTC_DEN_R    Sim_Regs[SIM_GPIO_PORTC_DEN]
+#define GPIO_PORTC_PCTL_R   Sim_Regs[SIM_GPIO_PORTC_PCTL]
+#define SSI0_CPSR_R         Sim_Regs[SIM_SSI0_CPSR]
+#define SSI0_CR0_R          Sim_Regs[SIM_SSI0_CR0]
+#define SSI0_CR1_R          Sim_Regs[SIM_SSI0_CR1]
+#define SSI0_DMACTL_R       Sim_Regs[SIM_SSI0_DMACTL]
+#define SSI0_DR_R           (*Sim_Access(SIM_SSI0_DR))
+#define SSI0_ICR_R          Sim_Regs[SIM_SSI0_ICR]
+#define SSI0_SR_R           (*Sim_Access(SIM_SSI0_SR))
+#define UDMA_CHMAP1_R       Sim_Regs[SIM_UDMA_CHMAP1]
+#define UART3_DR_R          (*Sim_Access(SIM_UART3_DR))
+#define UART3_FR_R          (*Sim_Access(SIM_UART3_FR))
+#define UART3_IM_R          Sim_Regs[SIM_UART3_IM]
+#define UART3_MIS_R         (*Sim_Access(SIM_UART3_MIS))
+#define UART3_ICR_R         Sim_Regs[SIM_UART3_ICR]
+#define UART3_CTL_R         Sim_Regs[SIM_UART3_CTL]
+#define UART3_IBRD_R        Sim_Regs[SIM_UART3_IBRD]
+#define UART3_FBRD_R        Sim_Regs[SIM_UART3_FBRD]
+#define UART3_LCRH_R        Sim_Regs[SIM_UART3_LCRH]
+#define UART3_IFLS_R        Sim_Regs[SIM_UART3_IFLS]
+#define NVIC_PRI14_R        Sim_Regs[SIM_NVIC_PRI14]
+#define EEPROM_EEBLOCK_R    Sim_Regs[SIM_EEPROM_EEBLOCK]
+#define EEPROM_EEOFFSET_R   Sim_Regs[SIM_EEPROM_EEOFFSET]
+#define EEPROM_EERDWR_R     (*Sim_Access(SIM_EEPROM_EERDWR))
+#define EEPROM_EEDONE_R     Sim_Regs[SIM_EEPROM_EEDONE]
+#define EEPROM_EESUPP_R     Sim_Regs[SIM_EEPROM_EESUPP]
+
+// bit fields of those, as in tm4c123gh6pm.h
+#define SSI_CR0_SCR_M           0x0000FF00
+#define SSI_CR0_SPH             0x00000080
+#define SSI_CR0_SPO             0x00000040
+#define SSI_CR0_FRF_M           0x00000030
+#define SSI_CR0_FRF_MOTO        0x00000000
+#define SSI_CR0_DSS_M           0x0000000F
+#define SSI_CR0_DSS_8           0x00000007
+#define SSI_CR1_MS              0x00000004
+#define SSI_CR1_SSE             0x00000002
+#define SSI_SR_BSY              0x00000010
+#define SSI_SR_RNE              0x00000004
+#define SSI_SR_TNF              0x00000002
+#define SSI_CPSR_CPSDVSR_M      0x000000FF
+#define SSI_ICR_RORIC           0x00000001
+#define SSI_DMACTL_TXDMAE       0x00000002
+#define EEPROM_EEDONE_WORKING   0x00000001
+#define EEPROM_EESUPP_PRETRY    0x00000008
+#define EEPROM_EESUPP_ERETRY    0x00000004
+#define SYSCTL_RCGCEEPROM_R0    0x00000001
+#define SYSCTL_PREEPROM_R0      0x00000001
+#define SYSCTL_SREEPROM_R0      0x00000001
+
+// a register whose reads or writes do something (push a byte out, pop a fifo) is a port.
+// every use of one of the macros above is a single access, so the value handed out is marked
+// (bit 31, the registers modelled this way are all narrower) and the next call into the model
+// finds out whether the driver wrote over it or only read it
+volatile uint32_t *Sim_Access(int reg);
+typedef struct {
+	uint32_t (*value)(void);       // what a read gets right now
+	void (*read)(void);            // it was read (0 if reading changes nothing)
+	void (*write)(uint32_t value); // it was written
+} Sim_Port;
+void Sim_AddPort(int reg, const Sim_Port *port);
+
+// a piece of hardware modelled outside this file
+#define SIM_NEVER 0xFFFFFFFFFFFFFFFFull
+typedef struct {
+	uint64_t (*next)(void);     // bus cycle of its next event, SIM_NEVER if nothing is coming
+	void (*event)(void);        // run that event (Sim_Cycles is its time, or later)
+	void (*access)(int reg);    // a register is about to be used from outside the model
+	void (*interrupt)(void);    // take any interrupt it has pending, if the I bit and the NVIC allow
+} Sim_Device;
+void Sim_AddDevice(const Sim_Device *device);
+
+// 1 while the I bit is set
+int Sim_InterruptsOff(void);
+
+// finish off the last port access and let the devices look at the registers
+// (a device calls this after running an interrupt handler)
+void Sim_Sync(void);
+
+// called every virtual millisecond (disk_timerproc, a SysTick handler...), 0 for none
+extern void (*Sim_MsTick)(void);
+
+// for wait loops that touch no register (waiting on a flag an interrupt handler sets):
+// move time on to the next event, or by a millisecond if nothing is coming
+void Sim_Idle(void);
+
+// same interface as inc/CortexM.h, backed by a simulated I bit
+void DisableInterrupts(void);
+void EnableInterrupts(void);
+long StartCritical(void);
+void EndCritical(long sr);
+
+// virtual time since Sim_Reset, in bus cycles
+extern uint64_t Sim_Cycles;
+
+// bytes the camera wanted to send while the uart fifo was full
+extern uint32_t Sim_UART4_Overruns;
+
+// clear all registers and the camera model, and forget every port and device
+void Sim_Reset(void);
+
+// give the camera model a picture to send
+// data/length: the whole picture, package_size: bytes sent per request, baud: camera link rate
+void Sim_Camera_Load(const uint8_t *data, uint32_t length, uint32_t package_size, uint32_t baud);
+
+// ask the camera for a package (what UART_OutCUSTOMACK does on the real link)
+// the package is queued behind any package that is already on the wire
+void Sim_Camera_Request(uint32_t package);
+
+// let the camera, uart fifo and uDMA run for some bus cycles
+// UART4_Handler gets called from in here whenever a transfer finishes and interrupts are on
+void Sim_Advance(uint64_t cycles);
+
+// cycles the link needs for one byte (start + 8 data + stop)
+uint64_t Sim_ByteCycles(uint32_t baud);
+
+#endif
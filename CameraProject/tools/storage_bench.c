@@ -0,0 +1,301 @@
+// storage_bench.c
+// runs the storage drivers (inc/eDisk.c and SDCard.c on SSI0, the display's sector commands in
+// LCD_UART.c) against the card and display models in sim/, and reports for each backend:
+//   seq write    sectors one after the other, as a picture log or a file gets them
+//   rand read    single sectors all over the card, checked against the image file
+//   frame store  a 160x120 RAW picture into the photo log, the way main.c stores one
+// sectors per second, latency percentiles of the calls the camera code makes, and bytes on the wire.
+// the models keep their sectors in files, and latencies and link costs are set per command and byte.
+// cpu time in the drivers (crc16, memcpy) is not counted, only register accesses and the gap between
+// polled SPI bytes, so the numbers are the link and the card, not the code
+// build (from CameraProject):
+//   gcc -O2 -no-pie -DHOST_SIM -I. -o storage_bench tools/storage_bench.c tools/sim/tm4c_sim.c tools/sim/storage_sim.c inc/eDisk.c SDCard.c Eeprom.c LCD_UART.c SectorBuffer.c SectorCache.c ImageLog.c
+// usage: ./storage_bench [sd.img] [lcd.img] [setting=value...]
+//   settings are the fields of Sim_SdConfig and Sim_DisplayConfig with sd. and lcd. in front
+//   (sd.block_us=400 lcd.max_baud=115200 ...), plus sectors= (how many each test moves), frames=,
+//   and only=sd or only=lcd
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include "tools/sim/tm4c_sim.h"
+#include "tools/sim/storage_sim.h"
+#include "inc/eDisk.h"
+#include "SDCard.h"
+#include "LCD_UART.h"
+#include "SectorBuffer.h"
+#include "SectorCache.h"
+#include "ImageLog.h"
+#include "Camera.h"
+
+#define MAX_SAMPLES  8192
+#define LOG_SECTOR   0       // the photo log, where main.c keeps it
+#define LOG_SLOTS    16
+#define DATA_SECTOR  8192    // the sequential write and random read area, past the log
+#define FRAME_WIDTH  160
+#define FRAME_HEIGHT 120
+#define FRAME_BYTES  (FRAME_WIDTH*FRAME_HEIGHT*2)
+#define PACKAGE      512     // camera package, as SectorBuffer_Write gets them
+
+// the uDMA control table, DMA_UART.c's on the board
+uint32_t ucControlTable[256] __attribute__((aligned(1024)));
+
+// stand-ins for the rest of the firmware the drivers call into
+void UART4_Handler(void) {}
+uint32_t UART_BusClock(void) { return SIM_BUS_CLOCK; }
+uint32_t TimeBase_Ms(void) { return (uint32_t)(Sim_Cycles/(SIM_BUS_CLOCK/1000)); }
+uint32_t TimeBase_Us(void) { return (uint32_t)(Sim_Cycles/(SIM_BUS_CLOCK/1000000)); }
+uint32_t FileCounter_Init(void) { return 1; }
+uint32_t FileCounter_Peek(void) { return 0; }
+void FileCounter_Set(uint32_t value) { (void)value; }
+
+static Sim_SdConfig Sd = {
+	.path = "sd.img", .sectors = 65536, .init_us = 50000, .access_us = 300, .single_us = 800,
+	.block_us = 250, .erased_us = 100, .stop_us = 500, .max_khz = 25000, .gap_cycles = 16
+};
+static Sim_DisplayConfig Lcd = {
+	.path = "lcd.img", .sectors = 65536, .command_us = 50, .read_us = 1500, .write_us = 2500,
+	.flush_us = 5000, .baud_ms = 100, .byte_ns = 0, .max_baud = 0
+};
+static uint32_t Sectors = 256;
+static uint32_t Frames = 4;
+
+static const struct { const char *name; uint32_t *value; } Settings[] = {
+	{"sd.sectors", &Sd.sectors}, {"sd.init_us", &Sd.init_us}, {"sd.access_us", &Sd.access_us},
+	{"sd.single_us", &Sd.single_us}, {"sd.block_us", &Sd.block_us}, {"sd.erased_us", &Sd.erased_us},
+	{"sd.stop_us", &Sd.stop_us}, {"sd.max_khz", &Sd.max_khz}, {"sd.gap_cycles", &Sd.gap_cycles},
+	{"lcd.sectors", &Lcd.sectors}, {"lcd.command_us", &Lcd.command_us}, {"lcd.read_us", &Lcd.read_us},
+	{"lcd.write_us", &Lcd.write_us}, {"lcd.flush_us", &Lcd.flush_us}, {"lcd.baud_ms", &Lcd.baud_ms},
+	{"lcd.byte_ns", &Lcd.byte_ns}, {"lcd.max_baud", &Lcd.max_baud},
+	{"sectors", &Sectors}, {"frames", &Frames}
+};
+
+static uint8_t Data[SECTOR_SIZE];
+static uint8_t Readback[SECTOR_SIZE];
+static uint8_t Picture[FRAME_BYTES];
+
+// one test: calls timed one by one, and the wire counted over the whole of it
+static uint32_t Latency[MAX_SAMPLES];
+static uint32_t Samples;
+static uint64_t Start, CallStart;
+static uint64_t WireStart;
+
+static uint64_t Wire(void) {
+	return Sim_Storage.spi_bytes + Sim_Storage.uart_tx_bytes + Sim_Storage.uart_rx_bytes;
+}
+
+static void Begin(void) {
+	Samples = 0;
+	Start = Sim_Cycles;
+	WireStart = Wire();
+}
+
+static void CallBegin(void) {
+	CallStart = Sim_Cycles;
+}
+
+static void CallEnd(void) {
+	if (Samples < MAX_SAMPLES) Latency[Samples++] = (uint32_t)(Sim_Cycles - CallStart);
+}
+
+static int Compare(const void *a, const void *b) {
+	uint32_t x = *(const uint32_t *)a, y = *(const uint32_t *)b;
+	return (x > y) - (x < y);
+}
+
+static double Us(uint32_t cycles) {
+	return (double)cycles/(SIM_BUS_CLOCK/1000000);
+}
+
+// sectors: moved by the test, errors: what went wrong on the way
+static void Report(const char *name, uint32_t sectors, uint32_t errors) {
+	uint64_t cycles = Sim_Cycles - Start;
+	uint64_t wire = Wire() - WireStart;
+	qsort(Latency, Samples, sizeof(Latency[0]), Compare);
+	uint32_t p50 = Samples ? Latency[Samples/2] : 0;
+	uint32_t p90 = Samples ? Latency[Samples*9/10] : 0;
+	uint32_t p99 = Samples ? Latency[Samples*99/100] : 0;
+	uint32_t max = Samples ? Latency[Samples - 1] : 0;
+	printf("  %-12s %10.0f %9.0f %9.0f %9.0f %9.0f %10llu %8.1f %6u\n", name,
+		cycles ? (double)sectors*SIM_BUS_CLOCK/cycles : 0.0, Us(p50), Us(p90), Us(p99), Us(max),
+		(unsigned long long)wire, sectors ? (double)wire/sectors : 0.0, errors);
+}
+
+static void Header(void) {
+	printf("  %-12s %10s %9s %9s %9s %9s %10s %8s %6s\n", "test", "sectors/s", "p50 us", "p90 us", "p99 us",
+		"max us", "wire B", "B/sector", "errors");
+}
+
+static void Fill(uint8_t *data, uint32_t seed) {
+	for (int i = 0; i < SECTOR_SIZE; ++i) data[i] = (uint8_t)(seed*31 + i*7 + (i >> 8));
+}
+
+// what the image file says a sector holds
+static int Matches(const char *path, uint32_t sector, const uint8_t *data) {
+	uint8_t stored[SECTOR_SIZE];
+	int file = open(path, O_RDONLY);
+	int ok = file >= 0 && pread(file, stored, SECTOR_SIZE, (off_t)sector*SECTOR_SIZE) == SECTOR_SIZE
+		&& memcmp(stored, data, SECTOR_SIZE) == 0;
+	if (file >= 0) close(file);
+	return ok;
+}
+
+static uint32_t Random(uint32_t *state) {
+	*state = *state*1664525u + 1013904223u;
+	return *state >> 8;
+}
+
+// seq write, rand read and frame store on one backend
+typedef struct {
+	const char *path;
+	uint32_t sectors;
+	void (*write)(uint32_t sector, uint8_t *data);
+	uint32_t (*read)(uint32_t sector, uint8_t *data);
+	void (*flush)(void);
+	uint32_t (*errors)(void);
+	int cached;        // frames go through SectorCache with a reserved multi-block write (SD_Photo_Routine)
+} Backend;
+
+static void Run(const Backend *backend) {
+	uint32_t errors = backend->errors();
+	uint32_t sectors = Sectors;
+	if (sectors > backend->sectors - DATA_SECTOR) sectors = backend->sectors - DATA_SECTOR;
+	if (sectors > MAX_SAMPLES) sectors = MAX_SAMPLES;
+	Header();
+
+	Begin();
+	if (backend->cached) SDCard_Reserve(sectors);
+	for (uint32_t i = 0; i < sectors; ++i) {
+		Fill(Data, DATA_SECTOR + i);
+		CallBegin();
+		backend->write(DATA_SECTOR + i, Data);
+		CallEnd();
+	}
+	backend->flush();
+	Report("seq write", sectors, backend->errors() - errors);
+
+	uint32_t state = 1, bad = 0;
+	errors = backend->errors();
+	Begin();
+	for (uint32_t i = 0; i < sectors; ++i) {
+		uint32_t sector = DATA_SECTOR + Random(&state)%sectors;
+		CallBegin();
+		if (!backend->read(sector, Readback)) ++bad;
+		CallEnd();
+		if (!Matches(backend->path, sector, Readback)) ++bad;
+	}
+	Report("rand read", sectors, bad + backend->errors() - errors);
+
+	uint32_t frame_sectors = (FRAME_BYTES + SECTOR_SIZE - 1)/SECTOR_SIZE + 1; // header too
+	uint32_t closed = 0;
+	errors = backend->errors();
+	if (backend->cached) {
+		SectorCache_Init(backend->write, backend->read, backend->flush);
+		ImageLog_Open(LOG_SECTOR, LOG_SLOTS, SectorCache_WriteSectorAt, SectorCache_ReadSectorAt, SectorCache_Sync);
+		SectorCache_Keep(LOG_SECTOR);
+		SectorCache_Sync();
+	}
+	else ImageLog_Open(LOG_SECTOR, LOG_SLOTS, backend->write, backend->read, backend->flush);
+	Begin();
+	for (uint32_t frame = 0; frame < Frames; ++frame) {
+		for (uint32_t i = 0; i < FRAME_BYTES; ++i) Picture[i] = (uint8_t)(i*frame + (i >> 9));
+		CallBegin();
+		if (backend->cached) SDCard_Reserve(frame_sectors - 1);
+		ImageLog_Begin(CAMERA_RAW, FRAME_WIDTH, FRAME_HEIGHT);
+		for (uint32_t offset = 0; offset < FRAME_BYTES; offset += PACKAGE) {
+			SectorBuffer_Write(&Picture[offset], (FRAME_BYTES - offset < PACKAGE) ? FRAME_BYTES - offset : PACKAGE);
+		}
+		closed += ImageLog_Close(TimeBase_Ms());
+		if (backend->cached) SectorCache_Sync();
+		else backend->flush();
+		CallEnd();
+	}
+	Report("frame store", Frames*frame_sectors, Frames - closed + backend->errors() - errors);
+	printf("  frame store p50 is per picture (%u sectors)\n", frame_sectors);
+}
+
+static uint32_t SdErrors(void) { return SDCard_Errors + eDisk_CrcErrors; }
+static uint32_t LcdErrors(void) { return LCD_ReplyErrors + LCD_Timeouts; }
+
+static void Disk_Tick(void) { disk_timerproc(); }
+
+static void SdBench(void) {
+	Sim_Reset();
+	Sim_MsTick = Disk_Tick;
+	memset(&Sim_Storage, 0, sizeof(Sim_Storage));
+	if (!Sim_Sd_Open(&Sd)) {
+		printf("sd: can't open %s\n", Sd.path);
+		return;
+	}
+	EnableInterrupts();
+	uint64_t start = Sim_Cycles;
+	if (!SDCard_Init()) {
+		printf("sd: card didn't come up\n");
+		return;
+	}
+	printf("sd card %s: up in %.1f ms, %u kHz%s, %u CRC errors while tuning\n", Sd.path,
+		Us((uint32_t)(Sim_Cycles - start))/1000, SIM_BUS_CLOCK/1000/SDCard_Divisor, SDCard_Tuned ? "" : " (not tuned)",
+		(uint32_t)eDisk_CrcErrors);
+	Backend backend = { Sd.path, Sd.sectors, SDCard_WriteSectorAt, SDCard_ReadSectorAt, SDCard_Flush, SdErrors, 1 };
+	eDisk_CrcErrors = 0;
+	Run(&backend);
+	printf("  %u commands, %u blocks written, %u read, %u CRC errors at the card\n", Sim_Storage.sd_commands,
+		Sim_Storage.sd_blocks_written, Sim_Storage.sd_blocks_read, Sim_Storage.sd_crc_errors);
+}
+
+static void LcdBench(void) {
+	Sim_Reset();
+	Sim_MsTick = 0;
+	memset(&Sim_Storage, 0, sizeof(Sim_Storage));
+	if (!Sim_Display_Open(&Lcd)) {
+		printf("lcd: can't open %s\n", Lcd.path);
+		return;
+	}
+	LCD_UART_Init();
+	EnableInterrupts();
+	uint64_t start = Sim_Cycles;
+	uint32_t baud = LCD_NegotiateBaud();
+	printf("display %s: %u baud after %.1f ms of negotiating\n", Lcd.path, baud, Us((uint32_t)(Sim_Cycles - start))/1000);
+	if (baud == 0) return;
+	LCD_MediaInit();
+	Backend backend = { Lcd.path, Lcd.sectors, LCD_WriteSectorAt, LCD_ReadSectorAt, LCD_FlushMedia, LcdErrors, 0 };
+	Run(&backend);
+	printf("  %u commands, %llu bytes out, %llu in, %u lost\n", Sim_Storage.display_commands,
+		(unsigned long long)Sim_Storage.uart_tx_bytes, (unsigned long long)Sim_Storage.uart_rx_bytes, Sim_Storage.uart_lost);
+}
+
+int main(int argc, char **argv) {
+	const char *only = "";
+	int paths = 0;
+	for (int i = 1; i < argc; ++i) {
+		char *value = strchr(argv[i], '=');
+		if (value == 0) {
+			if (paths == 0) Sd.path = argv[i];
+			else Lcd.path = argv[i];
+			++paths;
+			continue;
+		}
+		*value++ = '\0';
+		if (strcmp(argv[i], "only") == 0) {
+			only = value;
+			continue;
+		}
+		uint32_t j;
+		for (j = 0; j < sizeof(Settings)/sizeof(Settings[0]); ++j) {
+			if (strcmp(argv[i], Settings[j].name) == 0) break;
+		}
+		if (j == sizeof(Settings)/sizeof(Settings[0])) {
+			fprintf(stderr, "unknown setting %s\n", argv[i]);
+			return 1;
+		}
+		*Settings[j].value = strtoul(value, 0, 0);
+	}
+	if (Sd.sectors <= DATA_SECTOR || Lcd.sectors <= DATA_SECTOR) {
+		fprintf(stderr, "cards need more than %u sectors\n", DATA_SECTOR);
+		return 1;
+	}
+	if (strcmp(only, "lcd") != 0) SdBench();
+	if (strcmp(only, "sd") != 0) LcdBench();
+	return 0;
+}